@@ -0,0 +1,16 @@
+#ifndef __ALLOC_HOOK_H__
+#define __ALLOC_HOOK_H__
+
+// Counts heap allocations made through the global operator new (new, new[],
+// std containers, std::function, shared_ptr) anywhere in the process, so a
+// check can assert that a steady-state frame allocates nothing. The
+// replacement operators live in alloc_hook.cpp and cost one relaxed atomic
+// add on top of malloc(). Over-aligned new and direct malloc() calls from C
+// code are not counted.
+class AllocHook {
+public:
+    // allocations since the process started
+    static unsigned long long count();
+};
+
+#endif //__ALLOC_HOOK_H__
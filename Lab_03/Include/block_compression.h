@@ -0,0 +1,24 @@
+#ifndef __BLOCK_COMPRESSION_H__
+#define __BLOCK_COMPRESSION_H__
+
+// BC1/BC4/BC5 style 4x4 block codecs. Blocks hold 16 texels in row-major order,
+// texels are BGRA like TGAColor. Encoders are fast bounding-box fits, decoders
+// work on a single texel so samplers can decode on the fly.
+
+const int BC1_BLOCK_BYTES = 8;
+const int BC4_BLOCK_BYTES = 8;
+const int BC5_BLOCK_BYTES = 16;
+
+// BC1: 5:6:5 endpoints + 2-bit indices, alpha is dropped
+void encode_bc1(const unsigned char *bgra, unsigned char *block);
+void decode_bc1(const unsigned char *block, int i, unsigned char *bgra);
+
+// BC4: one channel, 8-bit endpoints + 3-bit indices; channel is the byte picked from every texel
+void encode_bc4(const unsigned char *bgra, int channel, unsigned char *block);
+unsigned char decode_bc4(const unsigned char *block, int i);
+
+// BC5: R and G as two BC4 blocks, B is rebuilt as the Z of a unit tangent-space normal
+void encode_bc5(const unsigned char *bgra, unsigned char *block);
+void decode_bc5(const unsigned char *block, int i, unsigned char *bgra);
+
+#endif //__BLOCK_COMPRESSION_H__
@@ -0,0 +1,71 @@
+#ifndef __FRAME_ARENA_H__
+#define __FRAME_ARENA_H__
+
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <vector>
+#include "image_view.h"
+
+// Bump allocator for data that lives until the end of the frame: prepared
+// faces, per-tile sums, light culling scratch. Nothing is freed one by one;
+// reset() rewinds the whole arena. Memory is kept across resets, and a frame
+// that spilled into extra blocks gets them merged into one for the next, so
+// once the biggest frame has been seen an arena allocates nothing.
+class Arena {
+public:
+    static const size_t BLOCK_SIZE = 1 << 20;
+
+    Arena();
+    ~Arena();
+
+    void *allocate(size_t bytes, size_t align);
+    void reset();
+    // bytes handed out since the last reset, and what the blocks hold
+    size_t used() const;
+    size_t capacity() const;
+
+    // n default-initialized Ts; no destructors run, so only trivial types
+    template<class T> Span<T> array(int n) {
+        static_assert(std::is_trivially_destructible<T>::value, "arena memory is never destroyed");
+        T *p = n > 0 ? (T *)allocate(sizeof(T)*n, alignof(T)) : NULL;
+        for (int i = 0; i < n; i++) new (p + i) T;
+        Span<T> s = {p, p + (n > 0 ? n : 0)};
+        return s;
+    }
+    template<class T> Span<T> array(int n, const T &value) {
+        Span<T> s = array<T>(n);
+        for (int i = 0; i < s.size(); i++) s[i] = value;
+        return s;
+    }
+
+private:
+    Arena(const Arena &);
+    Arena &operator=(const Arena &);
+
+    struct Block {
+        unsigned char *data;
+        size_t size;
+    };
+    std::vector<Block> blocks_;
+    size_t current_; // block being bumped
+    size_t offset_;  // into blocks_[current_]
+    size_t used_;
+};
+
+// The per-frame arena, one sub-arena per thread so pool workers bump without
+// locking. reset() rewinds all of them: call it between frames, never while
+// a parallel_for is running or frame data is still in use.
+class FrameArena {
+public:
+    // this thread's sub-arena
+    static Arena &local();
+    static void reset();
+    static size_t capacity();
+private:
+    static std::mutex mutex_;
+    static std::vector<Arena *> arenas_;
+};
+
+#endif //__FRAME_ARENA_H__
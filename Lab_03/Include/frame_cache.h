@@ -0,0 +1,57 @@
+#ifndef __FRAME_CACHE_H__
+#define __FRAME_CACHE_H__
+
+#include <cstddef>
+#include "tgaimage.h"
+
+// FNV-1a over raw bytes, for building cache keys out of matrices and shader parameters
+const unsigned long long HASH_SEED = 14695981039346656037ULL;
+unsigned long long hash_bytes(unsigned long long h, const void *data, size_t size);
+template<class T> unsigned long long hash_value(unsigned long long h, const T &v) {
+    return hash_bytes(h, &v, sizeof(T));
+}
+
+// Keeps the opaque pass of the last frame. The caller describes the opaque
+// draws by a key (model, camera, shader state) and the overlay draws by a key
+// and their screen bounds. When only the overlay changed, begin() copies the
+// cached opaque colour and depth back over the dirty rectangle (old plus new
+// overlay bounds) and the caller redraws just the overlays, scissored to it.
+// Everything outside the rectangle still holds the previous frame, so the
+// caller has to pass the same frame buffers every time.
+class FrameCache {
+public:
+    enum Redraw {
+        FULL,    // frame and depth are cleared: draw the opaque pass, store_opaque(), then the overlays
+        PARTIAL, // dirty() was restored: draw the overlays with dirty() as scissor
+        NONE     // nothing changed, the frame is already up to date
+    };
+    struct Stats {
+        unsigned long full;
+        unsigned long partial;
+        unsigned long unchanged;
+        unsigned long long restored_pixels;
+    };
+
+    FrameCache();
+    Redraw begin(unsigned long long opaque_key, unsigned long long overlay_key, const Rect &overlay_bounds,
+                 ImageView<RGB8> frame, ImageView<Gray8> depth);
+    const Rect &dirty() const;
+    void store_opaque(ImageView<const RGB8> frame, ImageView<const Gray8> depth);
+    // the next begin() returns FULL
+    void invalidate();
+    Stats stats() const;
+
+private:
+    TGAImage color_;
+    TGAImage depth_;
+    bool valid_;
+    unsigned long long opaque_key_;
+    unsigned long long overlay_key_;
+    Rect overlay_bounds_;
+    const RGB8 *frame_;  // buffers the cached frame was drawn into
+    const Gray8 *zbuffer_;
+    Rect dirty_;
+    Stats stats_;
+};
+
+#endif //__FRAME_CACHE_H__
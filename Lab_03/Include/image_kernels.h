@@ -0,0 +1,39 @@
+#ifndef __IMAGE_KERNELS_H__
+#define __IMAGE_KERNELS_H__
+
+#include "image_view.h"
+
+// Whole-image pixel kernels. SSE2/SSSE3 paths are used when the compiler targets
+// them, with scalar loops producing the same bytes otherwise. Images larger than
+// KERNEL_PARALLEL_PIXELS are split into row blocks on the thread pool.
+// Source and destination views must not overlap unless a kernel says "in place".
+
+const long KERNEL_PARALLEL_PIXELS = 1<<16;
+
+// in place
+template<class T> void flip_vertical(ImageView<T> img);
+template<class T> void flip_horizontal(ImageView<T> img);
+
+// nearest neighbour, any ratio
+template<class T> void resize_nearest(ImageView<const T> src, ImageView<T> dst);
+// bilinear with pixel-centre alignment, any ratio
+template<class T> void resize_bilinear(ImageView<const T> src, ImageView<T> dst);
+// average of the source footprint of every destination pixel; for shrinking
+template<class T> void downscale_box(ImageView<const T> src, ImageView<T> dst);
+
+// format conversion, luma is Rec.601 in 8.8 fixed point
+void convert(ImageView<const RGB8>  src, ImageView<RGBA8> dst);
+void convert(ImageView<const RGBA8> src, ImageView<RGB8>  dst);
+void convert(ImageView<const Gray8> src, ImageView<RGB8>  dst);
+void convert(ImageView<const RGB8>  src, ImageView<Gray8> dst);
+void convert(ImageView<const RGBA8> src, ImageView<Gray8> dst);
+// BGR <-> RGB channel order, in place
+void swap_red_blue(ImageView<RGB8>  img);
+void swap_red_blue(ImageView<RGBA8> img);
+
+// premultiplied alpha: premultiply() in place, then dst = src + dst*(1-src.a)
+void premultiply(ImageView<RGBA8> img);
+void composite_over(ImageView<const RGBA8> src, ImageView<RGBA8> dst);
+void composite_over(ImageView<const RGBA8> src, ImageView<RGB8>  dst);
+
+#endif //__IMAGE_KERNELS_H__
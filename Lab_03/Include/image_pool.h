@@ -0,0 +1,29 @@
+#ifndef __IMAGE_POOL_H__
+#define __IMAGE_POOL_H__
+
+#include <mutex>
+#include <vector>
+#include "tgaimage.h"
+
+// Framebuffers and staging images handed back after use instead of freed:
+// previews, the post-processing target, texture preview stand-ins. acquire()
+// reuses a released image of the same size and format, so a frame that asks
+// for the same buffers as the last one allocates nothing.
+class ImagePool {
+public:
+    static const size_t MAX_FREE = 16; // beyond this, released images are freed
+
+    static ImagePool &instance();
+
+    // a cleared w x h image
+    TGAImage acquire(int w, int h, int bytespp);
+    void release(TGAImage &&img);
+    // frees every pooled image
+    void trim();
+
+private:
+    std::mutex mutex_;
+    std::vector<TGAImage> free_;
+};
+
+#endif //__IMAGE_POOL_H__
@@ -0,0 +1,102 @@
+#ifndef __IMAGE_VIEW_H__
+#define __IMAGE_VIEW_H__
+
+// Non-owning, read-only window on a packed pixel buffer (rows are width*bytespp
+// bytes, no padding). Encoders take this instead of a TGAImage so nothing is copied.
+struct ConstImageView {
+    const unsigned char *data;
+    int width;
+    int height;
+    int bytespp;
+
+    ConstImageView() : data(0), width(0), height(0), bytespp(0) {}
+    ConstImageView(const unsigned char *d, int w, int h, int bpp) : data(d), width(w), height(h), bytespp(bpp) {}
+
+    const unsigned char *row(int y) const { return data + (unsigned long)y*width*bytespp; }
+    unsigned long size() const { return (unsigned long)width*height*bytespp; }
+};
+
+/////////////////////////////////////////////////////////////////////////////////
+
+// Half-open pixel rectangle [x0, x1) x [y0, y1).
+struct Rect {
+    int x0, y0, x1, y1;
+
+    Rect() : x0(0), y0(0), x1(0), y1(0) {}
+    Rect(int ax0, int ay0, int ax1, int ay1) : x0(ax0), y0(ay0), x1(ax1), y1(ay1) {}
+
+    int width() const { return x1-x0; }
+    int height() const { return y1-y0; }
+    bool empty() const { return x1<=x0 || y1<=y0; }
+    bool operator==(const Rect &o) const { return x0==o.x0 && y0==o.y0 && x1==o.x1 && y1==o.y1; }
+    bool operator!=(const Rect &o) const { return !(*this==o); }
+
+    Rect intersect(const Rect &o) const {
+        return Rect(x0>o.x0 ? x0 : o.x0, y0>o.y0 ? y0 : o.y0, x1<o.x1 ? x1 : o.x1, y1<o.y1 ? y1 : o.y1);
+    }
+    // bounding box of both; an empty rectangle doesn't count
+    Rect unite(const Rect &o) const {
+        if (empty()) return o;
+        if (o.empty()) return *this;
+        return Rect(x0<o.x0 ? x0 : o.x0, y0<o.y0 ? y0 : o.y0, x1>o.x1 ? x1 : o.x1, y1>o.y1 ? y1 : o.y1);
+    }
+    Rect grow(int r) const { return Rect(x0-r, y0-r, x1+r, y1+r); }
+};
+
+/////////////////////////////////////////////////////////////////////////////////
+
+// Pixel formats, laid out in memory the way TGA stores them (blue first).
+struct RGB8 {
+    unsigned char b, g, r;
+};
+
+struct RGBA8 {
+    unsigned char b, g, r, a;
+};
+
+typedef unsigned char Gray8;
+
+// float working format for post-processing and blending buffers
+struct RGBAf {
+    float r, g, b, a;
+};
+
+static_assert(sizeof(RGB8)==3 && sizeof(RGBA8)==4, "pixel formats must be packed");
+
+template<class T> struct Span {
+    T *first;
+    T *last;
+
+    T *begin() const { return first; }
+    T *end() const { return last; }
+    int size() const { return (int)(last-first); }
+    T &operator[](int i) const { return first[i]; }
+};
+
+// Typed, non-owning view with a compile-time pixel format. No bounds checks:
+// callers clip once per primitive and then walk rows through row()/span().
+// The stride is in pixels, so sub-views of a larger buffer are cheap.
+template<class T> class ImageView {
+    T *data_;
+    int width_;
+    int height_;
+    long stride_;
+public:
+    ImageView() : data_(0), width_(0), height_(0), stride_(0) {}
+    ImageView(T *d, int w, int h) : data_(d), width_(w), height_(h), stride_(w) {}
+    ImageView(T *d, int w, int h, long stride) : data_(d), width_(w), height_(h), stride_(stride) {}
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    long stride() const { return stride_; }
+    bool empty() const { return !data_; }
+
+    T *row(int y) const { return data_ + y*stride_; }
+    Span<T> span(int y) const { Span<T> s = {row(y), row(y)+width_}; return s; }
+    T &operator()(int x, int y) const { return data_[y*stride_ + x]; }
+
+    ImageView sub(int x, int y, int w, int h) const { return ImageView(data_ + y*stride_ + x, w, h, stride_); }
+    operator ImageView<const T>() const { return ImageView<const T>(data_, width_, height_, stride_); }
+};
+
+#endif //__IMAGE_VIEW_H__
@@ -0,0 +1,31 @@
+#ifndef __IMAGE_WRITER_H__
+#define __IMAGE_WRITER_H__
+
+#include <vector>
+#include "image_view.h"
+
+// Output encoder beside TGAImage::write_tga_file. Formats that can be cut into
+// independent horizontal stripes (QOI, PPM, raw) encode large frames stripe by
+// stripe on the thread pool and concatenate the results.
+class ImageWriter {
+public:
+    virtual ~ImageWriter();
+    virtual const char *name() const = 0;
+    virtual const char *extension() const = 0;
+    virtual void encode(const ConstImageView &img, std::vector<unsigned char> &out) const;
+    bool write(const ConstImageView &img, const char *filename) const;
+
+protected:
+    virtual void header(const ConstImageView &img, std::vector<unsigned char> &out) const;
+    virtual void stripe(const ConstImageView &img, int y0, int y1, std::vector<unsigned char> &out) const = 0;
+    virtual void footer(const ConstImageView &img, std::vector<unsigned char> &out) const;
+};
+
+// "tga", "tga-raw", "qoi", "ppm" or "raw"; NULL if unknown
+const ImageWriter *image_writer(const char *format);
+// picks the writer from the file extension, NULL if unknown
+const ImageWriter *image_writer_for(const char *filename);
+// format may be NULL, then the extension decides
+bool write_image(const ConstImageView &img, const char *filename, const char *format=NULL);
+
+#endif //__IMAGE_WRITER_H__
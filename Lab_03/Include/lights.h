@@ -0,0 +1,60 @@
+#ifndef __LIGHTS_H__
+#define __LIGHTS_H__
+
+#include <vector>
+#include "tgaimage.h"
+#include "../Include/math.h"
+
+// Local light with a finite range: contributes (1 - d²/r²)² of its colour at
+// distance d and nothing past radius, so culling by a sphere is exact.
+struct Light {
+    enum Type { POINT, SPOT };
+    Type  type;
+    Vec3f position;  // world space
+    Vec3f direction; // spot axis, world space
+    Vec3f color;     // 1 = full intensity of the channel
+    float radius;
+    float cos_inner; // spot cone: full intensity inside, none outside cos_outer
+    float cos_outer;
+
+    static Light point(Vec3f position, Vec3f color, float radius);
+    static Light spot(Vec3f position, Vec3f direction, Vec3f color, float radius, float inner_deg, float outer_deg);
+};
+
+// Tiled light culling. build() splits the depth buffer of a finished depth
+// pass into TILE x TILE tiles, takes each tile's depth min/max over covered
+// pixels, and keeps a compact index list of the lights whose sphere overlaps
+// the tile's screen rectangle and depth range. Shaders then loop over
+// lights(x, y) only. Lights are moved to eye space (ModelView) on build.
+class LightGrid {
+public:
+    static const int TILE = 16;
+    struct Stats {
+        int lights;
+        int tiles;        // tiles with geometry
+        long references;  // sum of the per-tile list lengths
+        int max_per_tile;
+    };
+
+    LightGrid();
+    // cull=false puts every light into every covered tile, for comparisons
+    void build(const std::vector<Light> &lights, ImageView<const Gray8> depth, bool cull=true);
+    void clear();
+    int size() const;
+    const Light &light(int i) const; // eye space
+    Span<const int> lights(int x, int y) const;
+    Stats stats() const;
+
+private:
+    int width_;
+    int height_;
+    int tiles_x_;
+    int tiles_y_;
+    std::vector<Light> eye_;
+    std::vector<int> zmin_;    // per tile, -1 when nothing was drawn there
+    std::vector<int> zmax_;
+    std::vector<int> offsets_; // tiles_x*tiles_y+1 starts into indices_
+    std::vector<int> indices_;
+};
+
+#endif //__LIGHTS_H__
@@ -2,31 +2,86 @@
 #define __MODEL_H__
 #include <vector>
 #include <string>
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
 #include "math.h"
 #include "tgaimage.h"
+#include "texture.h"
 
+// Texture maps live in the shared TextureCache and are decoded on a loader
+// thread when a shader first samples them or declares them with prefetch() or
+// require(). Until the full texture arrives, sampling returns a low-resolution
+// preview of it.
 class Model {
+public:
+    enum TextureMap {
+        DIFFUSE, NORMAL, SPECULAR
+    };
 private:
+    struct TextureSlot {
+        std::string path;
+        Texture::Format format;
+        std::shared_ptr<const Texture> texture;  // full resolution
+        std::shared_ptr<const Texture> preview;  // kept alive, samplers may still hold it
+        std::atomic<const Texture *> current;    // what texture() hands out
+        bool final;
+        std::shared_future<void> pending;
+        std::mutex mutex;
+        std::condition_variable arrived;
+    };
+
     std::vector<Vec3f> verts_;
-    std::vector<std::vector<Vec3i> > faces_; // attention, this Vec3i means vertex/uv/normal
+    // corners of all faces back to back, attention, this Vec3i means vertex/uv/normal;
+    // face i is corners_[faces_[i]] .. corners_[faces_[i+1]-1]
+    std::vector<Vec3i> corners_;
+    std::vector<int> faces_;
     std::vector<Vec3f> norms_;
     std::vector<Vec2f> uv_;
-    TGAImage diffusemap_;
-    TGAImage normalmap_;
-    TGAImage specularmap_;
-    void load_texture(std::string filename, const char *suffix, TGAImage &img);
+    TextureSlot maps_[3];
+    Texture::Filter filter_;
+    void texture_path(std::string filename, const char *suffix, TextureMap map);
+    const Texture &texture(TextureMap map);
+    const Texture &wait_texture(TextureMap map);
+    void load_texture(TextureMap map);
+    void publish(TextureMap map, const std::shared_ptr<const Texture> &tex, bool final);
 public:
-    Model(const char *filename);
+    // prefetch: bitmask of (1<<TextureMap) to start decoding before the OBJ is parsed
+    Model(const char *filename, int prefetch=0, bool compressed=false);
     ~Model();
     int nverts();
     int nfaces();
     Vec3f normal(int iface, int nthvert);
     Vec3f normal(Vec2f uv);
+    Vec3f normal(Vec2f uv, Vec2f duvdx, Vec2f duvdy);
     Vec3f vert(int i);
     Vec3f vert(int iface, int nthvert);
+    int nnormals();
+    Vec3f normal(int i);
+    // vertex/uv/normal indices of a face corner
+    Vec3i corner(int iface, int nthvert);
     Vec2f uv(int iface, int nthvert);
     TGAColor diffuse(Vec2f uv);
+    TGAColor diffuse(Vec2f uv, Vec2f duvdx, Vec2f duvdy);
     float specular(Vec2f uv);
-    std::vector<int> face(int idx);
+    float specular(Vec2f uv, Vec2f duvdx, Vec2f duvdy);
+    void texture_filter(Texture::Filter f);
+    // BC1/BC5/BC4 for the maps loaded from now on; maps already loaded are
+    // swapped for their compressed version, so don't call it while rendering
+    void compress_textures();
+    // starts loading the map in the background; the handle is ready once the
+    // full texture is in
+    std::shared_future<void> prefetch(TextureMap map);
+    // blocks until the full texture is in
+    void require(TextureMap map);
+    bool loaded(TextureMap map);
+    // the face's corners, straight from the model's storage
+    Span<const Vec3i> face(int idx);
 };
+
+// parses the OBJ on a loader thread while the prefetched maps decode on others
+std::shared_future<std::shared_ptr<Model> > load_model_async(const char *filename, int prefetch=0, bool compressed=false);
+
 #endif //__MODEL_H__
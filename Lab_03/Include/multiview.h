@@ -0,0 +1,43 @@
+#ifndef __MULTIVIEW_H__
+#define __MULTIVIEW_H__
+
+#include <vector>
+#include "mesh.h"
+#include "../Include/math.h"
+
+// One camera of a multi-view draw: the three matrices our_gl keeps globally.
+struct View {
+    Matrix model_view;
+    Matrix projection;
+    Matrix viewport;
+};
+
+// Vertex stage of a model for several cameras at once. Positions and normals
+// are fetched from the model once into SoA arrays, then every view's matrices
+// are applied in flat loops over the arrays that the compiler vectorizes;
+// faces just gather the results by index. The arithmetic is the one of
+// Matrix*Vec4f in the same order, so each view matches a single-camera
+// vertex() bit for bit.
+class MultiViewTransform {
+public:
+    MultiViewTransform();
+    void transform(Model &model, const std::vector<View> &views);
+    int views() const;
+    // clip-space position for the rasterizer (Viewport*Projection*ModelView)
+    Vec4f clip(int view, int vert) const;
+    // eye-space position and unit normal (ModelView)
+    Vec3f eye(int view, int vert) const;
+    Vec3f normal(int view, int norm) const;
+
+private:
+    struct Transformed {
+        std::vector<float> cx, cy, cz, cw;
+        std::vector<float> ex, ey, ez;
+        std::vector<float> nx, ny, nz;
+    };
+    std::vector<float> px_, py_, pz_; // model space, fetched once
+    std::vector<float> qx_, qy_, qz_;
+    std::vector<Transformed> out_;
+};
+
+#endif //__MULTIVIEW_H__
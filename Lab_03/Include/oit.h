@@ -0,0 +1,54 @@
+#ifndef __OIT_H__
+#define __OIT_H__
+
+#include <vector>
+#include "tgaimage.h"
+
+// Weighted blended order-independent transparency (McGuire & Bavoil, JCGT 2013).
+// Transparent fragments that pass the depth test against the opaque z-buffer add
+// their premultiplied colour times a depth weight to accum and multiply
+// revealage by (1-alpha); nothing is sorted and nothing writes depth. resolve()
+// then composites the weighted average over the opaque frame.
+// Colours stay in the 0..1 range of the 8-bit frame, like alphaBlendPixel.
+class OITBuffer {
+public:
+    OITBuffer();
+    OITBuffer(int width, int height);
+    int width() const;
+    int height() const;
+    // accum to zero, revealage to one
+    void clear();
+    void clear(const Rect &r);
+
+    // w(z, alpha) of the paper; nearer fragments (bigger depth) weigh more
+    static float weight(float alpha, int depth) {
+        float z = 1.f - depth*(1.f/255.f);
+        float w = .03f/(1e-5f + z*z*z*z);
+        return alpha*(w<1e-2f ? 1e-2f : (w>3e3f ? 3e3f : w));
+    }
+    void add(int x, int y, const TGAColor &c, float alpha, int depth) {
+        float w = alpha*weight(alpha, depth);
+        float wc = w*(1.f/255.f);
+        RGBAf &a = accum_[(size_t)y*width_ + x];
+        a.r += c[2]*wc;
+        a.g += c[1]*wc;
+        a.b += c[0]*wc;
+        a.a += w;
+        revealage_[(size_t)y*width_ + x] *= 1.f - alpha;
+    }
+
+    // frame = average * (1 - revealage) + frame * revealage, inside r
+    void resolve(ImageView<RGB8>  frame, const Rect &r) const;
+    void resolve(ImageView<RGBA8> frame, const Rect &r) const;
+
+    ImageView<const RGBAf> accum() const;
+    ImageView<const float> revealage() const;
+
+private:
+    int width_;
+    int height_;
+    std::vector<RGBAf> accum_;
+    std::vector<float> revealage_;
+};
+
+#endif //__OIT_H__
@@ -1,24 +1,90 @@
 #ifndef __OUR_GL_H__
 #define __OUR_GL_H__
 
+#include <vector>
 #include "tgaimage.h"
+#include "oit.h"
+#include "lights.h"
+#include "thread_pool.h"
 #include "../Include/math.h"
 
 extern Matrix ModelView;
 extern Matrix Viewport;
 extern Matrix Projection;
+extern std::vector<Light> Lights; // world space; shaders read them through a LightGrid
 
 void viewport(int x, int y, int w, int h);
 void projection(float coeff=0.f);
 void lookat(Vec3f eye, Vec3f center, Vec3f up);
+void add_light(const Light &light);
+void clear_lights();
+
+// Per-tile coarse shading rate: fragment() runs once per rate x rate block
+// (1, 2 or 4) and its colour goes to every covered pixel of the block.
+// Depth and coverage stay per pixel.
+class ShadingRateMap {
+public:
+    static const int TILE = 16;
+    ShadingRateMap();
+    void reset(int width, int height, int rate=1);
+    void set(int tx, int ty, int rate);
+    int rate(int x, int y) const;
+    int tiles_x() const;
+    int tiles_y() const;
+private:
+    int tiles_x_;
+    int tiles_y_;
+    std::vector<unsigned char> rates_;
+};
 
 struct IShader{
     float alpha = 0.0f;
+    Vec3f bar_ddx; // barycentric derivatives across the 2x2 pixel quad being shaded,
+    Vec3f bar_ddy; // varying*bar_ddx gives d(varying)/dx for texture LOD selection
+    Vec2i frag_coord; // pixel being shaded
+    int shading_rate = 1;                    // per draw, 1, 2 or 4
+    const ShadingRateMap *rate_map = NULL;   // per tile, overrides shading_rate
     virtual ~IShader();
     virtual Vec4f vertex(int iface, int nthvert) = 0;
     virtual bool fragment(Vec3f bar, TGAColor &color) = 0;
 };
 
 void triangle(Vec4f *pts, IShader &shader, TGAImage &image, TGAImage &zbuffer);
+void triangle(Vec4f *pts, IShader &shader, ImageView<RGB8>  image, ImageView<Gray8> zbuffer);
+void triangle(Vec4f *pts, IShader &shader, ImageView<RGBA8> image, ImageView<Gray8> zbuffer);
+// only pixels inside scissor are touched
+void triangle(Vec4f *pts, IShader &shader, ImageView<RGB8>  image, ImageView<Gray8> zbuffer, const Rect &scissor);
+void triangle(Vec4f *pts, IShader &shader, ImageView<RGBA8> image, ImageView<Gray8> zbuffer, const Rect &scissor);
+// depth only, for a pre-pass: fragment shaders are not run
+void triangle(Vec4f *pts, ImageView<Gray8> zbuffer, const Rect &scissor);
+// transparent fragments into OIT buffers: depth-tested against zbuffer, which is not written
+void triangle(Vec4f *pts, IShader &shader, OITBuffer &oit, ImageView<const Gray8> zbuffer, const Rect &scissor);
+// screen rectangle a triangle with these clip-space vertices can touch
+Rect triangle_bounds(const Vec4f *pts);
+
+// Sort-first parallel drawing. The screen is cut into bands of rows; a band is
+// drawn by one thread with only the triangles that touch it, in submission
+// order, so every pixel sees exactly the writes of a serial draw. The caller
+// shades each band with its own shader instance and passes band() as scissor.
+class TileBins {
+public:
+    static const int BAND_ROWS = 32;
+    TileBins();
+    // keeps the bins' memory from the last frame
+    void reset(int width, int height);
+    void add(int tri, const Rect &bounds);
+    int bands() const;
+    Rect band(int i) const;
+    const std::vector<int> &triangles(int band) const;
+private:
+    int width_;
+    int height_;
+    std::vector<std::vector<int> > bins_;
+};
+
+// draw(band, triangles) for every band, on the thread pool
+template<class F> void draw_bands(const TileBins &bins, F &&draw) {
+    ThreadPool::instance().parallel_for(bins.bands(), [&](int b) { draw(bins.band(b), bins.triangles(b)); });
+}
 
 #endif //__OUR_GL_H__
@@ -0,0 +1,119 @@
+#ifndef __PASS_GRAPH_H__
+#define __PASS_GRAPH_H__
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "thread_pool.h"
+#include "../Include/math.h"
+
+// One RGBA float texel, named like the GLSL vec4 the passes were written with.
+struct Texel {
+    float x, y, z, w;
+    Texel() : x(0), y(0), z(0), w(0) {}
+    Texel(float X, float Y, float Z, float W) : x(X), y(Y), z(Z), w(W) {}
+    Texel(const Vec3f &v, float W) : x(v.x), y(v.y), z(v.z), w(W) {}
+    Vec3f xyz() const { return Vec3f(x, y, z); }
+};
+
+// width x height texels, row 0 at the bottom like fragCoord
+class PassBuffer {
+public:
+    PassBuffer();
+    void resize(int width, int height);
+    int width() const { return width_; }
+    int height() const { return height_; }
+    // texelFetch; outside the buffer reads zero
+    Texel fetch(int x, int y) const {
+        if (x < 0 || y < 0 || x >= width_ || y >= height_) return Texel();
+        return data_[y*width_ + x];
+    }
+    Texel *row(int y) { return &data_[y*width_]; }
+    void clear();
+
+private:
+    int width_, height_;
+    std::vector<Texel> data_;
+};
+
+// Uniforms of one frame, as ShaderToy sets them.
+struct PassInputs {
+    int frame;          // iFrame, set by PassGraph::step()
+    float time;         // iTime
+    float time_delta;   // iTimeDelta
+    Texel mouse;        // iMouse
+    bool keys[256];     // key held, by JavaScript key code
+
+    PassInputs();
+};
+
+// What a pass sees while it runs: the uniforms and its four channels.
+struct PassContext {
+    const PassInputs *in;
+    const PassBuffer *channel[4];
+
+    Texel fetch(int ch, int x, int y) const { return channel[ch] ? channel[ch]->fetch(x, y) : Texel(); }
+};
+
+// mainImage(): the value of texel (x, y); fragCoord is (x + .5, y + .5)
+typedef std::function<Texel(const PassContext &, int x, int y)> PassFunc;
+
+// Runs a ShaderToy-style program of buffer passes. Passes are kept in the
+// order they were added (Buffer A, B, ...); a channel bound to an earlier
+// pass reads what it wrote this frame, a channel bound to itself or to a
+// later pass reads the previous frame, which is why every pass owns two
+// buffers and swaps them after the frame. Passes that don't read each
+// other's current output form one wave, and a wave goes to the pool as a
+// single parallel_for over row blocks; a wave of only tiny passes (the
+// 1-texel control buffers) runs on the calling thread without waking the pool.
+class PassGraph {
+public:
+    static const int UNBOUND = -2;  // channel source: reads zero
+    static const int KEYBOARD = -1; // channel source: the 256x3 keyboard texture
+    static const int SMALL_WAVE = 4096; // texels below which a wave runs inline
+    static const int ROW_BLOCK = 16;
+
+    PassGraph();
+
+    // returns the pass id
+    int add_pass(const std::string &name, int width, int height, const PassFunc &f);
+    // channel ch of pass reads source (a pass id or KEYBOARD)
+    void bind(int pass, int ch, int source);
+    // buffers back to zero, iFrame restarts
+    void reset();
+
+    // runs every pass once; in.frame is ignored, iFrame counts the steps since reset()
+    void step(const PassInputs &in, ThreadPool &pool);
+
+    // the pass's output of the last step()
+    const PassBuffer &output(int pass) const;
+    int passes() const { return (int)passes_.size(); }
+    // waves of the last step(), for the stats line
+    int waves() const { return waves_; }
+
+private:
+    struct Pass {
+        std::string name;
+        PassFunc func;
+        int source[4];
+        PassBuffer buffer[2];
+    };
+    struct Job {
+        int pass;
+        int y0, y1;
+    };
+
+    const PassBuffer *channel_buffer(int pass, int source) const;
+    void update_keyboard(const PassInputs &in);
+    void run_job(const Job &j, const PassInputs &in);
+
+    std::vector<Pass> passes_;
+    PassBuffer keyboard_;
+    bool keys_prev_[256];
+    int front_; // buffer[front_] gets written this frame
+    int frame_;
+    int waves_;
+    std::vector<Job> jobs_;
+};
+
+#endif //__PASS_GRAPH_H__
@@ -0,0 +1,139 @@
+#ifndef __PIPELINE_STATS_H__
+#define __PIPELINE_STATS_H__
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "tgaimage.h"
+
+// Where a frame goes: counts at every pipeline stage, wall time per stage and
+// two per-pixel heatmaps. Built only with RENDERER_STATS; without it the
+// STATS_* macros below expand to nothing and no stage pays for anything.
+//
+// Counters are per thread, so the pixel loops never share a cache line, and
+// merged by collect() at the end of a frame, when the pool is idle.
+enum PipelineStage {
+    STAGE_VERTEX,        // vertex() for every face, screen culling
+    STAGE_PREVIEW,       // progressive 1/8..1/2 frames
+    STAGE_DEPTH_PREPASS,
+    STAGE_LIGHT_CULLING,
+    STAGE_BINNING,       // triangles into bands
+    STAGE_RASTER,        // rasterization and shading of the head
+    STAGE_BLEND,         // the transparent cube
+    STAGE_POST,
+    STAGE_COUNT
+};
+
+struct PipelineCounters {
+    unsigned long long vertices_shaded;
+    unsigned long long triangles_submitted;
+    unsigned long long triangles_culled;     // entirely off screen
+    unsigned long long triangles_clipped;    // partly off screen, drawn cut to it
+    unsigned long long triangles_rasterized; // covered a pixel of the frame, once however many bands
+    unsigned long long pixels_covered;
+    unsigned long long pixels_depth_tested;
+    unsigned long long pixels_depth_passed;
+    unsigned long long pixels_shaded;        // fragment() calls
+    unsigned long long pixels_written;       // opaque stores, every pixel of a coarse block
+    unsigned long long pixels_blended;       // alpha blends and OIT fragments
+    unsigned long long pixels_discarded;     // fragment() returned true
+    unsigned long long stage_ns[STAGE_COUNT];
+
+    PipelineCounters();
+    void add(const PipelineCounters &c);
+};
+
+class PipelineStats {
+public:
+    static PipelineStats &instance();
+    // this thread's counters
+    static PipelineCounters &local();
+
+    // per-pixel overdraw and fragment() time for draws into a width x height
+    // target; smaller targets (previews) are not recorded. 0 x 0 turns them off
+    void heatmaps(int width, int height);
+    // the heatmap arrays for a draw into width x height, NULL when not recorded
+    unsigned short *overdraw(int width, int height);
+    float *shading_ns(int width, int height);
+
+    // sum of every thread's counters since the last collect(); resets them
+    PipelineCounters collect();
+    static const char *stage_name(int stage);
+
+    // overdraw: 0 black, then blue, cyan, green, yellow, red, white at 6+.
+    // shading cost: black-red-yellow-white up to the 99th percentile pixel
+    TGAImage overdraw_image() const;
+    TGAImage shading_cost_image() const;
+
+    // frames as one JSON document; amend_frame() adds work done after the last
+    // frame ended (post-processing) to it
+    void add_frame(const PipelineCounters &c, double frame_ms);
+    void amend_frame(const PipelineCounters &c, double ms);
+    bool write_json(const char *filename) const;
+
+    class Timer {
+    public:
+        explicit Timer(PipelineStage stage) : stage_(stage), start_(std::chrono::steady_clock::now()) {}
+        ~Timer() {
+            PipelineStats::local().stage_ns[stage_] += (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start_).count();
+        }
+    private:
+        PipelineStage stage_;
+        std::chrono::steady_clock::time_point start_;
+    };
+
+private:
+    PipelineStats();
+
+    std::mutex mutex_;
+    std::vector<PipelineCounters *> threads_;
+    int width_;
+    int height_;
+    std::vector<unsigned short> overdraw_;
+    std::vector<float> shading_ns_;
+    std::vector<std::pair<PipelineCounters, double> > frames_;
+};
+
+// Triangles of one banded draw that covered a pixel, each counted once however
+// many bands it was cut into. Bands wrap every triangle() in STATS_TRIANGLE;
+// the total goes to triangles_rasterized when the draw is over. Flags live in
+// the frame arena.
+class RasterizedTriangles {
+public:
+    explicit RasterizedTriangles(int triangles);
+    ~RasterizedTriangles();
+    // pixels_covered of this thread, before the draw
+    static unsigned long long covered() { return PipelineStats::local().pixels_covered; }
+    void drew(int tri, unsigned long long covered_before) {
+        if (tri < covered_.size() && covered() != covered_before) covered_[tri].store(true, std::memory_order_relaxed);
+    }
+private:
+    RasterizedTriangles(const RasterizedTriangles &);
+    RasterizedTriangles &operator=(const RasterizedTriangles &);
+
+    Span<std::atomic<bool> > covered_;
+};
+
+#ifdef RENDERER_STATS
+#define STATS_ENABLED 1
+#define STATS_CAT2(a, b) a##b
+#define STATS_CAT(a, b) STATS_CAT2(a, b)
+// stage wall time: the scope's duration on the calling thread
+#define STATS_TIMER(stage) PipelineStats::Timer STATS_CAT(stats_timer_, __LINE__)(stage)
+#define STATS_ADD(counter, n) (PipelineStats::local().counter += (n))
+// one triangle() call of a banded draw, counted into a RasterizedTriangles
+#define STATS_RASTERIZED(name, triangles) RasterizedTriangles name(triangles)
+#define STATS_TRIANGLE(name, tri, draw) \
+    do { unsigned long long stats_covered_ = RasterizedTriangles::covered(); draw; name.drew(tri, stats_covered_); } while (0)
+#else
+#define STATS_ENABLED 0
+#define STATS_TIMER(stage) ((void)0)
+#define STATS_ADD(counter, n) ((void)0)
+#define STATS_RASTERIZED(name, triangles) ((void)0)
+#define STATS_TRIANGLE(name, tri, draw) draw
+#endif
+
+#endif //__PIPELINE_STATS_H__
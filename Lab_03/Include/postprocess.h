@@ -0,0 +1,139 @@
+#ifndef __POSTPROCESS_H__
+#define __POSTPROCESS_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "image_view.h"
+
+// Screen-space post-processing on linear float colour. The frame is cut into
+// tiles; every tile is loaded once, pushed through all enabled passes while it
+// sits in cache, and stored once. A pass that reads neighbours declares its
+// radius(), and each tile is loaded with a halo big enough for the passes after
+// it, so the fused result matches running the passes one by one over the frame.
+// Colour is linear RGBAf; its alpha is free for the passes (SSAO keeps AO there).
+
+// Buffer covering [x0, x0+width) x [y0, y0+height) of the frame, in frame coordinates.
+struct PostTile {
+    ImageView<RGBAf> pixels;
+    int x0;
+    int y0;
+    int frame_width;
+    int frame_height;
+
+    int x1() const { return x0 + pixels.width(); }
+    int y1() const { return y0 + pixels.height(); }
+    RGBAf &operator()(int x, int y) const { return pixels(x-x0, y-y0); }
+    // clamp-to-edge read; the source tile of a pass always covers the clamped position
+    const RGBAf &clamped(int x, int y) const {
+        x = x<0 ? 0 : (x>=frame_width  ? frame_width-1  : x);
+        y = y<0 ? 0 : (y>=frame_height ? frame_height-1 : y);
+        return pixels(x-x0, y-y0);
+    }
+};
+
+// Read-only inputs shared by every tile.
+struct PostContext {
+    ImageView<const Gray8> depth; // the rasterizer's z-buffer, 255 is nearest, 0 is empty
+};
+
+class PostPass {
+public:
+    virtual ~PostPass();
+    virtual const char *name() const = 0;
+    // how far around a pixel the pass reads its colour input
+    virtual int radius() const = 0;
+    // writes every pixel of dst; src covers dst grown by radius(), clipped to the frame
+    virtual void run(const PostTile &src, const PostTile &dst, const PostContext &ctx) const = 0;
+};
+
+// ambient occlusion from the depth buffer into RGBAf::a. Taps come in opposite
+// pairs; a pair occludes when the surface bends towards the viewer between them,
+// so flat slopes stay unshaded. The pair directions rotate over a 4x4 pattern.
+class SSAOPass : public PostPass {
+    std::vector<int> offsets_; // 16 rotations x samples/2 pairs x (dx, dy)
+    int samples_;
+    float radius_;   // in pixels
+    float range_;    // depth levels beyond which an occluder doesn't count
+    float strength_;
+public:
+    SSAOPass(int samples=12, float radius=10.f, float range=24.f, float strength=1.f);
+    virtual const char *name() const { return "ssao"; }
+    virtual int radius() const { return 0; }
+    virtual void run(const PostTile &src, const PostTile &dst, const PostContext &ctx) const;
+};
+
+// 4x4 box blur of the AO term (hides the 4x4 rotation pattern), then rgb *= ao
+class AOBlurPass : public PostPass {
+public:
+    virtual const char *name() const { return "ssao-blur"; }
+    virtual int radius() const { return 2; }
+    virtual void run(const PostTile &src, const PostTile &dst, const PostContext &ctx) const;
+};
+
+// exposure, then the ACES filmic curve (Narkowicz fit) as a look on the LDR
+// frame. Not a tone mapper: the rasterizer writes 8-bit colour, so everything
+// above 1 is clipped before this pass sees it. It only bends [0,1] (white ends
+// at ~.8 with exposure 1)
+class ToneCurvePass : public PostPass {
+    float exposure_;
+public:
+    explicit ToneCurvePass(float exposure=1.f);
+    virtual const char *name() const { return "tone-curve"; }
+    virtual int radius() const { return 0; }
+    virtual void run(const PostTile &src, const PostTile &dst, const PostContext &ctx) const;
+};
+
+// FXAA in the spirit of Lottes' console version: an edge direction from the
+// luma of the diagonal neighbours and two or four bilinear taps along it
+class FXAAPass : public PostPass {
+public:
+    static const int SPAN = 8; // longest blur direction, the outer taps sit at half of it
+    virtual const char *name() const { return "fxaa"; }
+    virtual int radius() const { return SPAN/2+1; }
+    virtual void run(const PostTile &src, const PostTile &dst, const PostContext &ctx) const;
+};
+
+/////////////////////////////////////////////////////////////////////////////////
+
+class PostProcessor {
+public:
+    struct Timing {
+        std::string name;
+        double ms; // summed over worker threads
+    };
+
+    PostProcessor();
+    // ssao, ssao-blur, tone-curve, fxaa, in that order, all enabled
+    static PostProcessor standard();
+
+    void add(std::unique_ptr<PostPass> pass, bool enabled=true);
+    // false if there is no pass with that name
+    bool enable(const std::string &name, bool on);
+    bool enabled(const std::string &name) const;
+    // 0 means the whole frame in that direction; (0, 0) runs every pass over
+    // the whole frame before the next one starts. Default is 128x128.
+    void set_tile_size(int width, int height);
+
+    // src is 8-bit sRGB, dst receives sRGB again; they must not overlap.
+    // Bookkeeping goes to the caller's FrameArena
+    void process(ImageView<const RGB8> src, ImageView<const Gray8> depth, ImageView<RGB8> dst);
+
+    // times of the last process(); "load" and "store" are the 8-bit conversions
+    std::vector<Timing> timings() const;
+    double wall_ms() const;
+
+private:
+    struct Stage {
+        std::unique_ptr<PostPass> pass;
+        bool enabled;
+    };
+
+    std::vector<Stage> stages_;
+    int tile_width_;
+    int tile_height_;
+    std::vector<Timing> timings_;
+    double wall_ms_;
+};
+
+#endif //__POSTPROCESS_H__
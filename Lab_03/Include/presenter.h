@@ -0,0 +1,120 @@
+#ifndef __PRESENTER_H__
+#define __PRESENTER_H__
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "tgaimage.h"
+#include "../../Lab_04/InputRing.h"
+
+// Puts rendered frames on screen (or wherever the backend sends them) from its
+// own thread. It owns 2 or 3 RGB buffers: the renderer draws frame N+1 into
+// one while the presenter thread shows frame N from another, and buffers are
+// handed over, never copied. With 3 buffers the renderer may run one more
+// frame ahead before acquire() blocks.
+//
+// Images are bottom-up, as the rasterizer leaves them before flip_vertically().
+class Presenter {
+public:
+    struct Stats {
+        long presented;
+        double wait_ms;              // renderer time blocked in acquire()
+        double latency_p50_ms;       // input event to frame shown
+        double latency_p99_ms;
+        double interval_p50_ms;      // between frames shown
+        double interval_p99_ms;
+    };
+
+    Presenter(int width, int height, int buffers);
+    virtual ~Presenter();
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+
+    // a free buffer to render into; waits while every buffer is queued or shown
+    TGAImage &acquire();
+    // queues the acquired buffer. input_ns: steady_clock time of the oldest
+    // input the frame reflects, 0 if none; measured to the end of show()
+    void present(unsigned long long input_ns);
+    // waits until everything queued has been shown
+    void flush();
+    Stats stats() const;
+    // the user closed the output (window backends)
+    virtual bool closed() const { return false; }
+
+protected:
+    // presenter thread; frame stays untouched by the renderer until it returns
+    virtual void show(TGAImage &frame, long number) = 0;
+    // derived destructors call this first, while show() still works
+    void shutdown();
+
+private:
+    struct Slot {
+        TGAImage image;
+        unsigned long long input_ns;
+        long number;
+    };
+    void run();
+
+    int width_, height_;
+    std::vector<Slot> slots_;
+    std::deque<int> free_;
+    std::deque<int> queued_;
+    int acquired_;
+    int showing_;
+    long submitted_;
+    bool stop_;
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;     // presenter: a frame was queued
+    std::condition_variable released_; // renderer: a buffer came back
+    std::thread thread_;
+
+    double wait_ms_;
+    long presented_;
+    unsigned long long last_shown_;
+    std::vector<float> latency_ms_;  // the last SAMPLES frames
+    std::vector<float> interval_ms_;
+    static const int SAMPLES = 1024;
+};
+
+// Linux-friendly backend. target:
+//   ""           frames are only timed and dropped
+//   "shm:/name"  POSIX shared memory: a SharedFrameHeader, then width*height
+//                RGB top-down; seq is odd while a frame is being written
+//   otherwise    a printf pattern for one file per frame ("frame_%04d.tga"),
+//                format taken from the extension; exactly one %d, no other
+//                conversions
+class HeadlessPresenter : public Presenter {
+public:
+    struct SharedFrameHeader {
+        char magic[8];               // "RNDRFRM"
+        unsigned int width, height;
+        volatile unsigned long long seq;
+        unsigned long long frame;
+    };
+
+    HeadlessPresenter(int width, int height, int buffers, const std::string &target);
+    ~HeadlessPresenter();
+    // false when the target couldn't be opened or isn't a valid file pattern
+    bool ok() const { return ok_; }
+
+protected:
+    void show(TGAImage &frame, long number);
+
+private:
+    std::string target_;
+    bool ok_;
+    void *shm_;
+    unsigned long shm_size_;
+};
+
+// Windows backend: a window of its own, painted with StretchDIBits. Window
+// messages become InputEvents in input (may be NULL), so the same render loop
+// runs off live or replayed input. The ring takes one producer: pass NULL while
+// a replay pushes into it. NULL outside Windows or if the window can't be created.
+Presenter *create_gdi_presenter(int width, int height, int buffers, InputRing *input);
+
+#endif //__PRESENTER_H__
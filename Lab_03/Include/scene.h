@@ -0,0 +1,158 @@
+#ifndef __SCENE_H__
+#define __SCENE_H__
+
+#include <chrono>
+#include <functional>
+#include <vector>
+#include "tgaimage.h"
+#include "mesh.h"
+#include "lights.h"
+#include "our_gl.h"
+#include "../Include/math.h"
+
+// The shaded head: the state its shaders read, the Phong shader and the opaque
+// pass. Shared by the renderer and renderer_bench, which owns no main.cpp.
+
+extern Model *model;
+extern Vec3f light_dir;
+extern LightGrid light_grid;     // local lights per tile
+extern bool light_culling;
+extern int shading_rate;         // 1, 2, 4; 0: per tile from the normal spread
+extern ShadingRateMap rate_map;
+extern float rate_threshold[2];  // tile normal spread: below [0] 2x2, below [1] 4x4
+
+// n deterministic point and spot lights around the head, added to Lights
+void scatter_lights(int n);
+Vec3f local_light(const Light &l, Vec3f pos, Vec3f n, Vec3f view_dir, Vec3f tex_rgb, float shininess);
+
+// грань после vertex(): экранные вершины и varyings шейдера
+struct PreparedFace {
+    Vec4f pts[3];
+    mat<3,3,float> norm;
+    mat<3,3,float> pos;
+    mat<2,3,float> uv;
+};
+
+struct Shader : public IShader {
+    mat<3,3,float> varying_norm; // нормали по вершинам
+    mat<3,3,float> varying_pos;  // позиции по вершинам
+    mat<2,3,float> varying_uv;   // uv по вершинам
+    bool local_lights = true;    // в превью light_grid не соответствует кадру
+    Vec3f light_dir_eye;         // нормализованный вектор света, для камеры ModelView
+
+    // карты, которые читает fragment(); normal map не нужна
+    Shader() {
+        model->prefetch(Model::DIFFUSE);
+        model->prefetch(Model::SPECULAR);
+        light_dir_eye = eye_light(ModelView);
+    }
+
+    static Vec3f eye_light(const Matrix &model_view) {
+        return proj<3>(model_view * embed<4>(::light_dir, 0.0f)).normalize();
+    }
+
+    void save(PreparedFace &face) const {
+        face.norm = varying_norm;
+        face.pos = varying_pos;
+        face.uv = varying_uv;
+    }
+    void restore(const PreparedFace &face) {
+        varying_norm = face.norm;
+        varying_pos = face.pos;
+        varying_uv = face.uv;
+    }
+
+    virtual Vec4f vertex(int iface, int nthvert) {
+        // UV
+        varying_uv.set_col(nthvert, model->uv(iface, nthvert));
+        // вершина из модели
+        Vec4f gl_Vertex = embed<4>(model->vert(iface, nthvert));
+
+        Vec4f pos_eye4 = ModelView * gl_Vertex;
+        Vec3f pos_eye = proj<3>(pos_eye4);
+        varying_pos.set_col(nthvert, pos_eye);
+
+        Vec4f n4 = embed<4>(model->normal(iface, nthvert), 0.0f);
+        Vec3f n_eye = proj<3>(ModelView * n4).normalize();
+        varying_norm.set_col(nthvert, n_eye);
+
+        return Viewport * Projection * ModelView * gl_Vertex;
+    }
+
+    // fragment: интерполируем нормаль/позицию/uv и считаем Phong
+    virtual bool fragment(Vec3f bar, TGAColor &color) {
+        // --- интерполяция ---
+        Vec2f interp_uv = varying_uv * bar;
+        Vec2f duvdx = varying_uv * bar_ddx;
+        Vec2f duvdy = varying_uv * bar_ddy;
+        Vec3f interp_pos = varying_pos * bar;
+        Vec3f interp_norm = (varying_norm * bar).normalize();
+
+        // view vector
+        Vec3f view_dir = (Vec3f(0,0,0) - interp_pos).normalize();
+
+        const float ambient_strength = 0.1f;
+
+        // diffuse
+        float diff = std::max(0.f, interp_norm * light_dir_eye);
+
+        // specular (Phong)
+        // R = reflect(-L, N) = 2*(N·L)*N - L
+        Vec3f R = interp_norm * (2.f * (interp_norm * light_dir_eye)) - light_dir_eye;
+        float spec_angle = std::max(0.f, R * view_dir);
+
+        float spec_map = model->specular(Vec2f(interp_uv[0], interp_uv[1]), duvdx, duvdy);
+
+        if (spec_map < 1e-6f) spec_map = 16.f;
+        float shininess = spec_map;
+        float spec = std::pow(spec_angle, shininess);
+
+        // получаем base diffuse color из текстуры
+        Vec2f uv = Vec2f(interp_uv[0], interp_uv[1]);
+        TGAColor tex = model->diffuse(uv, duvdx, duvdy);
+        Vec3f tex_rgb = Vec3f((float)tex[2], (float)tex[1], (float)tex[0]);
+
+        Vec3f ambient = tex_rgb * ambient_strength;
+        Vec3f diffuse = tex_rgb * diff;
+        Vec3f specular = Vec3f(255.f,255.f,255.f) * spec * 0.5f;
+
+        Vec3f result = ambient + diffuse + specular;
+
+        // локальные источники: только те, что попали в тайл пикселя
+        if (local_lights && light_grid.size()) {
+            Span<const int> tile = light_grid.lights(frag_coord.x, frag_coord.y);
+            for (int i = 0; i < tile.size(); i++)
+                result = result + local_light(light_grid.light(tile[i]), interp_pos, interp_norm, view_dir, tex_rgb, shininess);
+        }
+
+        for (int i=0;i<3;i++) {
+            if (result[i] > 255.f) result[i] = 255.f;
+            if (result[i] < 0.f)   result[i] = 0.f;
+        }
+        color[0] = (unsigned char)result[2]; // B
+        color[1] = (unsigned char)result[1]; // G
+        color[2] = (unsigned char)result[0]; // R
+        color[3] = 255; // A
+
+        return false;
+    }
+};
+
+double elapsed_ms(std::chrono::steady_clock::time_point start);
+Vec4f scale_xy(Vec4f v, float scale);
+void draw_faces(Span<const PreparedFace> faces, ImageView<RGB8> frame, ImageView<Gray8> depth, float scale,
+                bool depth_only, bool full, TileBins &bins);
+// what render_opaque found out about one frame; printing it is up to the caller
+struct OpaqueStats {
+    LightGrid::Stats lights; // zero without local lights
+    double light_ms;         // depth pre-pass + light culling
+    int rate_tiles[5];       // tiles shaded at rate 1, 2 and 4 in auto-rate mode
+};
+
+// the head into frame/depth with the current ModelView, Projection and Viewport;
+// preview, if set, gets the 1/8, 1/4 and 1/2 frames first. Scratch comes from
+// the FrameArena, which the caller resets between frames
+OpaqueStats render_opaque(ImageView<RGB8> frame, ImageView<Gray8> depth, TileBins &bins,
+                          const std::function<void(int, TGAImage &, TGAImage &)> &preview);
+
+#endif //__SCENE_H__
@@ -0,0 +1,123 @@
+#ifndef __SDF_H__
+#define __SDF_H__
+
+#include <vector>
+#include "tgaimage.h"
+#include "thread_pool.h"
+#include "pass_graph.h"
+#include "../Include/math.h"
+
+// Lab_02's buffers A-D as passes of a PassGraph
+struct SdfPasses {
+    int a; // turret angles and fire key
+    int b; // bullet
+    int c; // planes and bombs
+    int d; // craters
+};
+
+// Uniform grid over the ground plane (xz) for the crater bumps. A cell lists
+// every crater whose bump reaches into it, in crater order, so a sample of
+// the ground sums one cell instead of all craters. A bump is cut off at
+// RADIUS, where it has fallen below 3e-6.
+class CraterGrid {
+public:
+    static constexpr float CELL = 1.f;
+    static constexpr float RADIUS = 2.5f;
+    static const int MAX_CELLS = 1 << 18; // larger spreads get larger cells
+    struct Entry {
+        float x, z;
+        int index; // into the crater list
+    };
+
+    CraterGrid();
+    void build(const std::vector<Vec3f> &craters);
+    // indexes craters[size()..]; rebuilds when the indexed ones changed or a
+    // new one falls outside the grid
+    void update(const std::vector<Vec3f> &craters);
+    int size() const { return (int)indexed_.size(); }
+    long references() const;
+
+    // the cell of (x, z), -1 outside the grid
+    int cell(float x, float z) const {
+        float fx = (x - x0_)*inv_cell_, fz = (z - z0_)*inv_cell_;
+        if (!(fx >= 0.f && fz >= 0.f && fx < nx_ && fz < nz_)) return -1;
+        return (int)fz*nx_ + (int)fx;
+    }
+    Span<const Entry> entries(int cell) const {
+        const std::vector<Entry> &c = cells_[cell];
+        Span<const Entry> s = {c.data(), c.data() + c.size()};
+        return s;
+    }
+
+private:
+    bool insert(const Vec3f &c, int index);
+
+    float x0_, z0_;
+    float cell_, inv_cell_;
+    int nx_, nz_;
+    std::vector<Vec3f> indexed_;
+    std::vector<std::vector<Entry> > cells_;
+};
+
+// CPU port of the Lab_02 ShaderToy scene: two tanks, two planes with bombs,
+// a bullet and a cratered ground, ray marched and lit by a sun with soft
+// shadows. What the ShaderToy buffers fed through iChannel0..3 (turret
+// angles, bullets, planes, craters) is plain data here: set directly, or
+// read from the buffer passes with load().
+struct SdfScene {
+    // constants of Image.txt
+    static const int   MAX_MARCHING_STEPS = 80;
+    static const int   MAX_SHADOW_STEPS = 128; // the shader's loop is unbounded
+    static constexpr float MIN_DIST  = 0.f;
+    static constexpr float MAX_DIST  = 30.f;
+    static constexpr float PRECISION = .001f;
+    static constexpr float FOV       = .9f;
+
+    struct Plane {
+        Vec3f pos;             // relative to (0, 3, 0), like sdFly
+        Vec3f right, up, dir;  // columns of its rotation
+        Vec3f bomb;
+    };
+
+    Vec2f mouse;               // iMouse in pixels; (-1, -1) = centre of the image
+    Vec2f turret;              // iChannel0: turret yaw (x) and pitch (y) of the player
+    Vec3f bullet;
+    bool  bullet_live;
+    Plane planes[2];           // sdFly(..., 3) and sdFly(..., 5)
+    std::vector<Vec3f> craters;
+    CraterGrid crater_grid;    // index_craters() after changing craters
+
+    SdfScene();
+    // planes and bombs where buffer C puts them at iTime = t
+    void animate(float t);
+    // n craters at deterministic spots of the ground
+    void scatter_craters(int n);
+    // everything but the mouse from the outputs of the buffer passes
+    void load(const PassGraph &graph, const SdfPasses &passes);
+    // brings crater_grid up to date with craters; appending is cheap
+    void index_craters();
+};
+
+// adds buffers A-D to graph with Lab_02's channel bindings; D keeps up to
+// max_craters craters per plane
+SdfPasses add_sdf_passes(PassGraph &graph, int max_craters);
+
+struct SdfStats {
+    double ms;
+    long primary_rays;
+    long shadow_rays;
+    long packets;
+    long fallback_rays; // rays a packet handed over to the scalar marcher
+    long crater_refs;   // crater list entries of the grid, 0 for the linear scan
+    bool avx2;          // packets ran on the AVX2 lanes
+};
+
+// Renders the scene into frame, tiles spread over pool. packets=false marches
+// every ray alone; packets=true marches 4x2 pixel blocks 8-wide (AVX2 when the
+// CPU has it, checked at run time) and finishes the lanes of a diverged packet
+// one by one.
+// crater_grid=false sums every crater at every sample, like the shader.
+SdfStats render_sdf(const SdfScene &scene, ImageView<RGB8> frame, ThreadPool &pool, bool packets=true,
+                    bool crater_grid=true);
+
+#endif //__SDF_H__
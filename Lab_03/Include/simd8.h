@@ -0,0 +1,174 @@
+#ifndef __SIMD8_H__
+#define __SIMD8_H__
+
+#include <cmath>
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// 8 floats with the arithmetic of a scalar float, for code templated on the
+// lane type. simd8_generic keeps a plain array the compiler may still
+// vectorize; simd8_avx2 keeps one __m256. Comparisons give a Mask8, which
+// select() and the any()/bits() queries consume.
+//
+// simd8_avx2 is built for AVX2 whatever the compiler flags, so a baseline
+// x86-64 binary still has it. Code using it goes between SIMD8_AVX2_BEGIN and
+// SIMD8_AVX2_END, which give every function defined there (templates too) the
+// avx2 target, and runs only if simd8_cpu_avx2(). SIMD8_AVX2 is defined when
+// the namespace exists.
+
+#if defined(__AVX2__)
+#define SIMD8_AVX2
+#define SIMD8_AVX2_BEGIN
+#define SIMD8_AVX2_END
+inline bool simd8_cpu_avx2() { return true; }
+#elif defined(_MSC_VER) && defined(_M_X64)
+// MSVC emits AVX intrinsics anywhere; the check also wants the OS to save ymm
+#define SIMD8_AVX2
+#define SIMD8_AVX2_BEGIN
+#define SIMD8_AVX2_END
+inline bool simd8_cpu_avx2() {
+    static const bool has = [] {
+        int info[4];
+        __cpuid(info, 1);
+        if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28)) || (_xgetbv(0) & 6) != 6) return false;
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+    }();
+    return has;
+}
+#elif (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define SIMD8_AVX2
+#ifdef __clang__
+#define SIMD8_AVX2_BEGIN _Pragma("clang attribute push (__attribute__((target(\"avx2\"))), apply_to = function)")
+#define SIMD8_AVX2_END _Pragma("clang attribute pop")
+#else
+#define SIMD8_AVX2_BEGIN _Pragma("GCC push_options") _Pragma("GCC target(\"avx2\")")
+#define SIMD8_AVX2_END _Pragma("GCC pop_options")
+#endif
+inline bool simd8_cpu_avx2() {
+    static const bool has = __builtin_cpu_supports("avx2");
+    return has;
+}
+#else
+inline bool simd8_cpu_avx2() { return false; }
+#endif
+
+namespace simd8_generic {
+
+struct Mask8 {
+    bool m[8];
+    Mask8 operator&(const Mask8 &o) const { Mask8 r; for (int i=0; i<8; i++) r.m[i] = m[i] && o.m[i]; return r; }
+    Mask8 operator|(const Mask8 &o) const { Mask8 r; for (int i=0; i<8; i++) r.m[i] = m[i] || o.m[i]; return r; }
+    Mask8 operator~() const { Mask8 r; for (int i=0; i<8; i++) r.m[i] = !m[i]; return r; }
+    int bits() const { int b = 0; for (int i=0; i<8; i++) b |= m[i] << i; return b; }
+    static Mask8 lanes(int bits) { Mask8 r; for (int i=0; i<8; i++) r.m[i] = (bits >> i) & 1; return r; }
+};
+
+struct F8 {
+    float v[8];
+    F8() {}
+    F8(float s) { for (int i=0; i<8; i++) v[i] = s; }
+    static F8 load(const float *p) { F8 r; for (int i=0; i<8; i++) r.v[i] = p[i]; return r; }
+    void store(float *p) const { for (int i=0; i<8; i++) p[i] = v[i]; }
+    float operator[](int i) const { return v[i]; }
+
+    F8 operator+(const F8 &o) const { F8 r; for (int i=0; i<8; i++) r.v[i] = v[i] + o.v[i]; return r; }
+    F8 operator-(const F8 &o) const { F8 r; for (int i=0; i<8; i++) r.v[i] = v[i] - o.v[i]; return r; }
+    F8 operator*(const F8 &o) const { F8 r; for (int i=0; i<8; i++) r.v[i] = v[i] * o.v[i]; return r; }
+    F8 operator/(const F8 &o) const { F8 r; for (int i=0; i<8; i++) r.v[i] = v[i] / o.v[i]; return r; }
+    F8 operator-() const { F8 r; for (int i=0; i<8; i++) r.v[i] = -v[i]; return r; }
+    F8 &operator+=(const F8 &o) { for (int i=0; i<8; i++) v[i] += o.v[i]; return *this; }
+    Mask8 operator<(const F8 &o) const { Mask8 r; for (int i=0; i<8; i++) r.m[i] = v[i] < o.v[i]; return r; }
+    Mask8 operator>(const F8 &o) const { Mask8 r; for (int i=0; i<8; i++) r.m[i] = v[i] > o.v[i]; return r; }
+};
+
+inline F8 vmin(const F8 &a, const F8 &b) { F8 r; for (int i=0; i<8; i++) r.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i]; return r; }
+inline F8 vmax(const F8 &a, const F8 &b) { F8 r; for (int i=0; i<8; i++) r.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i]; return r; }
+inline F8 vabs(const F8 &a) { F8 r; for (int i=0; i<8; i++) r.v[i] = std::fabs(a.v[i]); return r; }
+inline F8 vsqrt(const F8 &a) { F8 r; for (int i=0; i<8; i++) r.v[i] = std::sqrt(a.v[i]); return r; }
+inline F8 select(const Mask8 &m, const F8 &a, const F8 &b) { F8 r; for (int i=0; i<8; i++) r.v[i] = m.m[i] ? a.v[i] : b.v[i]; return r; }
+inline F8 vexp(const F8 &x) { F8 r; for (int i=0; i<8; i++) r.v[i] = std::exp(x.v[i]); return r; }
+
+inline bool any(const Mask8 &m) { return m.bits() != 0; }
+
+} // namespace simd8_generic
+
+#ifdef SIMD8_AVX2
+SIMD8_AVX2_BEGIN
+namespace simd8_avx2 {
+
+struct Mask8 {
+    __m256 m;
+    Mask8() {}
+    explicit Mask8(__m256 v) : m(v) {}
+    Mask8 operator&(Mask8 o) const { return Mask8(_mm256_and_ps(m, o.m)); }
+    Mask8 operator|(Mask8 o) const { return Mask8(_mm256_or_ps(m, o.m)); }
+    Mask8 operator~() const { return Mask8(_mm256_xor_ps(m, _mm256_castsi256_ps(_mm256_set1_epi32(-1)))); }
+    int bits() const { return _mm256_movemask_ps(m); }
+    // lane i set when bit i is
+    static Mask8 lanes(int bits) {
+        __m256i bit = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+        return Mask8(_mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(bits), bit), bit)));
+    }
+};
+
+struct F8 {
+    __m256 v;
+    F8() {}
+    F8(float s) : v(_mm256_set1_ps(s)) {}
+    explicit F8(__m256 x) : v(x) {}
+    static F8 load(const float *p) { return F8(_mm256_loadu_ps(p)); }
+    void store(float *p) const { _mm256_storeu_ps(p, v); }
+    float operator[](int i) const { float t[8]; store(t); return t[i]; }
+
+    F8 operator+(F8 o) const { return F8(_mm256_add_ps(v, o.v)); }
+    F8 operator-(F8 o) const { return F8(_mm256_sub_ps(v, o.v)); }
+    F8 operator*(F8 o) const { return F8(_mm256_mul_ps(v, o.v)); }
+    F8 operator/(F8 o) const { return F8(_mm256_div_ps(v, o.v)); }
+    F8 operator-() const { return F8(_mm256_xor_ps(v, _mm256_set1_ps(-0.f))); }
+    F8 &operator+=(F8 o) { v = _mm256_add_ps(v, o.v); return *this; }
+    Mask8 operator<(F8 o) const { return Mask8(_mm256_cmp_ps(v, o.v, _CMP_LT_OQ)); }
+    Mask8 operator>(F8 o) const { return Mask8(_mm256_cmp_ps(v, o.v, _CMP_GT_OQ)); }
+};
+
+inline F8 vmin(F8 a, F8 b) { return F8(_mm256_min_ps(a.v, b.v)); }
+inline F8 vmax(F8 a, F8 b) { return F8(_mm256_max_ps(a.v, b.v)); }
+inline F8 vabs(F8 a) { return F8(_mm256_andnot_ps(_mm256_set1_ps(-0.f), a.v)); }
+inline F8 vsqrt(F8 a) { return F8(_mm256_sqrt_ps(a.v)); }
+inline F8 select(Mask8 m, F8 a, F8 b) { return F8(_mm256_blendv_ps(b.v, a.v, m.m)); }
+
+// e^x for the range the scene needs (x <= 0), 2^n * polynomial(2^f); ~1e-7 relative
+inline F8 vexp(F8 x) {
+    __m256 t = _mm256_mul_ps(_mm256_max_ps(x.v, _mm256_set1_ps(-87.f)), _mm256_set1_ps(1.44269504f));
+    __m256 n = _mm256_floor_ps(t);
+    __m256 f = _mm256_sub_ps(t, n);
+    __m256 p = _mm256_set1_ps(1.53533e-4f);
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(1.33989e-3f));
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(9.61844e-3f));
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(5.55033e-2f));
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(2.40227e-1f));
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(6.93147e-1f));
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(1.f));
+    __m256i e = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+    return F8(_mm256_mul_ps(p, _mm256_castsi256_ps(e)));
+}
+
+inline bool any(const Mask8 &m) { return m.bits() != 0; }
+
+} // namespace simd8_avx2
+SIMD8_AVX2_END
+#endif
+
+// the same names for one lane, so scene code can be written once
+inline float vmin(float a, float b) { return a < b ? a : b; }
+inline float vmax(float a, float b) { return a > b ? a : b; }
+inline float vabs(float a) { return std::fabs(a); }
+inline float vsqrt(float a) { return std::sqrt(a); }
+inline float vexp(float a) { return std::exp(a); }
+inline float select(bool m, float a, float b) { return m ? a : b; }
+
+#endif //__SIMD8_H__
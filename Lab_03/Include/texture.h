@@ -0,0 +1,66 @@
+#ifndef __TEXTURE_H__
+#define __TEXTURE_H__
+
+#include <vector>
+#include "math.h"
+#include "tgaimage.h"
+
+// Read-only sampled texture. The mip chain is built once at load time and every
+// level is stored as 8x8 tiles with Morton (Z-order) texels inside a tile, so a
+// bilinear footprint or a 2x2 pixel quad usually stays inside one 256-byte tile.
+// Levels can be block-compressed in place; a tile then holds 2x2 blocks in Z-order.
+class Texture {
+public:
+    // NEAREST: level 0 only, whatever the derivatives; BILINEAR: the nearest
+    // mip level; TRILINEAR: a blend of the two levels around the LOD
+    enum Filter {
+        NEAREST, BILINEAR, TRILINEAR
+    };
+    enum Format {
+        BGRA8, BC1, BC4, BC5
+    };
+
+    Texture();
+    Texture(const TGAImage &img, Filter f=TRILINEAR);
+    void load(const TGAImage &img);
+    void set_filter(Filter f);
+    Filter get_filter() const;
+    int get_width() const;
+    int get_height() const;
+    int get_bytespp() const;
+    int levels() const;
+    bool empty() const;
+    Format get_format() const;
+    unsigned long memory_bytes() const;
+    bool compress(Format f);
+
+    TGAColor fetch(int level, int x, int y) const;
+    TGAColor sample(Vec2f uv) const;
+    TGAColor sample(Vec2f uv, Vec2f duvdx, Vec2f duvdy) const;
+    // explicit filter, for shared textures whose owner must not change filter_
+    TGAColor sample(Vec2f uv, Filter f) const;
+    TGAColor sample(Vec2f uv, Vec2f duvdx, Vec2f duvdy, Filter f) const;
+    float lod(Vec2f duvdx, Vec2f duvdy) const;
+
+private:
+    struct Level {
+        int width;
+        int height;
+        int tiles_x;
+        std::vector<unsigned char> texels; // BGRA, tiled
+    };
+
+    std::vector<Level> levels_;
+    int bytespp_;
+    Filter filter_;
+    Format format_;
+
+    static int offset(const Level &l, int x, int y);
+    static int block_offset(const Level &l, int bx, int by, int block_bytes);
+    void texel(const Level &l, int x, int y, unsigned char *bgra) const;
+    Vec4f nearest(int level, Vec2f uv) const;
+    Vec4f bilinear(int level, Vec2f uv) const;
+    TGAColor to_color(const Vec4f &c) const;
+};
+
+#endif //__TEXTURE_H__
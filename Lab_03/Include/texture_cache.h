@@ -0,0 +1,72 @@
+#ifndef __TEXTURE_CACHE_H__
+#define __TEXTURE_CACHE_H__
+
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "texture.h"
+
+// Process-wide store of decoded textures. A file is decoded once and handed out
+// as a shared_ptr; two paths with byte-identical contents (FNV-1a of the file)
+// share one Texture. Entries nobody holds any more stay cached and are evicted
+// least-recently-used first once the total size goes over the byte budget.
+// Textures still referenced by a Model are never evicted, they only count
+// towards the total.
+class TextureCache {
+public:
+    static const int PREVIEW_SIZE = 32; // longest side of a preview texture
+    struct Stats {
+        unsigned long hits;       // served from memory, by path or by content
+        unsigned long misses;     // had to be decoded
+        unsigned long duplicates; // decoded, but another thread cached the file first
+        unsigned long evictions;
+        unsigned long entries;
+        unsigned long bytes;      // memory_bytes() of every cached texture
+        unsigned long budget;
+    };
+
+    explicit TextureCache(unsigned long budget);
+    // budget from RENDERER_TEXTURE_BUDGET_MB, 256 MB if unset
+    static TextureCache &instance();
+
+    typedef std::function<void(const std::shared_ptr<const Texture> &)> PreviewFn;
+
+    // NULL if the file can't be read or decoded. Textures are flipped so that
+    // v=0 is the bottom row, and compressed to fmt when it isn't BGRA8.
+    // On a miss, preview (if set) gets a PREVIEW_SIZE stand-in as soon as the
+    // file is decoded, before the mip chain and the compression are built.
+    std::shared_ptr<const Texture> acquire(const std::string &path, Texture::Format fmt=Texture::BGRA8,
+                                           const PreviewFn &preview=PreviewFn());
+    void set_budget(unsigned long bytes);
+    // drops every entry that is not referenced outside the cache
+    void trim();
+    Stats stats() const;
+
+private:
+    struct Key {
+        unsigned long long hash;
+        Texture::Format format;
+        bool operator<(const Key &o) const { return hash!=o.hash ? hash<o.hash : format<o.format; }
+    };
+    struct Entry {
+        std::shared_ptr<const Texture> texture;
+        unsigned long bytes;
+        std::list<Key>::iterator lru;
+    };
+
+    mutable std::mutex mutex_;
+    std::map<std::string, unsigned long long> paths_; // path -> content hash
+    std::map<Key, Entry> entries_;
+    std::list<Key> lru_;                              // most recently used first
+    unsigned long bytes_;
+    unsigned long budget_;
+    Stats stats_;
+
+    std::shared_ptr<const Texture> lookup(const Key &key);
+    void evict(unsigned long budget);
+};
+
+#endif //__TEXTURE_CACHE_H__
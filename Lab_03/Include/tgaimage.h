@@ -2,6 +2,8 @@
 #define __IMAGE_H__
 
 #include <fstream>
+#include <vector>
+#include "image_view.h"
 
 #pragma pack(push,1)
 struct TGA_Header {
@@ -71,8 +73,7 @@ protected:
     int height;
     int bytespp;
 
-    bool   load_rle_data(std::ifstream &in);
-    bool unload_rle_data(std::ofstream &out);
+    bool   load_rle_data(const unsigned char *in, const unsigned char *end);
 public:
     enum Format {
         GRAYSCALE=1, RGB=3, RGBA=4
@@ -81,21 +82,38 @@ public:
     TGAImage();
     TGAImage(int w, int h, int bpp);
     TGAImage(const TGAImage &img);
+    TGAImage(TGAImage &&img);
     bool read_tga_file(const char *filename);
-    bool write_tga_file(const char *filename, bool rle=true);
+    bool read_tga_buffer(const unsigned char *buf, unsigned long size);
+    bool write_tga_file(const char *filename, bool rle=true) const;
     bool flip_horizontally();
     bool flip_vertically();
     bool scale(int w, int h);
-    TGAColor get(int x, int y);
+    TGAColor get(int x, int y) const;
     bool set(int x, int y, TGAColor &c);
     bool set(int x, int y, const TGAColor &c);
     ~TGAImage();
     TGAImage & operator =(const TGAImage &img);
-    int get_width();
-    int get_height();
-    int get_bytespp();
+    TGAImage & operator =(TGAImage &&img);
+    int get_width() const;
+    int get_height() const;
+    int get_bytespp() const;
     unsigned char *buffer();
+    const unsigned char *buffer() const;
+    ConstImageView view() const;
+    // typed access, empty view if the pixel size does not match bytespp
+    template<class T> ImageView<T> pixels() {
+        if (sizeof(T)!=(size_t)bytespp) return ImageView<T>();
+        return ImageView<T>((T *)data, width, height);
+    }
+    template<class T> ImageView<const T> pixels() const {
+        if (sizeof(T)!=(size_t)bytespp) return ImageView<const T>();
+        return ImageView<const T>((const T *)data, width, height);
+    }
     void clear();
 };
 
+// whole TGA file (header, pixels, footer) in memory
+void encode_tga(const ConstImageView &img, std::vector<unsigned char> &out, bool rle=true);
+
 #endif //__IMAGE_H__
@@ -0,0 +1,53 @@
+#ifndef __THREAD_POOL_H__
+#define __THREAD_POOL_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for data-parallel loops. parallel_for() blocks
+// until every index is done; the calling thread takes part in the work, and a
+// parallel_for issued from inside a worker runs inline instead of deadlocking.
+// Only one thread's loop owns the pool at a time: a parallel_for from another
+// thread while it is busy (a texture loader during the raster bands) does not
+// wait for it but runs serially on its own thread, since the busy loop may
+// itself be waiting for that thread.
+// Dispatch goes through a plain function pointer, so a call never allocates.
+class ThreadPool {
+public:
+    explicit ThreadPool(int nthreads);
+    ~ThreadPool();
+
+    // process-wide pool; size from $RENDERER_THREADS or the hardware concurrency
+    static ThreadPool &instance();
+
+    int size() const;
+
+    template<class F> void parallel_for(int n, F &&f) {
+        typedef typename std::remove_reference<F>::type Fn;
+        run(n, [](void *ctx, int i) { (*static_cast<Fn *>(ctx))(i); }, (void *)&f);
+    }
+
+private:
+    void run(int n, void (*fn)(void *, int), void *ctx);
+    void worker();
+    void drain(void (*fn)(void *, int), void *ctx, int count);
+
+    std::vector<std::thread> threads_;
+    std::mutex submit_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    void (*fn_)(void *, int);
+    void *ctx_;
+    int count_;
+    std::atomic<int> next_;
+    std::atomic<int> finished_;
+    unsigned long generation_;
+    int busy_;
+    bool stop_;
+};
+
+#endif //__THREAD_POOL_H__
@@ -0,0 +1,51 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <atomic>
+
+// Timeline of scoped work on every thread, written as Chrome trace_event JSON
+// (chrome://tracing, ui.perfetto.dev). Off until start(): a TRACE_SCOPE then
+// costs one relaxed load. When on, each thread appends complete events to its
+// own fixed buffer, so recording never locks or allocates after the thread's
+// first event; a full buffer drops events and counts them.
+//
+// Names are not copied and must outlive write(): string literals.
+class Trace {
+public:
+    static const int THREAD_EVENTS = 1 << 16;
+
+    static void start();
+    static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+    static unsigned long long now_ns();
+    // index >= 0 is shown as args.index (band, tile, frame)
+    static void record(const char *name, unsigned long long begin_ns, unsigned long long end_ns, int index);
+    // label for the calling thread's track
+    static void name_thread(const char *name);
+    // call once the traced work is done: buffers are read without locks
+    static bool write(const char *filename);
+    static unsigned long long dropped();
+
+private:
+    static std::atomic<bool> enabled_;
+};
+
+class TraceScope {
+public:
+    explicit TraceScope(const char *name, int index=-1)
+        : name_(name), index_(index), begin_(Trace::enabled() ? Trace::now_ns() : 0) {}
+    ~TraceScope() {
+        if (begin_) Trace::record(name_, begin_, Trace::now_ns(), index_);
+    }
+private:
+    TraceScope(const TraceScope &);
+    TraceScope &operator=(const TraceScope &);
+    const char *name_;
+    int index_;
+    unsigned long long begin_;
+};
+
+#define TRACE_CAT2(a, b) a##b
+#define TRACE_CAT(a, b) TRACE_CAT2(a, b)
+#define TRACE_SCOPE(...) TraceScope TRACE_CAT(trace_scope_, __LINE__)(__VA_ARGS__)
+
+#endif //__TRACE_H__
@@ -0,0 +1,251 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../Include/image_kernels.h"
+
+// Ядра image_kernels против наивных попиксельных циклов: случайные картинки
+// всех форматов, узкие (хвосты SIMD) и больше KERNEL_PARALLEL_PIXELS (полосы
+// на пуле). Результат должен совпасть байт в байт при любом наборе инструкций
+// и любом RENDERER_THREADS.
+//
+//   kernel_check [--rounds N] [--seed S]
+//
+// Код возврата 1 при любом расхождении.
+
+struct LCG {
+    unsigned int state;
+    unsigned int next() {
+        state = state*1664525u + 1013904223u;
+        return state >> 8;
+    }
+    int below(int n) { return (int)(next() % (unsigned int)n); }
+};
+
+// пиксели w x h как байты, с запасом по строке: stride больше ширины
+template<class T> struct Image {
+    int w, h;
+    long stride;
+    std::vector<T> pixels;
+    Image(int aw, int ah, long astride) : w(aw), h(ah), stride(astride), pixels((size_t)astride*ah) {}
+    ImageView<T> view() { return ImageView<T>(pixels.data(), w, h, stride); }
+    ImageView<const T> cview() const { return ImageView<const T>(pixels.data(), w, h, stride); }
+    T &at(int x, int y) { return pixels[(size_t)y*stride + x]; }
+    const T &at(int x, int y) const { return pixels[(size_t)y*stride + x]; }
+};
+
+template<class T> static Image<T> random_image(LCG &rng, int w, int h, bool opaque_runs = false) {
+    Image<T> img(w, h, w + rng.below(3));
+    unsigned char *p = (unsigned char *)img.pixels.data();
+    for (size_t i = 0; i < img.pixels.size()*sizeof(T); i++) p[i] = (unsigned char)rng.next();
+    // для смешивания нужны и прозрачные, и непрозрачные пиксели целыми отрезками
+    if (opaque_runs)
+        for (size_t i = 3; i < img.pixels.size()*sizeof(T); i += sizeof(T))
+            if (rng.below(3) == 0) p[i] = (unsigned char)(rng.below(2) ? 255 : 0);
+    return img;
+}
+
+// только пиксели внутри ширины: хвост строки за w ядро трогать не должно, но и не сравнивается
+template<class T> static bool same(const Image<T> &a, const Image<T> &b) {
+    for (int y = 0; y < a.h; y++)
+        if (memcmp(&a.at(0, y), &b.at(0, y), sizeof(T)*a.w)) return false;
+    return true;
+}
+
+// округление x/255 к ближайшему, как у ядер
+static int div255(int x) {
+    return (2*x + 255)/510;
+}
+
+static int failures = 0;
+
+static void report(const char *kernel, const char *format, int w, int h, bool ok) {
+    if (ok) return;
+    failures++;
+    printf("%s %s %dx%d: differs from the reference\n", kernel, format, w, h);
+}
+
+template<class T> static void check_geometry(LCG &rng, const char *format, int w, int h) {
+    const int N = sizeof(T);
+    Image<T> src = random_image<T>(rng, w, h);
+
+    Image<T> flipped = src, reference = src;
+    flip_vertical(flipped.view());
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++) reference.at(x, y) = src.at(x, h-1-y);
+    report("flip_vertical", format, w, h, same(flipped, reference));
+
+    flipped = src;
+    flip_horizontal(flipped.view());
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++) reference.at(x, y) = src.at(w-1-x, y);
+    report("flip_horizontal", format, w, h, same(flipped, reference));
+
+    int dw = 1 + rng.below(2*w), dh = 1 + rng.below(2*h);
+    Image<T> dst(dw, dh, dw), expected(dw, dh, dw);
+    resize_nearest(src.cview(), dst.view());
+    for (int y = 0; y < dh; y++)
+        for (int x = 0; x < dw; x++)
+            expected.at(x, y) = src.at((int)(((2L*x+1)*w)/(2L*dw)), (int)(((2L*y+1)*h)/(2L*dh)));
+    report("resize_nearest", format, dw, dh, same(dst, expected));
+
+    resize_bilinear(src.cview(), dst.view());
+    for (int y = 0; y < dh; y++) {
+        float fy = std::max(0.f, (y+.5f)*h/dh - .5f);
+        int y0 = std::min((int)fy, h-1), y1 = std::min(y0+1, h-1);
+        int wy = (int)((fy-y0)*256.f + .5f);
+        for (int x = 0; x < dw; x++) {
+            float fx = std::max(0.f, (x+.5f)*w/dw - .5f);
+            int x0 = std::min((int)fx, w-1), x1 = std::min(x0+1, w-1);
+            int wx = (int)((fx-x0)*256.f + .5f);
+            for (int c = 0; c < N; c++) {
+                int top    = ((const unsigned char *)&src.at(x0, y0))[c]*(256-wx) + ((const unsigned char *)&src.at(x1, y0))[c]*wx;
+                int bottom = ((const unsigned char *)&src.at(x0, y1))[c]*(256-wx) + ((const unsigned char *)&src.at(x1, y1))[c]*wx;
+                ((unsigned char *)&expected.at(x, y))[c] = (unsigned char)((top*(256-wy) + bottom*wy + (1<<15)) >> 16);
+            }
+        }
+    }
+    report("resize_bilinear", format, dw, dh, same(dst, expected));
+
+    dw = 1 + rng.below(w), dh = 1 + rng.below(h);
+    Image<T> small(dw, dh, dw), small_expected(dw, dh, dw);
+    downscale_box(src.cview(), small.view());
+    for (int y = 0; y < dh; y++)
+        for (int x = 0; x < dw; x++) {
+            int sx0 = (int)((long)x*w/dw), sx1 = std::max(sx0+1, (int)((long)(x+1)*w/dw));
+            int sy0 = (int)((long)y*h/dh), sy1 = std::max(sy0+1, (int)((long)(y+1)*h/dh));
+            int count = (sx1-sx0)*(sy1-sy0);
+            for (int c = 0; c < N; c++) {
+                int sum = 0;
+                for (int sy = sy0; sy < sy1; sy++)
+                    for (int sx = sx0; sx < sx1; sx++) sum += ((const unsigned char *)&src.at(sx, sy))[c];
+                ((unsigned char *)&small_expected.at(x, y))[c] = (unsigned char)((sum + count/2)/count);
+            }
+        }
+    report("downscale_box", format, dw, dh, same(small, small_expected));
+}
+
+static void check_color(LCG &rng, int w, int h) {
+    Image<RGB8> rgb = random_image<RGB8>(rng, w, h);
+    Image<RGBA8> rgba = random_image<RGBA8>(rng, w, h, true);
+    Image<Gray8> gray = random_image<Gray8>(rng, w, h);
+
+    Image<RGBA8> to_rgba(w, h, w), to_rgba_expected(w, h, w);
+    convert(rgb.cview(), to_rgba.view());
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++) {
+            RGBA8 &e = to_rgba_expected.at(x, y);
+            e.b = rgb.at(x, y).b; e.g = rgb.at(x, y).g; e.r = rgb.at(x, y).r; e.a = 255;
+        }
+    report("convert", "rgb->rgba", w, h, same(to_rgba, to_rgba_expected));
+
+    Image<RGB8> to_rgb(w, h, w), to_rgb_expected(w, h, w);
+    convert(rgba.cview(), to_rgb.view());
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++) {
+            RGB8 &e = to_rgb_expected.at(x, y);
+            e.b = rgba.at(x, y).b; e.g = rgba.at(x, y).g; e.r = rgba.at(x, y).r;
+        }
+    report("convert", "rgba->rgb", w, h, same(to_rgb, to_rgb_expected));
+
+    convert(gray.cview(), to_rgb.view());
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++) to_rgb_expected.at(x, y).b = to_rgb_expected.at(x, y).g = to_rgb_expected.at(x, y).r = gray.at(x, y);
+    report("convert", "gray->rgb", w, h, same(to_rgb, to_rgb_expected));
+
+    Image<Gray8> luma(w, h, w), luma_expected(w, h, w);
+    convert(rgb.cview(), luma.view());
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++) {
+            const RGB8 &s = rgb.at(x, y);
+            luma_expected.at(x, y) = (Gray8)((77*s.r + 150*s.g + 29*s.b + 128) >> 8);
+        }
+    report("convert", "rgb->gray", w, h, same(luma, luma_expected));
+    convert(rgba.cview(), luma.view());
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++) {
+            const RGBA8 &s = rgba.at(x, y);
+            luma_expected.at(x, y) = (Gray8)((77*s.r + 150*s.g + 29*s.b + 128) >> 8);
+        }
+    report("convert", "rgba->gray", w, h, same(luma, luma_expected));
+
+    Image<RGB8> swapped = rgb, swapped_expected = rgb;
+    swap_red_blue(swapped.view());
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++) std::swap(swapped_expected.at(x, y).b, swapped_expected.at(x, y).r);
+    report("swap_red_blue", "rgb", w, h, same(swapped, swapped_expected));
+    Image<RGBA8> swapped4 = rgba, swapped4_expected = rgba;
+    swap_red_blue(swapped4.view());
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++) std::swap(swapped4_expected.at(x, y).b, swapped4_expected.at(x, y).r);
+    report("swap_red_blue", "rgba", w, h, same(swapped4, swapped4_expected));
+
+    Image<RGBA8> pm = rgba, pm_expected = rgba;
+    premultiply(pm.view());
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++) {
+            RGBA8 &e = pm_expected.at(x, y);
+            e.b = (unsigned char)div255(e.b*e.a);
+            e.g = (unsigned char)div255(e.g*e.a);
+            e.r = (unsigned char)div255(e.r*e.a);
+        }
+    report("premultiply", "rgba", w, h, same(pm, pm_expected));
+
+    // src премультиплицирован, dst любой
+    Image<RGBA8> over = random_image<RGBA8>(rng, w, h), over_expected = over;
+    composite_over(pm.cview(), over.view());
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++) {
+            const RGBA8 &s = pm.at(x, y);
+            RGBA8 &d = over_expected.at(x, y);
+            int inv = 255 - s.a;
+            d.b = (unsigned char)std::min(255, s.b + div255(d.b*inv));
+            d.g = (unsigned char)std::min(255, s.g + div255(d.g*inv));
+            d.r = (unsigned char)std::min(255, s.r + div255(d.r*inv));
+            d.a = (unsigned char)std::min(255, s.a + div255(d.a*inv));
+        }
+    report("composite_over", "rgba", w, h, same(over, over_expected));
+
+    Image<RGB8> over3 = rgb, over3_expected = rgb;
+    composite_over(pm.cview(), over3.view());
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++) {
+            const RGBA8 &s = pm.at(x, y);
+            RGB8 &d = over3_expected.at(x, y);
+            int inv = 255 - s.a;
+            d.b = (unsigned char)std::min(255, s.b + div255(d.b*inv));
+            d.g = (unsigned char)std::min(255, s.g + div255(d.g*inv));
+            d.r = (unsigned char)std::min(255, s.r + div255(d.r*inv));
+        }
+    report("composite_over", "rgb", w, h, same(over3, over3_expected));
+}
+
+int main(int argc, char** argv) {
+    int rounds = 40;
+    unsigned int seed = 12345;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--rounds") && i+1 < argc) rounds = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--seed") && i+1 < argc) seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+        else {
+            std::cerr << "unknown argument " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    LCG rng = {seed};
+    for (int r = 0; r < rounds; r++) {
+        // каждый четвёртый раунд - картинка на несколько полос пула
+        int w = r % 4 == 3 ? 300 + rng.below(200) : 1 + rng.below(70);
+        int h = r % 4 == 3 ? 250 + rng.below(100) : 1 + rng.below(40);
+        check_geometry<Gray8>(rng, "gray", w, h);
+        check_geometry<RGB8>(rng, "rgb", w, h);
+        check_geometry<RGBA8>(rng, "rgba", w, h);
+        check_color(rng, w, h);
+    }
+    printf("%d rounds: %d mismatches\n", rounds, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,581 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../Include/tgaimage.h"
+#include "../Include/mesh.h"
+#include "../Include/math.h"
+#include "../Include/our_gl.h"
+#include "../Include/camera.h"
+#include "../Include/scene.h"
+#include "../Include/frame_arena.h"
+#include "../Include/image_kernels.h"
+
+// Микробенчмарки горячих путей рендера по отдельности.
+//
+//   renderer_bench [--filter substr] [--warmup N] [--reps N] [--batch-ms MS]
+//                  [--json out.json] [--baseline base.json] [--threshold PCT]
+//                  [--obj path] [--list]
+//
+// Каждый замер - пачка из n вызовов, n подбирается на прогреве так, чтобы пачка
+// шла не меньше --batch-ms. В отчёте время одного вызова: медиана и MAD по
+// --reps пачкам. С --baseline каждый тест сравнивается с сохранённым JSON
+// U-критерием Манна-Уитни по замерам пачек: регрессия - медиана хуже порога
+// и p < 0.01. Код возврата 2, если есть регрессии.
+
+typedef std::chrono::steady_clock Clock;
+
+struct Bench {
+    std::string name;
+    std::function<void()> setup; // один раз перед прогревом, не замеряется
+    std::function<void(long)> run; // n вызовов подряд
+};
+
+struct Result {
+    std::string name;
+    long batch;                  // вызовов в пачке
+    std::vector<double> samples; // нс на вызов, по пачке
+    double median, mad, min;
+};
+
+// не даёт компилятору выбросить результат
+static volatile float sink;
+
+static double median_of(std::vector<double> v) {
+    if (v.empty()) return 0.;
+    std::sort(v.begin(), v.end());
+    size_t n = v.size();
+    return n % 2 ? v[n/2] : .5*(v[n/2 - 1] + v[n/2]);
+}
+
+static double mad_of(const std::vector<double> &v, double median) {
+    std::vector<double> d;
+    for (double x : v) d.push_back(std::fabs(x - median));
+    return median_of(d);
+}
+
+static double batch_ns(const Bench &b, long n) {
+    Clock::time_point t0 = Clock::now();
+    b.run(n);
+    return std::chrono::duration<double, std::nano>(Clock::now() - t0).count();
+}
+
+static Result measure(const Bench &b, int warmup, int reps, double batch_ms) {
+    if (b.setup) b.setup();
+    // прогрев и подбор размера пачки: удваиваем, пока пачка короче batch_ms
+    long n = 1;
+    while (batch_ns(b, n) < batch_ms*1e6 && n < (1L << 30)) n *= 2;
+    for (int i = 0; i < warmup; i++) batch_ns(b, n);
+    Result r;
+    r.name = b.name;
+    r.batch = n;
+    for (int i = 0; i < reps; i++) r.samples.push_back(batch_ns(b, n)/n);
+    r.median = median_of(r.samples);
+    r.mad = mad_of(r.samples, r.median);
+    r.min = *std::min_element(r.samples.begin(), r.samples.end());
+    return r;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+
+static std::string json_escape(const std::string &s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+static bool write_json(const char *filename, const std::vector<Result> &results) {
+    std::ofstream out(filename);
+    if (!out) return false;
+    out.precision(9);
+    out << "{\n  \"unit\": \"ns\",\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result &r = results[i];
+        out << "    {\"name\": \"" << json_escape(r.name) << "\", \"batch\": " << r.batch << ", \"median\": " << r.median
+            << ", \"mad\": " << r.mad << ", \"min\": " << r.min << ", \"samples\": [";
+        for (size_t k = 0; k < r.samples.size(); k++) out << (k ? ", " : "") << r.samples[k];
+        out << "]}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    return (bool)out;
+}
+
+// читает только то, что пишет write_json: имя и замеры каждого теста
+static bool read_json(const char *filename, std::vector<Result> &results) {
+    std::ifstream in(filename);
+    if (!in) return false;
+    std::stringstream ss;
+    ss << in.rdbuf();
+    std::string s = ss.str();
+    size_t pos = 0;
+    for (;;) {
+        size_t name = s.find("\"name\": \"", pos);
+        if (name == std::string::npos) break;
+        name += 9;
+        size_t end = s.find('"', name);
+        size_t samples = s.find("\"samples\": [", end);
+        size_t close = samples == std::string::npos ? samples : s.find(']', samples);
+        if (end == std::string::npos || close == std::string::npos) return false;
+        Result r;
+        r.name = s.substr(name, end - name);
+        r.batch = 0;
+        const char *p = s.c_str() + samples + 12;
+        const char *stop = s.c_str() + close;
+        while (p < stop) {
+            char *next;
+            double v = strtod(p, &next);
+            if (next == p) break;
+            r.samples.push_back(v);
+            p = next;
+            while (p < stop && (*p == ',' || *p == ' ')) p++;
+        }
+        r.median = median_of(r.samples);
+        r.mad = mad_of(r.samples, r.median);
+        r.min = r.samples.empty() ? 0. : *std::min_element(r.samples.begin(), r.samples.end());
+        results.push_back(r);
+        pos = close;
+    }
+    return true;
+}
+
+// односторонний U-тест Манна-Уитни, нормальное приближение с поправкой на связи:
+// вероятность получить такие b при a не хуже
+static double mann_whitney_p(const std::vector<double> &a, const std::vector<double> &b) {
+    size_t n1 = a.size(), n2 = b.size();
+    if (!n1 || !n2) return 1.;
+    std::vector<std::pair<double, int> > all;
+    for (double x : a) all.push_back(std::make_pair(x, 0));
+    for (double x : b) all.push_back(std::make_pair(x, 1));
+    std::sort(all.begin(), all.end());
+    double rank_b = 0., ties = 0.;
+    for (size_t i = 0; i < all.size();) {
+        size_t j = i;
+        while (j < all.size() && all[j].first == all[i].first) j++;
+        double rank = .5*(i + 1 + j); // средний ранг группы
+        for (size_t k = i; k < j; k++) if (all[k].second) rank_b += rank;
+        double t = (double)(j - i);
+        ties += t*t*t - t;
+        i = j;
+    }
+    double n = (double)(n1 + n2);
+    double u = rank_b - .5*n2*(n2 + 1);
+    double mean = .5*n1*n2;
+    double var = n1*n2/12.*((n + 1) - ties/(n*(n - 1)));
+    if (var <= 0.) return 1.;
+    double z = (u - mean - .5)/std::sqrt(var);
+    return .5*std::erfc(z/std::sqrt(2.));
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+
+// плоская заливка: растеризация и z-тест без стоимости шейдинга
+struct FlatShader : public IShader {
+    TGAColor color;
+    virtual Vec4f vertex(int, int) { return Vec4f(); }
+    virtual bool fragment(Vec3f, TGAColor &c) {
+        c = color;
+        return false;
+    }
+};
+
+struct LCG {
+    unsigned int seed;
+    explicit LCG(unsigned int s) : seed(s) {}
+    float next() {
+        seed = seed*1664525u + 1013904223u;
+        return (seed >> 8)*(1.f/16777216.f);
+    }
+};
+
+// n треугольников со стороной около size пикселей в кадре w x h, вершины в экранных координатах
+static std::vector<Vec4f> random_triangles(int n, float size, int w, int h, unsigned int seed) {
+    LCG rnd(seed);
+    std::vector<Vec4f> pts;
+    for (int i = 0; i < n; i++) {
+        float cx = rnd.next()*w, cy = rnd.next()*h;
+        for (int j = 0; j < 3; j++) {
+            float a = 2.f*(float)M_PI*(j + rnd.next()*.5f)/3.f;
+            pts.push_back(embed<4>(Vec3f(cx + std::cos(a)*size*.6f, cy + std::sin(a)*size*.6f, rnd.next()*255.f)));
+        }
+    }
+    return pts;
+}
+
+static void add_triangle_benches(std::vector<Bench> &benches) {
+    // размеры как у граней головы в кадре 800x800 (единицы пикселей), средних мешей и полноэкранных проходов
+    struct { const char *name; float size; int count; } dist[] = {
+        {"triangle/tiny_2px", 2.f, 4096}, {"triangle/small_8px", 8.f, 4096},
+        {"triangle/medium_32px", 32.f, 1024}, {"triangle/large_256px", 256.f, 64},
+    };
+    const int w = 512, h = 512;
+    std::shared_ptr<TGAImage> image = std::make_shared<TGAImage>(w, h, TGAImage::RGB);
+    std::shared_ptr<TGAImage> zbuffer = std::make_shared<TGAImage>(w, h, TGAImage::GRAYSCALE);
+    for (auto &d : dist) {
+        std::shared_ptr<std::vector<Vec4f> > pts = std::make_shared<std::vector<Vec4f> >();
+        int count = d.count;
+        float size = d.size;
+        Bench b;
+        b.name = d.name;
+        b.setup = [=]() { *pts = random_triangles(count, size, w, h, 7); };
+        // один вызов - один треугольник; z-буфер чистится раз в проход по списку
+        b.run = [=](long n) {
+            FlatShader shader;
+            shader.color = TGAColor(200, 120, 40, 255);
+            ImageView<RGB8> frame = image->pixels<RGB8>();
+            ImageView<Gray8> depth = zbuffer->pixels<Gray8>();
+            for (long i = 0; i < n; i++) {
+                int t = (int)(i % count);
+                if (!t) zbuffer->clear();
+                triangle(&(*pts)[t*3], shader, frame, depth);
+            }
+        };
+        benches.push_back(b);
+    }
+}
+
+// камера и viewport как у renderer, кадр w x h
+static void setup_view(int w, int h) {
+    Camera cam(Vec3f(2, 2, 10), Vec3f(0, 0, 0), Vec3f(0, 1, 0));
+    cam.applyView();
+    cam.applyProjection(w, h);
+    viewport(w/8, h/8, w*3/4, h*3/4);
+}
+
+static void add_shader_benches(std::vector<Bench> &benches) {
+    // Shader::fragment на гранях головы, барицентрики по сетке внутри треугольника
+    Bench b;
+    b.name = "shader/fragment";
+    std::shared_ptr<std::vector<PreparedFace> > faces = std::make_shared<std::vector<PreparedFace> >();
+    b.setup = [=]() {
+        setup_view(800, 800);
+        Shader shader;
+        faces->clear();
+        for (int i = 0; i < model->nfaces(); i++) {
+            PreparedFace f;
+            for (int j = 0; j < 3; j++) f.pts[j] = shader.vertex(i, j);
+            shader.save(f);
+            faces->push_back(f);
+        }
+    };
+    b.run = [=](long n) {
+        Shader shader;
+        shader.bar_ddx = Vec3f(-.01f, .01f, 0.f);
+        shader.bar_ddy = Vec3f(-.01f, 0.f, .01f);
+        TGAColor c;
+        float acc = 0.f;
+        for (long i = 0; i < n; i++) {
+            if (i % 16 == 0) shader.restore((*faces)[(i/16) % faces->size()]);
+            float u = (i % 4 + .5f)*.2f, v = (i/4 % 4 + .5f)*.2f*(1.f - u);
+            shader.frag_coord = Vec2i((int)(i % 800), (int)(i/800 % 800));
+            shader.fragment(Vec3f(1.f - u - v, u, v), c);
+            acc += c[0];
+        }
+        sink = acc;
+    };
+    benches.push_back(b);
+
+    b = Bench();
+    b.name = "shader/vertex";
+    b.setup = []() { setup_view(800, 800); };
+    b.run = [](long n) {
+        Shader shader;
+        float acc = 0.f;
+        int nfaces = model->nfaces();
+        for (long i = 0; i < n; i++) acc += shader.vertex((int)(i/3 % nfaces), (int)(i % 3))[0];
+        sink = acc;
+    };
+    benches.push_back(b);
+}
+
+static void add_model_benches(std::vector<Bench> &benches, const std::string &obj) {
+    // только OBJ: текстуры не запрошены и не грузятся
+    Bench b;
+    b.name = "model/load_obj";
+    b.run = [obj](long n) {
+        for (long i = 0; i < n; i++) {
+            Model m(obj.c_str());
+            sink = (float)m.nfaces();
+        }
+    };
+    benches.push_back(b);
+}
+
+static void add_tga_benches(std::vector<Bench> &benches, const std::string &texture) {
+    // кодирование и разбор в памяти, без диска: диффузная текстура головы
+    std::shared_ptr<TGAImage> image = std::make_shared<TGAImage>();
+    std::shared_ptr<std::vector<unsigned char> > rle = std::make_shared<std::vector<unsigned char> >();
+    std::shared_ptr<std::vector<unsigned char> > raw = std::make_shared<std::vector<unsigned char> >();
+    std::function<void()> setup = [=]() {
+        if (!image->get_width()) {
+            image->read_tga_file(texture.c_str());
+            encode_tga(image->view(), *rle, true);
+            encode_tga(image->view(), *raw, false);
+        }
+    };
+    for (int compressed = 1; compressed >= 0; compressed--) {
+        std::shared_ptr<std::vector<unsigned char> > data = compressed ? rle : raw;
+        Bench b;
+        b.name = compressed ? "tga/write_rle" : "tga/write_raw";
+        b.setup = setup;
+        b.run = [=](long n) {
+            std::vector<unsigned char> out;
+            for (long i = 0; i < n; i++) encode_tga(image->view(), out, compressed != 0);
+            sink = (float)out.size();
+        };
+        benches.push_back(b);
+        b.name = compressed ? "tga/read_rle" : "tga/read_raw";
+        b.run = [=](long n) {
+            TGAImage img;
+            for (long i = 0; i < n; i++) img.read_tga_buffer(data->data(), data->size());
+            sink = (float)img.get_width();
+        };
+        benches.push_back(b);
+    }
+}
+
+static void add_math_benches(std::vector<Bench> &benches) {
+    Matrix a = Matrix::identity(), b = Matrix::identity();
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++) {
+            a[i][j] += .01f*(i*4 + j);
+            b[i][j] -= .02f*(j*4 + i);
+        }
+    Bench m;
+    m.name = "math/mat4_mul";
+    m.run = [=](long n) {
+        Matrix r = a;
+        for (long i = 0; i < n; i++) r = r*b;
+        sink = r[0][0];
+    };
+    benches.push_back(m);
+    m.name = "math/mat4_vec4";
+    m.run = [=](long n) {
+        Vec4f v = embed<4>(Vec3f(1.f, 2.f, 3.f));
+        for (long i = 0; i < n; i++) v = a*v;
+        sink = v[0];
+    };
+    benches.push_back(m);
+    m.name = "math/mat4_invert_transpose";
+    m.run = [=](long n) {
+        Matrix r = a;
+        float acc = 0.f;
+        for (long i = 0; i < n; i++) {
+            r[0][0] = 1.f + i*1e-9f;
+            acc += r.invert_transpose()[1][1];
+        }
+        sink = acc;
+    };
+    benches.push_back(m);
+}
+
+// картинка w x h из шума; альфа отрезками 0, 255 и промежуточная, как у спрайтов
+static std::shared_ptr<TGAImage> noise_image(int w, int h, int bpp, unsigned int seed) {
+    std::shared_ptr<TGAImage> img = std::make_shared<TGAImage>(w, h, bpp);
+    LCG rnd(seed);
+    unsigned char *p = img->buffer();
+    for (long i = 0; i < (long)w*h*bpp; i++) p[i] = (unsigned char)(rnd.next()*256.f);
+    if (bpp == TGAImage::RGBA)
+        for (long i = 0; i < (long)w*h; i++) {
+            int run = (int)(i/37 % 3);
+            if (run < 2) p[i*4 + 3] = run ? 255 : 0;
+        }
+    return img;
+}
+
+static void add_kernel_benches(std::vector<Bench> &benches) {
+    // ядра image_kernels на картинке 1024 x 1024 (больше KERNEL_PARALLEL_PIXELS, то есть с полосами на пуле);
+    // resize - в 1.5 раза больше, downscale_box - в 3 раза меньше
+    const int S = 1024;
+    std::shared_ptr<TGAImage> rgb  = noise_image(S, S, TGAImage::RGB, 11);
+    std::shared_ptr<TGAImage> rgba = noise_image(S, S, TGAImage::RGBA, 12);
+    std::shared_ptr<TGAImage> rgb_dst  = std::make_shared<TGAImage>(S, S, TGAImage::RGB);
+    std::shared_ptr<TGAImage> rgba_dst = std::make_shared<TGAImage>(S, S, TGAImage::RGBA);
+    std::shared_ptr<TGAImage> rgb_big   = std::make_shared<TGAImage>(S*3/2, S*3/2, TGAImage::RGB);
+    std::shared_ptr<TGAImage> rgb_small = std::make_shared<TGAImage>(S/3, S/3, TGAImage::RGB);
+
+    struct Case {
+        const char *name;
+        std::function<void()> run;
+    };
+    std::vector<Case> cases = {
+        {"kernel/flip_vertical_rgb",       [=]() { flip_vertical(rgb->pixels<RGB8>()); }},
+        {"kernel/flip_horizontal_rgb",     [=]() { flip_horizontal(rgb->pixels<RGB8>()); }},
+        {"kernel/flip_horizontal_rgba",    [=]() { flip_horizontal(rgba->pixels<RGBA8>()); }},
+        {"kernel/resize_nearest_rgb",      [=]() { resize_nearest<RGB8>(rgb->pixels<RGB8>(), rgb_big->pixels<RGB8>()); }},
+        {"kernel/resize_bilinear_rgb",     [=]() { resize_bilinear<RGB8>(rgb->pixels<RGB8>(), rgb_big->pixels<RGB8>()); }},
+        {"kernel/downscale_box_rgb",       [=]() { downscale_box<RGB8>(rgb->pixels<RGB8>(), rgb_small->pixels<RGB8>()); }},
+        {"kernel/convert_rgb_rgba",        [=]() { convert(rgb->pixels<RGB8>(), rgba_dst->pixels<RGBA8>()); }},
+        {"kernel/convert_rgba_rgb",        [=]() { convert(rgba->pixels<RGBA8>(), rgb_dst->pixels<RGB8>()); }},
+        // альфа не меняется, поэтому повторы в одной картинке идут по тем же ветвям
+        {"kernel/premultiply_rgba",        [=]() { premultiply(rgba->pixels<RGBA8>()); }},
+        {"kernel/composite_over_rgba",     [=]() { composite_over(rgba->pixels<RGBA8>(), rgba_dst->pixels<RGBA8>()); }},
+        {"kernel/composite_over_rgb",      [=]() { composite_over(rgba->pixels<RGBA8>(), rgb_dst->pixels<RGB8>()); }},
+    };
+    for (const Case &c : cases) {
+        Bench b;
+        b.name = c.name;
+        std::function<void()> kernel = c.run;
+        b.run = [=](long n) {
+            for (long i = 0; i < n; i++) kernel();
+            sink = (float)rgb_dst->buffer()[0];
+        };
+        benches.push_back(b);
+    }
+}
+
+static void add_frame_benches(std::vector<Bench> &benches) {
+    // полный непрозрачный проход головы, как renderer без куба
+    int sizes[] = {256, 512, 800, 1024};
+    for (int s : sizes) {
+        std::shared_ptr<TGAImage> image = std::make_shared<TGAImage>(s, s, TGAImage::RGB);
+        std::shared_ptr<TGAImage> zbuffer = std::make_shared<TGAImage>(s, s, TGAImage::GRAYSCALE);
+        std::shared_ptr<TileBins> bins = std::make_shared<TileBins>();
+        Bench b;
+        b.name = "frame/head_" + std::to_string(s);
+        b.setup = [=]() {
+            setup_view(s, s);
+            clear_lights();
+        };
+        b.run = [=](long n) {
+            for (long i = 0; i < n; i++) {
+                FrameArena::reset();
+                image->clear();
+                zbuffer->clear();
+                render_opaque(image->pixels<RGB8>(), zbuffer->pixels<Gray8>(), *bins,
+                              std::function<void(int, TGAImage &, TGAImage &)>());
+            }
+        };
+        benches.push_back(b);
+    }
+
+    // голова 800x800 с N локальными источниками, как renderer --lights N;
+    // _all - без отсечения по тайлам (--no-light-culling)
+    int counts[] = {1, 4, 16, 64, 256, 1024};
+    for (int lights : counts) {
+        for (int cull = 1; cull >= 0; cull--) {
+            std::shared_ptr<TGAImage> image = std::make_shared<TGAImage>(800, 800, TGAImage::RGB);
+            std::shared_ptr<TGAImage> zbuffer = std::make_shared<TGAImage>(800, 800, TGAImage::GRAYSCALE);
+            std::shared_ptr<TileBins> bins = std::make_shared<TileBins>();
+            Bench b;
+            b.name = "frame/lights_" + std::to_string(lights) + (cull ? "" : "_all");
+            b.setup = [=]() {
+                setup_view(800, 800);
+                clear_lights();
+                scatter_lights(lights);
+            };
+            b.run = [=](long n) {
+                light_culling = cull != 0;
+                for (long i = 0; i < n; i++) {
+                    FrameArena::reset();
+                    image->clear();
+                    zbuffer->clear();
+                    render_opaque(image->pixels<RGB8>(), zbuffer->pixels<Gray8>(), *bins,
+                                  std::function<void(int, TGAImage &, TGAImage &)>());
+                }
+                light_culling = true;
+            };
+            benches.push_back(b);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    std::string obj = "../obj/african_head.obj";
+    std::string filter;
+    int warmup = 3, reps = 15;
+    double batch_ms = 20.;
+    double threshold = 5.; // % медианы
+    const char *json = NULL;
+    const char *baseline = NULL;
+    bool list = false;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--filter") && i+1 < argc) filter = argv[++i];
+        else if (!strcmp(argv[i], "--warmup") && i+1 < argc) warmup = std::max(0, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--reps") && i+1 < argc) reps = std::max(3, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--batch-ms") && i+1 < argc) batch_ms = std::max(.1, atof(argv[++i]));
+        else if (!strcmp(argv[i], "--json") && i+1 < argc) json = argv[++i];
+        else if (!strcmp(argv[i], "--baseline") && i+1 < argc) baseline = argv[++i];
+        else if (!strcmp(argv[i], "--threshold") && i+1 < argc) threshold = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--obj") && i+1 < argc) obj = argv[++i];
+        else if (!strcmp(argv[i], "--list")) list = true;
+        else {
+            std::cerr << "unknown argument " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<Result> base;
+    if (baseline && !read_json(baseline, base)) {
+        std::cerr << "can't read " << baseline << std::endl;
+        return 1;
+    }
+
+    std::vector<Bench> benches;
+    add_triangle_benches(benches);
+    add_shader_benches(benches);
+    add_model_benches(benches, obj);
+    add_tga_benches(benches, obj.substr(0, obj.rfind('.')) + "_diffuse.tga");
+    add_math_benches(benches);
+    add_kernel_benches(benches);
+    add_frame_benches(benches);
+    if (list) {
+        for (const Bench &b : benches) std::cout << b.name << std::endl;
+        return 0;
+    }
+
+    // голова с текстурами нужна шейдеру и кадрам; грузится один раз
+    std::unique_ptr<Model> head(new Model(obj.c_str(), 1<<Model::DIFFUSE | 1<<Model::SPECULAR));
+    head->require(Model::DIFFUSE);
+    head->require(Model::SPECULAR);
+    model = head.get();
+    light_dir.normalize();
+
+    std::vector<Result> results;
+    int regressions = 0;
+    printf("%-30s %12s %10s %12s %8s\n", "benchmark", "median ns", "MAD %", "min ns", "batch");
+    for (const Bench &b : benches) {
+        if (!filter.empty() && b.name.find(filter) == std::string::npos) continue;
+        Result r = measure(b, warmup, reps, batch_ms);
+        results.push_back(r);
+        printf("%-30s %12.1f %9.2f%% %12.1f %8ld", r.name.c_str(), r.median, r.median > 0. ? 100.*r.mad/r.median : 0.,
+               r.min, r.batch);
+        for (const Result &old : base) {
+            if (old.name != r.name) continue;
+            double change = old.median > 0. ? 100.*(r.median - old.median)/old.median : 0.;
+            double p_slower = mann_whitney_p(old.samples, r.samples);
+            double p_faster = mann_whitney_p(r.samples, old.samples);
+            const char *verdict = "";
+            if (change > threshold && p_slower < .01) {
+                verdict = "  REGRESSION";
+                regressions++;
+            } else if (change < -threshold && p_faster < .01) {
+                verdict = "  faster";
+            }
+            printf("  %+7.2f%% vs baseline (p %.4f)%s", change, std::min(p_slower, p_faster), verdict);
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+
+    model = NULL;
+    if (json && !write_json(json, results)) {
+        std::cerr << "can't write " << json << std::endl;
+        return 1;
+    }
+    if (baseline)
+        std::cerr << regressions << " significant regressions over " << threshold << "%" << std::endl;
+    return regressions ? 2 : 0;
+}
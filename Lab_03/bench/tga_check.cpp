@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "../Include/tgaimage.h"
+
+// Проверка кодека TGA на случайных картинках: 1/3/4 байта на пиксель, без
+// сжатия и с RLE. encode_tga сверяется байт в байт с исходной записью файла
+// (заголовок, пакеты RLE старого unload_rle_data, подвал), read_tga_buffer
+// должен вернуть исходные пиксели, а обрезанный или испорченный файл - не
+// уронить декодер.
+//
+//   tga_check [--images N] [--seed S]
+//
+// Код возврата 1 при любом расхождении.
+
+struct LCG {
+    unsigned int state;
+    unsigned int next() {
+        state = state*1664525u + 1013904223u;
+        return state >> 8;
+    }
+    int below(int n) { return (int)(next() % (unsigned int)n); }
+};
+
+// картинка из отрезков: повторы любой длины (и длиннее 128 пикселей), шум и
+// одиночные пиксели, чтобы попасть на все границы пакетов
+static TGAImage random_image(LCG &rng) {
+    static const int formats[3] = {TGAImage::GRAYSCALE, TGAImage::RGB, TGAImage::RGBA};
+    int bpp = formats[rng.below(3)];
+    int w = 1 + rng.below(rng.below(4) ? 64 : 300);
+    int h = 1 + rng.below(48);
+    TGAImage img(w, h, bpp);
+    unsigned char *p = img.buffer();
+    long npixels = (long)w*h;
+    long i = 0;
+    unsigned char pixel[4] = {0, 0, 0, 0};
+    while (i < npixels) {
+        int kind = rng.below(4);
+        long len = 1 + (kind == 0 ? rng.below(300) : rng.below(8));
+        for (long k = 0; k < len && i < npixels; k++, i++) {
+            // kind 0, 1 - повтор одного пикселя, 2 - шум, 3 - шум из двух значений
+            if (k == 0 || kind == 2 || (kind == 3 && rng.below(2)))
+                for (int c = 0; c < bpp; c++) pixel[c] = (unsigned char)(kind == 3 ? rng.below(2) : rng.next());
+            memcpy(p + i*bpp, pixel, bpp);
+        }
+    }
+    return img;
+}
+
+// исходный TGAImage::write_tga_file (до кодирования в память), в буфер
+static void reference_tga(const TGAImage &img, bool rle, std::vector<unsigned char> &out) {
+    const int bytespp = img.get_bytespp();
+    const unsigned char *data = img.buffer();
+    unsigned char developer_area_ref[4] = {0, 0, 0, 0};
+    unsigned char extension_area_ref[4] = {0, 0, 0, 0};
+    unsigned char footer[18] = {'T','R','U','E','V','I','S','I','O','N','-','X','F','I','L','E','.','\0'};
+    TGA_Header header;
+    memset((void *)&header, 0, sizeof(header));
+    header.bitsperpixel = bytespp<<3;
+    header.width  = img.get_width();
+    header.height = img.get_height();
+    header.datatypecode = (bytespp==TGAImage::GRAYSCALE?(rle?11:3):(rle?10:2));
+    header.imagedescriptor = 0x20;
+    out.assign((unsigned char *)&header, (unsigned char *)&header + sizeof(header));
+    unsigned long npixels = (unsigned long)img.get_width()*img.get_height();
+    if (!rle) {
+        out.insert(out.end(), data, data + npixels*bytespp);
+    } else {
+        const unsigned char max_chunk_length = 128;
+        unsigned long curpix = 0;
+        while (curpix<npixels) {
+            unsigned long chunkstart = curpix*bytespp;
+            unsigned long curbyte = curpix*bytespp;
+            unsigned char run_length = 1;
+            bool raw = true;
+            while (curpix+run_length<npixels && run_length<max_chunk_length) {
+                bool succ_eq = true;
+                for (int t=0; succ_eq && t<bytespp; t++) {
+                    succ_eq = (data[curbyte+t]==data[curbyte+t+bytespp]);
+                }
+                curbyte += bytespp;
+                if (1==run_length) {
+                    raw = !succ_eq;
+                }
+                if (raw && succ_eq) {
+                    run_length--;
+                    break;
+                }
+                if (!raw && !succ_eq) {
+                    break;
+                }
+                run_length++;
+            }
+            curpix += run_length;
+            out.push_back((unsigned char)(raw?run_length-1:run_length+127));
+            out.insert(out.end(), data+chunkstart, data+chunkstart+(raw?run_length*bytespp:bytespp));
+        }
+    }
+    out.insert(out.end(), developer_area_ref, developer_area_ref + sizeof(developer_area_ref));
+    out.insert(out.end(), extension_area_ref, extension_area_ref + sizeof(extension_area_ref));
+    out.insert(out.end(), footer, footer + sizeof(footer));
+}
+
+static bool same_pixels(const TGAImage &a, const TGAImage &b) {
+    return a.get_width() == b.get_width() && a.get_height() == b.get_height() && a.get_bytespp() == b.get_bytespp() &&
+           !memcmp(a.buffer(), b.buffer(), (size_t)a.get_width()*a.get_height()*a.get_bytespp());
+}
+
+int main(int argc, char** argv) {
+    int images = 300;
+    unsigned int seed = 12345;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--images") && i+1 < argc) images = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--seed") && i+1 < argc) seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+        else {
+            std::cerr << "unknown argument " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    // декодер пишет размер каждой картинки в cerr; здесь это только шум
+    std::ostringstream quiet;
+    std::streambuf *cerr_buf = std::cerr.rdbuf(quiet.rdbuf());
+    LCG rng = {seed};
+    int failures = 0;
+    long encoded = 0, rle_bytes = 0, raw_bytes = 0;
+    for (int n = 0; n < images; n++) {
+        TGAImage img = random_image(rng);
+        for (int rle = 0; rle < 2; rle++) {
+            std::vector<unsigned char> file, reference;
+            encode_tga(img.view(), file, rle != 0);
+            reference_tga(img, rle != 0, reference);
+            encoded++;
+            (rle ? rle_bytes : raw_bytes) += (long)file.size();
+            const char *error = NULL;
+            TGAImage decoded;
+            if (file != reference) error = "encoding differs from the reference";
+            else if (!decoded.read_tga_buffer(file.data(), file.size())) error = "can't decode";
+            else if (!same_pixels(img, decoded)) error = "decoded pixels differ";
+            if (error) {
+                failures++;
+                printf("image %d (%dx%d, %d bpp, %s): %s\n", n, img.get_width(), img.get_height(), img.get_bytespp()*8,
+                       rle ? "rle" : "raw", error);
+                continue;
+            }
+            // обрезанный и испорченный файл: декодер может отказаться, но не выйти за буфер
+            std::vector<unsigned char> broken(file.begin(), file.begin() + rng.below((int)file.size()));
+            decoded.read_tga_buffer(broken.data(), broken.size());
+            broken = file;
+            for (int k = 0; k < 4; k++) broken[sizeof(TGA_Header) + rng.below((int)(file.size() - sizeof(TGA_Header)))] ^= (unsigned char)(1 + rng.below(255));
+            decoded.read_tga_buffer(broken.data(), broken.size());
+        }
+    }
+    std::cerr.rdbuf(cerr_buf);
+    printf("%ld encodings of %d images: %d failures; raw %ld bytes, rle %ld bytes\n", encoded, images, failures, raw_bytes,
+           rle_bytes);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,151 @@
+#include <cmath>
+#include <algorithm>
+#include "../Include/block_compression.h"
+
+static inline unsigned short pack565(const unsigned char *bgra) {
+    return (unsigned short)(((bgra[2]>>3)<<11) | ((bgra[1]>>2)<<5) | (bgra[0]>>3));
+}
+
+static inline void unpack565(unsigned short c, unsigned char *bgra) {
+    int r = (c>>11) & 31, g = (c>>5) & 63, b = c & 31;
+    bgra[0] = (unsigned char)((b<<3) | (b>>2));
+    bgra[1] = (unsigned char)((g<<2) | (g>>4));
+    bgra[2] = (unsigned char)((r<<3) | (r>>2));
+    bgra[3] = 255;
+}
+
+static void bc1_palette(unsigned short c0, unsigned short c1, unsigned char palette[4][4]) {
+    unpack565(c0, palette[0]);
+    unpack565(c1, palette[1]);
+    for (int t=0; t<3; t++) {
+        if (c0>c1) {
+            palette[2][t] = (unsigned char)((2*palette[0][t] + palette[1][t])/3);
+            palette[3][t] = (unsigned char)((palette[0][t] + 2*palette[1][t])/3);
+        } else {
+            palette[2][t] = (unsigned char)((palette[0][t] + palette[1][t])/2);
+            palette[3][t] = 0;
+        }
+    }
+    palette[2][3] = palette[3][3] = 255;
+}
+
+void encode_bc1(const unsigned char *bgra, unsigned char *block) {
+    unsigned char lo[4] = {255, 255, 255, 255};
+    unsigned char hi[4] = {0, 0, 0, 0};
+    for (int i=0; i<16; i++) {
+        for (int t=0; t<3; t++) {
+            lo[t] = std::min(lo[t], bgra[i*4+t]);
+            hi[t] = std::max(hi[t], bgra[i*4+t]);
+        }
+    }
+    // pull the box in by 1/16 of its extent, endpoints land closer to the cluster
+    for (int t=0; t<3; t++) {
+        int inset = (hi[t]-lo[t])>>4;
+        lo[t] = (unsigned char)(lo[t]+inset);
+        hi[t] = (unsigned char)(hi[t]-inset);
+    }
+    unsigned short c0 = pack565(hi);
+    unsigned short c1 = pack565(lo);
+    if (c0<c1) std::swap(c0, c1);
+
+    unsigned int indices = 0;
+    if (c0!=c1) {
+        unsigned char palette[4][4];
+        bc1_palette(c0, c1, palette);
+        for (int i=0; i<16; i++) {
+            int best = 0, best_err = 1<<30;
+            for (int k=0; k<4; k++) {
+                int err = 0;
+                for (int t=0; t<3; t++) {
+                    int d = bgra[i*4+t]-palette[k][t];
+                    err += d*d;
+                }
+                if (err<best_err) {
+                    best_err = err;
+                    best = k;
+                }
+            }
+            indices |= (unsigned int)best << (2*i);
+        }
+    }
+    block[0] = (unsigned char)(c0 & 0xff);
+    block[1] = (unsigned char)(c0 >> 8);
+    block[2] = (unsigned char)(c1 & 0xff);
+    block[3] = (unsigned char)(c1 >> 8);
+    for (int k=0; k<4; k++) block[4+k] = (unsigned char)(indices >> (8*k));
+}
+
+void decode_bc1(const unsigned char *block, int i, unsigned char *bgra) {
+    unsigned short c0 = (unsigned short)(block[0] | (block[1]<<8));
+    unsigned short c1 = (unsigned short)(block[2] | (block[3]<<8));
+    int idx = (block[4+(i>>2)] >> (2*(i&3))) & 3;
+    if (idx<2) {
+        unpack565(idx ? c1 : c0, bgra);
+        return;
+    }
+    unsigned char e0[4], e1[4];
+    unpack565(c0, e0);
+    unpack565(c1, e1);
+    for (int t=0; t<3; t++) {
+        if (c0>c1)
+            bgra[t] = (unsigned char)(idx==2 ? (2*e0[t]+e1[t])/3 : (e0[t]+2*e1[t])/3);
+        else
+            bgra[t] = (unsigned char)(idx==2 ? (e0[t]+e1[t])/2 : 0);
+    }
+    bgra[3] = 255;
+}
+
+static inline int bc4_value(int a0, int a1, int idx) {
+    if (idx==0) return a0;
+    if (idx==1) return a1;
+    if (a0>a1) return ((8-idx)*a0 + (idx-1)*a1)/7;
+    if (idx<6)  return ((6-idx)*a0 + (idx-1)*a1)/5;
+    return idx==6 ? 0 : 255;
+}
+
+void encode_bc4(const unsigned char *bgra, int channel, unsigned char *block) {
+    int lo = 255, hi = 0;
+    for (int i=0; i<16; i++) {
+        lo = std::min(lo, (int)bgra[i*4+channel]);
+        hi = std::max(hi, (int)bgra[i*4+channel]);
+    }
+    block[0] = (unsigned char)hi;
+    block[1] = (unsigned char)lo;
+    unsigned long long indices = 0;
+    if (hi!=lo) {
+        int palette[8];
+        for (int k=0; k<8; k++) palette[k] = bc4_value(hi, lo, k);
+        for (int i=0; i<16; i++) {
+            int v = bgra[i*4+channel];
+            int best = 0;
+            for (int k=1; k<8; k++)
+                if (std::abs(palette[k]-v) < std::abs(palette[best]-v)) best = k;
+            indices |= (unsigned long long)best << (3*i);
+        }
+    }
+    for (int k=0; k<6; k++) block[2+k] = (unsigned char)(indices >> (8*k));
+}
+
+unsigned char decode_bc4(const unsigned char *block, int i) {
+    int bit = 3*i;
+    int bits = block[2+(bit>>3)] | ((bit>>3)<5 ? block[3+(bit>>3)]<<8 : 0);
+    int idx = (bits >> (bit&7)) & 7;
+    return (unsigned char)bc4_value(block[0], block[1], idx);
+}
+
+void encode_bc5(const unsigned char *bgra, unsigned char *block) {
+    encode_bc4(bgra, 2, block);
+    encode_bc4(bgra, 1, block+BC4_BLOCK_BYTES);
+}
+
+void decode_bc5(const unsigned char *block, int i, unsigned char *bgra) {
+    unsigned char r = decode_bc4(block, i);
+    unsigned char g = decode_bc4(block+BC4_BLOCK_BYTES, i);
+    float x = r/255.f*2.f - 1.f;
+    float y = g/255.f*2.f - 1.f;
+    float z = std::sqrt(std::max(0.f, 1.f - x*x - y*y));
+    bgra[0] = (unsigned char)((z*.5f + .5f)*255.f + .5f);
+    bgra[1] = g;
+    bgra[2] = r;
+    bgra[3] = 255;
+}
@@ -0,0 +1,80 @@
+#include "../Include/frame_arena.h"
+
+Arena::Arena() : blocks_(), current_(0), offset_(0), used_(0) {}
+
+Arena::~Arena() {
+    for (size_t i = 0; i < blocks_.size(); i++) delete [] blocks_[i].data;
+}
+
+void *Arena::allocate(size_t bytes, size_t align) {
+    while (current_ < blocks_.size()) {
+        Block &b = blocks_[current_];
+        size_t addr = (size_t)(b.data + offset_);
+        size_t pad = (align - addr % align) % align;
+        if (offset_ + pad + bytes <= b.size) {
+            offset_ += pad + bytes;
+            used_ += bytes;
+            return b.data + offset_ - bytes;
+        }
+        current_++;
+        offset_ = 0;
+    }
+    size_t size = bytes + align > BLOCK_SIZE ? bytes + align : BLOCK_SIZE;
+    Block b = {new unsigned char[size], size};
+    blocks_.push_back(b);
+    current_ = blocks_.size() - 1;
+    offset_ = 0;
+    return allocate(bytes, align);
+}
+
+void Arena::reset() {
+    // spilled: one block big enough for all of it next time
+    if (blocks_.size() > 1) {
+        size_t total = capacity();
+        for (size_t i = 0; i < blocks_.size(); i++) delete [] blocks_[i].data;
+        blocks_.resize(1);
+        blocks_[0].data = new unsigned char[total];
+        blocks_[0].size = total;
+    }
+    current_ = 0;
+    offset_ = 0;
+    used_ = 0;
+}
+
+size_t Arena::used() const {
+    return used_;
+}
+
+size_t Arena::capacity() const {
+    size_t n = 0;
+    for (size_t i = 0; i < blocks_.size(); i++) n += blocks_[i].size;
+    return n;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+
+std::mutex FrameArena::mutex_;
+std::vector<Arena *> FrameArena::arenas_;
+
+Arena &FrameArena::local() {
+    // never freed: a worker may exit with its arena still registered
+    thread_local Arena *arena = NULL;
+    if (!arena) {
+        arena = new Arena();
+        std::lock_guard<std::mutex> lock(mutex_);
+        arenas_.push_back(arena);
+    }
+    return *arena;
+}
+
+void FrameArena::reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < arenas_.size(); i++) arenas_[i]->reset();
+}
+
+size_t FrameArena::capacity() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t n = 0;
+    for (size_t i = 0; i < arenas_.size(); i++) n += arenas_[i]->capacity();
+    return n;
+}
@@ -0,0 +1,86 @@
+#include <algorithm>
+#include <cstring>
+#include "../Include/frame_cache.h"
+
+unsigned long long hash_bytes(unsigned long long h, const void *data, size_t size) {
+    const unsigned char *p = (const unsigned char *)data;
+    for (size_t i=0; i<size; i++) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+FrameCache::FrameCache() : color_(), depth_(), valid_(false), opaque_key_(0), overlay_key_(0), overlay_bounds_(),
+                           frame_(NULL), zbuffer_(NULL), dirty_() {
+    memset(&stats_, 0, sizeof(stats_));
+}
+
+template<class T> static void copy_rect(ImageView<const T> src, ImageView<T> dst, const Rect &r) {
+    for (int y=r.y0; y<r.y1; y++)
+        memcpy(dst.row(y) + r.x0, src.row(y) + r.x0, sizeof(T)*r.width());
+}
+
+template<class T> static void clear(ImageView<T> img) {
+    for (int y=0; y<img.height(); y++)
+        memset(img.row(y), 0, sizeof(T)*img.width());
+}
+
+FrameCache::Redraw FrameCache::begin(unsigned long long opaque_key, unsigned long long overlay_key, const Rect &overlay_bounds,
+                                     ImageView<RGB8> frame, ImageView<Gray8> depth) {
+    Rect screen(0, 0, std::min(frame.width(), depth.width()), std::min(frame.height(), depth.height()));
+    bool same_target = frame.row(0)==frame_ && depth.row(0)==zbuffer_ &&
+                       screen.width()==color_.get_width() && screen.height()==color_.get_height();
+    Rect bounds = overlay_bounds.intersect(screen);
+
+    if (!valid_ || !same_target || opaque_key!=opaque_key_) {
+        valid_ = false;
+        opaque_key_ = opaque_key;
+        overlay_key_ = overlay_key;
+        overlay_bounds_ = bounds;
+        frame_ = frame.row(0);
+        zbuffer_ = depth.row(0);
+        dirty_ = screen;
+        clear(frame);
+        clear(depth);
+        stats_.full++;
+        return FULL;
+    }
+    if (overlay_key==overlay_key_ && bounds==overlay_bounds_) {
+        dirty_ = Rect();
+        stats_.unchanged++;
+        return NONE;
+    }
+    dirty_ = overlay_bounds_.unite(bounds);
+    copy_rect<RGB8>(color_.pixels<RGB8>(), frame, dirty_);
+    copy_rect<Gray8>(depth_.pixels<Gray8>(), depth, dirty_);
+    overlay_key_ = overlay_key;
+    overlay_bounds_ = bounds;
+    stats_.partial++;
+    stats_.restored_pixels += (unsigned long long)dirty_.width()*dirty_.height();
+    return PARTIAL;
+}
+
+const Rect &FrameCache::dirty() const {
+    return dirty_;
+}
+
+void FrameCache::store_opaque(ImageView<const RGB8> frame, ImageView<const Gray8> depth) {
+    int w = std::min(frame.width(), depth.width()), h = std::min(frame.height(), depth.height());
+    if (color_.get_width()!=w || color_.get_height()!=h) {
+        color_ = TGAImage(w, h, TGAImage::RGB);
+        depth_ = TGAImage(w, h, TGAImage::GRAYSCALE);
+    }
+    Rect screen(0, 0, w, h);
+    copy_rect<RGB8>(frame, color_.pixels<RGB8>(), screen);
+    copy_rect<Gray8>(depth, depth_.pixels<Gray8>(), screen);
+    valid_ = true;
+}
+
+void FrameCache::invalidate() {
+    valid_ = false;
+}
+
+FrameCache::Stats FrameCache::stats() const {
+    return stats_;
+}
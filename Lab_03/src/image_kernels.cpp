@@ -0,0 +1,425 @@
+#include <algorithm>
+#include <vector>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "../Include/image_kernels.h"
+#include "../Include/thread_pool.h"
+
+// The pshufb loops are built for SSSE3 only and chosen at run time, so a
+// plain x86-64 build still uses them on CPUs that have it
+#if defined(__SSSE3__)
+#define KERNELS_SSSE3
+#define SSSE3_TARGET
+static inline bool cpu_ssse3() { return true; }
+#elif defined(__SSE2__) && (defined(__GNUC__) || defined(__clang__))
+#define KERNELS_SSSE3
+#define SSSE3_TARGET __attribute__((target("ssse3")))
+static bool cpu_ssse3() {
+    static const bool has = __builtin_cpu_supports("ssse3");
+    return has;
+}
+#endif
+#ifdef KERNELS_SSSE3
+#include <tmmintrin.h>
+#endif
+
+// f(y0, y1) over row blocks, on the pool once the image is big enough to pay for it
+template<class F> static void for_rows(int height, long pixels, F &&f) {
+    ThreadPool &pool = ThreadPool::instance();
+    if (pixels<KERNEL_PARALLEL_PIXELS || pool.size()<2 || height<2) {
+        f(0, height);
+        return;
+    }
+    int blocks = std::min(height, pool.size()*4);
+    pool.parallel_for(blocks, [&](int i) {
+        f((int)((long)height*i/blocks), (int)((long)height*(i+1)/blocks));
+    });
+}
+
+// x/255 rounded to nearest, exact for 0 <= x <= 65535
+static inline int div255(int x) {
+    x += 128;
+    return (x + (x>>8)) >> 8;
+}
+
+#ifdef __SSE2__
+static inline __m128i div255_epu16(__m128i x) {
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+// alpha of each of the two pixels in x (8 x u16), copied to all four lanes of its pixel
+static inline __m128i broadcast_alpha(__m128i x) {
+    x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(3, 3, 3, 3));
+    return _mm_shufflehi_epi16(x, _MM_SHUFFLE(3, 3, 3, 3));
+}
+#endif
+
+static void swap_bytes(unsigned char *a, unsigned char *b, long n) {
+    long i = 0;
+#ifdef __SSE2__
+    for (; i+16<=n; i+=16) {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a+i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b+i));
+        _mm_storeu_si128((__m128i *)(a+i), vb);
+        _mm_storeu_si128((__m128i *)(b+i), va);
+    }
+#endif
+    for (; i<n; i++) std::swap(a[i], b[i]);
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+
+template<class T> void flip_vertical(ImageView<T> img) {
+    int half = img.height()/2;
+    long bytes = (long)img.width()*sizeof(T);
+    for_rows(half, (long)img.width()*img.height(), [&](int y0, int y1) {
+        for (int y=y0; y<y1; y++)
+            swap_bytes((unsigned char *)img.row(y), (unsigned char *)img.row(img.height()-1-y), bytes);
+    });
+}
+
+#ifdef KERNELS_SSSE3
+// swaps 16-byte blocks from both ends inwards; i and j end around the middle
+SSSE3_TARGET static void reverse_row_ssse3(Gray8 *row, int &i, int &j) {
+    const __m128i rev = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    for (; i+16<=j-16; i+=16, j-=16) {
+        __m128i l = _mm_loadu_si128((const __m128i *)(row+i));
+        __m128i r = _mm_loadu_si128((const __m128i *)(row+j-16));
+        _mm_storeu_si128((__m128i *)(row+i),    _mm_shuffle_epi8(r, rev));
+        _mm_storeu_si128((__m128i *)(row+j-16), _mm_shuffle_epi8(l, rev));
+    }
+}
+#endif
+
+static void reverse_row(Gray8 *row, int w) {
+    int i = 0, j = w;
+#ifdef KERNELS_SSSE3
+    if (cpu_ssse3()) reverse_row_ssse3(row, i, j);
+#endif
+    std::reverse(row+i, row+j);
+}
+
+static void reverse_row(RGB8 *row, int w) {
+    std::reverse(row, row+w);
+}
+
+static void reverse_row(RGBA8 *row, int w) {
+    int i = 0, j = w;
+#ifdef __SSE2__
+    for (; i+4<=j-4; i+=4, j-=4) {
+        __m128i l = _mm_loadu_si128((const __m128i *)(row+i));
+        __m128i r = _mm_loadu_si128((const __m128i *)(row+j-4));
+        _mm_storeu_si128((__m128i *)(row+i),   _mm_shuffle_epi32(r, _MM_SHUFFLE(0, 1, 2, 3)));
+        _mm_storeu_si128((__m128i *)(row+j-4), _mm_shuffle_epi32(l, _MM_SHUFFLE(0, 1, 2, 3)));
+    }
+#endif
+    std::reverse(row+i, row+j);
+}
+
+template<class T> void flip_horizontal(ImageView<T> img) {
+    for_rows(img.height(), (long)img.width()*img.height(), [&](int y0, int y1) {
+        for (int y=y0; y<y1; y++) reverse_row(img.row(y), img.width());
+    });
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+
+template<class T> void resize_nearest(ImageView<const T> src, ImageView<T> dst) {
+    if (src.empty() || dst.empty()) return;
+    std::vector<int> xmap(dst.width());
+    for (int x=0; x<dst.width(); x++) xmap[x] = (int)(((2L*x+1)*src.width())/(2L*dst.width()));
+    for_rows(dst.height(), (long)dst.width()*dst.height(), [&](int y0, int y1) {
+        for (int y=y0; y<y1; y++) {
+            const T *s = src.row((int)(((2L*y+1)*src.height())/(2L*dst.height())));
+            T *d = dst.row(y);
+            for (int x=0; x<dst.width(); x++) d[x] = s[xmap[x]];
+        }
+    });
+}
+
+template<class T> void resize_bilinear(ImageView<const T> src, ImageView<T> dst) {
+    if (src.empty() || dst.empty()) return;
+    const int N = sizeof(T);
+    // per destination column: left source column and its 8-bit weight
+    std::vector<int> x0(dst.width()), wx(dst.width());
+    for (int x=0; x<dst.width(); x++) {
+        float fx = std::max(0.f, (x+.5f)*src.width()/dst.width() - .5f);
+        x0[x] = std::min((int)fx, src.width()-1);
+        wx[x] = (int)((fx-x0[x])*256.f + .5f);
+    }
+    for_rows(dst.height(), (long)dst.width()*dst.height(), [&](int ya, int yb) {
+        for (int y=ya; y<yb; y++) {
+            float fy = std::max(0.f, (y+.5f)*src.height()/dst.height() - .5f);
+            int sy = std::min((int)fy, src.height()-1);
+            int wy = (int)((fy-sy)*256.f + .5f);
+            const unsigned char *r0 = (const unsigned char *)src.row(sy);
+            const unsigned char *r1 = (const unsigned char *)src.row(std::min(sy+1, src.height()-1));
+            unsigned char *d = (unsigned char *)dst.row(y);
+            for (int x=0; x<dst.width(); x++) {
+                int a = x0[x]*N, b = std::min(x0[x]+1, src.width()-1)*N;
+                for (int c=0; c<N; c++) {
+                    int top    = r0[a+c]*(256-wx[x]) + r0[b+c]*wx[x];
+                    int bottom = r1[a+c]*(256-wx[x]) + r1[b+c]*wx[x];
+                    d[x*N+c] = (unsigned char)((top*(256-wy) + bottom*wy + (1<<15)) >> 16);
+                }
+            }
+        }
+    });
+}
+
+template<class T> void downscale_box(ImageView<const T> src, ImageView<T> dst) {
+    if (src.empty() || dst.empty()) return;
+    const int N = sizeof(T);
+    for_rows(dst.height(), (long)dst.width()*dst.height(), [&](int ya, int yb) {
+        for (int y=ya; y<yb; y++) {
+            int sy0 = (int)((long)y*src.height()/dst.height());
+            int sy1 = std::max(sy0+1, (int)((long)(y+1)*src.height()/dst.height()));
+            unsigned char *d = (unsigned char *)dst.row(y);
+            for (int x=0; x<dst.width(); x++) {
+                int sx0 = (int)((long)x*src.width()/dst.width());
+                int sx1 = std::max(sx0+1, (int)((long)(x+1)*src.width()/dst.width()));
+                int sum[4] = {0, 0, 0, 0};
+                for (int sy=sy0; sy<sy1; sy++) {
+                    const unsigned char *s = (const unsigned char *)src.row(sy);
+                    for (int sx=sx0; sx<sx1; sx++)
+                        for (int c=0; c<N; c++) sum[c] += s[sx*N+c];
+                }
+                int count = (sx1-sx0)*(sy1-sy0);
+                for (int c=0; c<N; c++) d[x*N+c] = (unsigned char)((sum[c] + count/2)/count);
+            }
+        }
+    });
+}
+
+template void flip_vertical(ImageView<Gray8>);
+template void flip_vertical(ImageView<RGB8>);
+template void flip_vertical(ImageView<RGBA8>);
+template void flip_horizontal(ImageView<Gray8>);
+template void flip_horizontal(ImageView<RGB8>);
+template void flip_horizontal(ImageView<RGBA8>);
+template void resize_nearest(ImageView<const Gray8>, ImageView<Gray8>);
+template void resize_nearest(ImageView<const RGB8>,  ImageView<RGB8>);
+template void resize_nearest(ImageView<const RGBA8>, ImageView<RGBA8>);
+template void resize_bilinear(ImageView<const Gray8>, ImageView<Gray8>);
+template void resize_bilinear(ImageView<const RGB8>,  ImageView<RGB8>);
+template void resize_bilinear(ImageView<const RGBA8>, ImageView<RGBA8>);
+template void downscale_box(ImageView<const Gray8>, ImageView<Gray8>);
+template void downscale_box(ImageView<const RGB8>,  ImageView<RGB8>);
+template void downscale_box(ImageView<const RGBA8>, ImageView<RGBA8>);
+
+/////////////////////////////////////////////////////////////////////////////////
+
+#ifdef KERNELS_SSSE3
+// these return the first pixel they left to the scalar tail
+SSSE3_TARGET static int expand_row_ssse3(const RGB8 *s, RGBA8 *d, int w) {
+    const __m128i expand = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i alpha  = _mm_set1_epi32((int)0xff000000);
+    int x = 0;
+    // 16-byte load covers 4 pixels plus 4 spare bytes that must still be inside the row
+    for (; x+6<=w; x+=4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s+x));
+        _mm_storeu_si128((__m128i *)(d+x), _mm_or_si128(_mm_shuffle_epi8(v, expand), alpha));
+    }
+    return x;
+}
+
+SSSE3_TARGET static int pack_row_ssse3(const RGBA8 *s, RGB8 *d, int w) {
+    const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    int x = 0;
+    // the 16-byte store spills 4 bytes that the next step overwrites
+    for (; x+6<=w; x+=4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s+x));
+        _mm_storeu_si128((__m128i *)(d+x), _mm_shuffle_epi8(v, pack));
+    }
+    return x;
+}
+
+SSSE3_TARGET static int swap_red_blue_ssse3(RGBA8 *p, int w) {
+    const __m128i swap = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    int x = 0;
+    for (; x+4<=w; x+=4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p+x));
+        _mm_storeu_si128((__m128i *)(p+x), _mm_shuffle_epi8(v, swap));
+    }
+    return x;
+}
+#endif
+
+void convert(ImageView<const RGB8> src, ImageView<RGBA8> dst) {
+    int w = std::min(src.width(), dst.width());
+    int h = std::min(src.height(), dst.height());
+    for_rows(h, (long)w*h, [&](int y0, int y1) {
+        for (int y=y0; y<y1; y++) {
+            const RGB8 *s = src.row(y);
+            RGBA8 *d = dst.row(y);
+            int x = 0;
+#ifdef KERNELS_SSSE3
+            if (cpu_ssse3()) x = expand_row_ssse3(s, d, w);
+#endif
+            for (; x<w; x++) {
+                d[x].b = s[x].b;
+                d[x].g = s[x].g;
+                d[x].r = s[x].r;
+                d[x].a = 255;
+            }
+        }
+    });
+}
+
+void convert(ImageView<const RGBA8> src, ImageView<RGB8> dst) {
+    int w = std::min(src.width(), dst.width());
+    int h = std::min(src.height(), dst.height());
+    for_rows(h, (long)w*h, [&](int y0, int y1) {
+        for (int y=y0; y<y1; y++) {
+            const RGBA8 *s = src.row(y);
+            RGB8 *d = dst.row(y);
+            int x = 0;
+#ifdef KERNELS_SSSE3
+            if (cpu_ssse3()) x = pack_row_ssse3(s, d, w);
+#endif
+            for (; x<w; x++) {
+                d[x].b = s[x].b;
+                d[x].g = s[x].g;
+                d[x].r = s[x].r;
+            }
+        }
+    });
+}
+
+void convert(ImageView<const Gray8> src, ImageView<RGB8> dst) {
+    int w = std::min(src.width(), dst.width());
+    int h = std::min(src.height(), dst.height());
+    for_rows(h, (long)w*h, [&](int y0, int y1) {
+        for (int y=y0; y<y1; y++) {
+            const Gray8 *s = src.row(y);
+            RGB8 *d = dst.row(y);
+            for (int x=0; x<w; x++) d[x].b = d[x].g = d[x].r = s[x];
+        }
+    });
+}
+
+template<class P> static void to_luma(ImageView<const P> src, ImageView<Gray8> dst) {
+    int w = std::min(src.width(), dst.width());
+    int h = std::min(src.height(), dst.height());
+    for_rows(h, (long)w*h, [&](int y0, int y1) {
+        for (int y=y0; y<y1; y++) {
+            const P *s = src.row(y);
+            Gray8 *d = dst.row(y);
+            for (int x=0; x<w; x++) d[x] = (Gray8)((77*s[x].r + 150*s[x].g + 29*s[x].b + 128) >> 8);
+        }
+    });
+}
+
+void convert(ImageView<const RGB8> src, ImageView<Gray8> dst) {
+    to_luma(src, dst);
+}
+
+void convert(ImageView<const RGBA8> src, ImageView<Gray8> dst) {
+    to_luma(src, dst);
+}
+
+void swap_red_blue(ImageView<RGB8> img) {
+    for_rows(img.height(), (long)img.width()*img.height(), [&](int y0, int y1) {
+        for (int y=y0; y<y1; y++) {
+            RGB8 *p = img.row(y);
+            for (int x=0; x<img.width(); x++) std::swap(p[x].b, p[x].r);
+        }
+    });
+}
+
+void swap_red_blue(ImageView<RGBA8> img) {
+    for_rows(img.height(), (long)img.width()*img.height(), [&](int y0, int y1) {
+        for (int y=y0; y<y1; y++) {
+            RGBA8 *p = img.row(y);
+            int x = 0;
+#ifdef KERNELS_SSSE3
+            if (cpu_ssse3()) x = swap_red_blue_ssse3(p, img.width());
+#endif
+            for (; x<img.width(); x++) std::swap(p[x].b, p[x].r);
+        }
+    });
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+
+void premultiply(ImageView<RGBA8> img) {
+    for_rows(img.height(), (long)img.width()*img.height(), [&](int y0, int y1) {
+        for (int y=y0; y<y1; y++) {
+            RGBA8 *p = img.row(y);
+            int x = 0;
+#ifdef __SSE2__
+            const __m128i zero = _mm_setzero_si128();
+            // alpha lanes multiply by 255 so they come out unchanged
+            const __m128i keep_rgb = _mm_setr_epi16(-1, -1, -1, 0, -1, -1, -1, 0);
+            const __m128i full_a   = _mm_setr_epi16(0, 0, 0, 255, 0, 0, 0, 255);
+            for (; x+4<=img.width(); x+=4) {
+                __m128i v  = _mm_loadu_si128((const __m128i *)(p+x));
+                __m128i lo = _mm_unpacklo_epi8(v, zero);
+                __m128i hi = _mm_unpackhi_epi8(v, zero);
+                __m128i alo = _mm_or_si128(_mm_and_si128(broadcast_alpha(lo), keep_rgb), full_a);
+                __m128i ahi = _mm_or_si128(_mm_and_si128(broadcast_alpha(hi), keep_rgb), full_a);
+                lo = div255_epu16(_mm_mullo_epi16(lo, alo));
+                hi = div255_epu16(_mm_mullo_epi16(hi, ahi));
+                _mm_storeu_si128((__m128i *)(p+x), _mm_packus_epi16(lo, hi));
+            }
+#endif
+            for (; x<img.width(); x++) {
+                p[x].b = (unsigned char)div255(p[x].b*p[x].a);
+                p[x].g = (unsigned char)div255(p[x].g*p[x].a);
+                p[x].r = (unsigned char)div255(p[x].r*p[x].a);
+            }
+        }
+    });
+}
+
+void composite_over(ImageView<const RGBA8> src, ImageView<RGBA8> dst) {
+    int w = std::min(src.width(), dst.width());
+    int h = std::min(src.height(), dst.height());
+    for_rows(h, (long)w*h, [&](int y0, int y1) {
+        for (int y=y0; y<y1; y++) {
+            const RGBA8 *s = src.row(y);
+            RGBA8 *d = dst.row(y);
+            int x = 0;
+#ifdef __SSE2__
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i full = _mm_set1_epi16(255);
+            for (; x+4<=w; x+=4) {
+                __m128i vs = _mm_loadu_si128((const __m128i *)(s+x));
+                __m128i vd = _mm_loadu_si128((const __m128i *)(d+x));
+                __m128i ilo = _mm_sub_epi16(full, broadcast_alpha(_mm_unpacklo_epi8(vs, zero)));
+                __m128i ihi = _mm_sub_epi16(full, broadcast_alpha(_mm_unpackhi_epi8(vs, zero)));
+                __m128i lo = div255_epu16(_mm_mullo_epi16(_mm_unpacklo_epi8(vd, zero), ilo));
+                __m128i hi = div255_epu16(_mm_mullo_epi16(_mm_unpackhi_epi8(vd, zero), ihi));
+                _mm_storeu_si128((__m128i *)(d+x), _mm_adds_epu8(vs, _mm_packus_epi16(lo, hi)));
+            }
+#endif
+            for (; x<w; x++) {
+                int inv = 255-s[x].a;
+                d[x].b = (unsigned char)std::min(255, s[x].b + div255(d[x].b*inv));
+                d[x].g = (unsigned char)std::min(255, s[x].g + div255(d[x].g*inv));
+                d[x].r = (unsigned char)std::min(255, s[x].r + div255(d[x].r*inv));
+                d[x].a = (unsigned char)std::min(255, s[x].a + div255(d[x].a*inv));
+            }
+        }
+    });
+}
+
+void composite_over(ImageView<const RGBA8> src, ImageView<RGB8> dst) {
+    int w = std::min(src.width(), dst.width());
+    int h = std::min(src.height(), dst.height());
+    for_rows(h, (long)w*h, [&](int y0, int y1) {
+        for (int y=y0; y<y1; y++) {
+            const RGBA8 *s = src.row(y);
+            RGB8 *d = dst.row(y);
+            for (int x=0; x<w; x++) {
+                int inv = 255-s[x].a;
+                d[x].b = (unsigned char)std::min(255, s[x].b + div255(d[x].b*inv));
+                d[x].g = (unsigned char)std::min(255, s[x].g + div255(d[x].g*inv));
+                d[x].r = (unsigned char)std::min(255, s[x].r + div255(d[x].r*inv));
+            }
+        }
+    });
+}
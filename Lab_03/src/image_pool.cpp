@@ -0,0 +1,33 @@
+#include "../Include/image_pool.h"
+
+ImagePool &ImagePool::instance() {
+    static ImagePool pool;
+    return pool;
+}
+
+TGAImage ImagePool::acquire(int w, int h, int bytespp) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t i = 0; i < free_.size(); i++) {
+            if (free_[i].get_width() != w || free_[i].get_height() != h || free_[i].get_bytespp() != bytespp) continue;
+            TGAImage img(std::move(free_[i]));
+            free_[i] = std::move(free_.back());
+            free_.pop_back();
+            img.clear();
+            return img;
+        }
+    }
+    return TGAImage(w, h, bytespp);
+}
+
+void ImagePool::release(TGAImage &&img) {
+    if (!img.buffer()) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_.size() >= MAX_FREE) free_.erase(free_.begin()); // the oldest goes
+    free_.push_back(std::move(img));
+}
+
+void ImagePool::trim() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_.clear();
+}
@@ -0,0 +1,270 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <string.h>
+#include "../Include/image_writer.h"
+#include "../Include/tgaimage.h"
+#include "../Include/thread_pool.h"
+#include "../Include/trace.h"
+
+// frames below this many pixels are not worth a trip through the pool
+static const unsigned long STRIPE_MIN_PIXELS = 1<<18;
+static const int STRIPE_MIN_ROWS = 16;
+
+ImageWriter::~ImageWriter() {}
+
+void ImageWriter::header(const ConstImageView &, std::vector<unsigned char> &) const {}
+
+void ImageWriter::footer(const ConstImageView &, std::vector<unsigned char> &) const {}
+
+void ImageWriter::encode(const ConstImageView &img, std::vector<unsigned char> &out) const {
+    out.clear();
+    header(img, out);
+    ThreadPool &pool = ThreadPool::instance();
+    unsigned long npixels = (unsigned long)img.width*img.height;
+    if (pool.size()<2 || npixels<STRIPE_MIN_PIXELS) {
+        stripe(img, 0, img.height, out);
+    } else {
+        int nstripes = std::min(pool.size()*4, std::max(1, img.height/STRIPE_MIN_ROWS));
+        int rows = (img.height+nstripes-1)/nstripes;
+        nstripes = (img.height+rows-1)/rows;
+        std::vector<std::vector<unsigned char> > parts(nstripes);
+        pool.parallel_for(nstripes, [&](int i) {
+            TRACE_SCOPE("encode stripe", i);
+            stripe(img, i*rows, std::min(img.height, (i+1)*rows), parts[i]);
+        });
+        for (int i=0; i<nstripes; i++) out.insert(out.end(), parts[i].begin(), parts[i].end());
+    }
+    footer(img, out);
+}
+
+bool ImageWriter::write(const ConstImageView &img, const char *filename) const {
+    TRACE_SCOPE("encode image");
+    std::vector<unsigned char> file;
+    encode(img, file);
+    std::ofstream out;
+    out.open (filename, std::ios::binary);
+    if (!out.is_open()) {
+        std::cerr << "can't open file " << filename << "\n";
+        return false;
+    }
+    out.write((const char *)file.data(), file.size());
+    if (!out.good()) {
+        std::cerr << "can't dump the " << name() << " file\n";
+        out.close();
+        return false;
+    }
+    out.close();
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+
+class TGAWriter : public ImageWriter {
+    bool rle_;
+public:
+    TGAWriter(bool rle) : rle_(rle) {}
+    virtual const char *name() const { return rle_ ? "tga" : "tga-raw"; }
+    virtual const char *extension() const { return ".tga"; }
+    // RLE packets run across rows, so TGA stays a single serial stream
+    virtual void encode(const ConstImageView &img, std::vector<unsigned char> &out) const {
+        encode_tga(img, out, rle_);
+    }
+protected:
+    virtual void stripe(const ConstImageView &img, int y0, int y1, std::vector<unsigned char> &out) const {
+        out.insert(out.end(), img.row(y0), img.row(y1));
+    }
+};
+
+/////////////////////////////////////////////////////////////////////////////////
+
+// pixels in file order, no header; the caller knows the size and the BGR(A) layout
+class RawWriter : public ImageWriter {
+public:
+    virtual const char *name() const { return "raw"; }
+    virtual const char *extension() const { return ".raw"; }
+protected:
+    virtual void stripe(const ConstImageView &img, int y0, int y1, std::vector<unsigned char> &out) const {
+        out.insert(out.end(), img.row(y0), img.row(y1));
+    }
+};
+
+/////////////////////////////////////////////////////////////////////////////////
+
+// binary PPM (P6) for colour, PGM (P5) for grayscale; alpha is dropped
+class PPMWriter : public ImageWriter {
+public:
+    virtual const char *name() const { return "ppm"; }
+    virtual const char *extension() const { return ".ppm"; }
+protected:
+    virtual void header(const ConstImageView &img, std::vector<unsigned char> &out) const {
+        std::string h = std::string(1==img.bytespp ? "P5\n" : "P6\n") + std::to_string(img.width) + " " +
+                        std::to_string(img.height) + "\n255\n";
+        out.insert(out.end(), h.begin(), h.end());
+    }
+    virtual void stripe(const ConstImageView &img, int y0, int y1, std::vector<unsigned char> &out) const {
+        if (1==img.bytespp) {
+            out.insert(out.end(), img.row(y0), img.row(y1));
+            return;
+        }
+        size_t start = out.size();
+        out.resize(start + (size_t)(y1-y0)*img.width*3);
+        unsigned char *dst = &out[start];
+        for (int y=y0; y<y1; y++) {
+            const unsigned char *src = img.row(y);
+            for (int x=0; x<img.width; x++, src+=img.bytespp, dst+=3) {
+                dst[0] = src[2];
+                dst[1] = src[1];
+                dst[2] = src[0];
+            }
+        }
+    }
+};
+
+/////////////////////////////////////////////////////////////////////////////////
+
+// QOI, https://qoiformat.org/qoi-specification.pdf
+// A stripe starts from the last pixel of the stripe above as its "previous" pixel
+// and with an empty colour index; it only emits QOI_OP_INDEX for slots it filled
+// itself, which always agree with the decoder's index, so the stripes concatenate
+// into one valid stream.
+class QOIWriter : public ImageWriter {
+    struct Pixel {
+        unsigned char r, g, b, a;
+        bool operator==(const Pixel &o) const { return r==o.r && g==o.g && b==o.b && a==o.a; }
+    };
+
+    static Pixel pixel(const ConstImageView &img, int x, int y) {
+        const unsigned char *p = img.row(y) + x*img.bytespp;
+        Pixel px;
+        if (1==img.bytespp) {
+            px.r = px.g = px.b = p[0];
+            px.a = 255;
+        } else {
+            px.b = p[0];
+            px.g = p[1];
+            px.r = p[2];
+            px.a = (4==img.bytespp ? p[3] : 255);
+        }
+        return px;
+    }
+
+    static void put32(std::vector<unsigned char> &out, unsigned int v) {
+        for (int k=3; k>=0; k--) out.push_back((unsigned char)(v >> (8*k)));
+    }
+
+public:
+    virtual const char *name() const { return "qoi"; }
+    virtual const char *extension() const { return ".qoi"; }
+protected:
+    virtual void header(const ConstImageView &img, std::vector<unsigned char> &out) const {
+        const char magic[4] = {'q', 'o', 'i', 'f'};
+        out.insert(out.end(), magic, magic+4);
+        put32(out, img.width);
+        put32(out, img.height);
+        out.push_back(4==img.bytespp ? 4 : 3);
+        out.push_back(0); // sRGB with linear alpha
+    }
+
+    virtual void footer(const ConstImageView &, std::vector<unsigned char> &out) const {
+        const unsigned char end[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+        out.insert(out.end(), end, end+8);
+    }
+
+    virtual void stripe(const ConstImageView &img, int y0, int y1, std::vector<unsigned char> &out) const {
+        Pixel index[64];
+        bool known[64];
+        memset(index, 0, sizeof(index));
+        memset(known, 0, sizeof(known));
+        Pixel prev = {0, 0, 0, 255};
+        if (y0>0) {
+            prev = pixel(img, img.width-1, y0-1);
+        } else {
+            for (int i=0; i<64; i++) known[i] = true; // the decoder's index starts zeroed
+        }
+        out.reserve(out.size() + (size_t)(y1-y0)*img.width*2);
+        int run = 0;
+        for (int y=y0; y<y1; y++) {
+            for (int x=0; x<img.width; x++) {
+                Pixel px = pixel(img, x, y);
+                if (px==prev) {
+                    if (++run==62) {
+                        out.push_back(0xc0 | (run-1));
+                        run = 0;
+                    }
+                    continue;
+                }
+                if (run>0) {
+                    out.push_back(0xc0 | (run-1));
+                    run = 0;
+                }
+                int h = (px.r*3 + px.g*5 + px.b*7 + px.a*11) & 63;
+                if (known[h] && index[h]==px) {
+                    out.push_back((unsigned char)h);
+                } else {
+                    index[h] = px;
+                    known[h] = true;
+                    if (px.a==prev.a) {
+                        signed char vr = (signed char)(px.r-prev.r);
+                        signed char vg = (signed char)(px.g-prev.g);
+                        signed char vb = (signed char)(px.b-prev.b);
+                        signed char vg_r = (signed char)(vr-vg);
+                        signed char vg_b = (signed char)(vb-vg);
+                        if (vr>-3 && vr<2 && vg>-3 && vg<2 && vb>-3 && vb<2) {
+                            out.push_back((unsigned char)(0x40 | (vr+2)<<4 | (vg+2)<<2 | (vb+2)));
+                        } else if (vg_r>-9 && vg_r<8 && vg>-33 && vg<32 && vg_b>-9 && vg_b<8) {
+                            out.push_back((unsigned char)(0x80 | (vg+32)));
+                            out.push_back((unsigned char)((vg_r+8)<<4 | (vg_b+8)));
+                        } else {
+                            out.push_back(0xfe);
+                            out.push_back(px.r);
+                            out.push_back(px.g);
+                            out.push_back(px.b);
+                        }
+                    } else {
+                        out.push_back(0xff);
+                        out.push_back(px.r);
+                        out.push_back(px.g);
+                        out.push_back(px.b);
+                        out.push_back(px.a);
+                    }
+                }
+                prev = px;
+            }
+        }
+        if (run>0) out.push_back(0xc0 | (run-1));
+    }
+};
+
+/////////////////////////////////////////////////////////////////////////////////
+
+const ImageWriter *image_writer(const char *format) {
+    static const TGAWriter tga(true), tga_raw(false);
+    static const QOIWriter qoi;
+    static const PPMWriter ppm;
+    static const RawWriter raw;
+    static const ImageWriter *writers[] = {&tga, &tga_raw, &qoi, &ppm, &raw};
+    if (!format) return &tga;
+    for (size_t i=0; i<sizeof(writers)/sizeof(writers[0]); i++)
+        if (!strcmp(writers[i]->name(), format)) return writers[i];
+    return NULL;
+}
+
+const ImageWriter *image_writer_for(const char *filename) {
+    const char *dot = strrchr(filename, '.');
+    if (!dot) return NULL;
+    std::string ext(dot+1);
+    for (size_t i=0; i<ext.size(); i++) ext[i] = (char)tolower(ext[i]);
+    if ("pgm"==ext || "pnm"==ext) ext = "ppm";
+    if ("bin"==ext) ext = "raw";
+    return image_writer(ext.c_str());
+}
+
+bool write_image(const ConstImageView &img, const char *filename, const char *format) {
+    const ImageWriter *w = format ? image_writer(format) : image_writer_for(filename);
+    if (!w) {
+        std::cerr << "unknown image format for " << filename << "\n";
+        return false;
+    }
+    return w->write(img, filename);
+}
@@ -0,0 +1,159 @@
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include "../Include/lights.h"
+#include "../Include/our_gl.h"
+#include "../Include/thread_pool.h"
+#include "../Include/frame_arena.h"
+
+Light Light::point(Vec3f position, Vec3f color, float radius) {
+    Light l;
+    l.type = POINT;
+    l.position = position;
+    l.direction = Vec3f(0, 0, -1);
+    l.color = color;
+    l.radius = radius;
+    l.cos_inner = -1.f;
+    l.cos_outer = -1.f;
+    return l;
+}
+
+Light Light::spot(Vec3f position, Vec3f direction, Vec3f color, float radius, float inner_deg, float outer_deg) {
+    Light l = point(position, color, radius);
+    l.type = SPOT;
+    l.direction = direction.normalize();
+    l.cos_inner = std::cos(inner_deg*(float)M_PI/180.f);
+    l.cos_outer = std::cos(outer_deg*(float)M_PI/180.f);
+    return l;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+
+LightGrid::LightGrid() : width_(0), height_(0), tiles_x_(0), tiles_y_(0), eye_(), zmin_(), zmax_(), offsets_(1, 0), indices_() {}
+
+void LightGrid::clear() {
+    eye_.clear();
+    indices_.clear();
+    std::fill(offsets_.begin(), offsets_.end(), 0);
+}
+
+// Screen rectangle and depth range (in z-buffer units, bigger is nearer) of a
+// light's sphere, from the 8 corners of its eye-space bounding box. A box that
+// reaches behind the camera covers everything.
+static void light_bounds(const Light &l, const Matrix &to_screen, int width, int height, Rect &rect, float &dlo, float &dhi) {
+    float xmin = std::numeric_limits<float>::max(), ymin = xmin, zmin = xmin;
+    float xmax = -xmin, ymax = -xmin, zmax = -xmin;
+    for (int k=0; k<8; k++) {
+        Vec3f c(l.position.x + (k&1 ? l.radius : -l.radius),
+                l.position.y + (k&2 ? l.radius : -l.radius),
+                l.position.z + (k&4 ? l.radius : -l.radius));
+        Vec4f s = to_screen*embed<4>(c);
+        if (s[3] < 1e-4f) {
+            rect = Rect(0, 0, width, height);
+            dlo = -std::numeric_limits<float>::max();
+            dhi = std::numeric_limits<float>::max();
+            return;
+        }
+        xmin = std::min(xmin, s[0]/s[3]); xmax = std::max(xmax, s[0]/s[3]);
+        ymin = std::min(ymin, s[1]/s[3]); ymax = std::max(ymax, s[1]/s[3]);
+        zmin = std::min(zmin, s[2]/s[3]); zmax = std::max(zmax, s[2]/s[3]);
+    }
+    // a pixel away and a depth step either side: the shader interpolates
+    // positions linearly in screen space, the z-buffer is rounded
+    rect = Rect((int)std::floor(xmin) - 1, (int)std::floor(ymin) - 1, (int)xmax + 2, (int)ymax + 2).intersect(Rect(0, 0, width, height));
+    dlo = zmin - 1.f;
+    dhi = zmax + 1.f;
+}
+
+void LightGrid::build(const std::vector<Light> &lights, ImageView<const Gray8> depth, bool cull) {
+    width_ = depth.width();
+    height_ = depth.height();
+    tiles_x_ = (width_+TILE-1)/TILE;
+    tiles_y_ = (height_+TILE-1)/TILE;
+    int ntiles = tiles_x_*tiles_y_;
+
+    eye_.resize(lights.size());
+    for (size_t i=0; i<lights.size(); i++) {
+        eye_[i] = lights[i];
+        eye_[i].position = proj<3>(ModelView*embed<4>(lights[i].position));
+        eye_[i].direction = proj<3>(ModelView*embed<4>(lights[i].direction, 0.f)).normalize();
+    }
+
+    // depth range of the covered pixels of every tile
+    zmin_.assign(ntiles, -1);
+    zmax_.assign(ntiles, -1);
+    ThreadPool::instance().parallel_for(tiles_y_, [&](int ty) {
+        for (int tx=0; tx<tiles_x_; tx++) {
+            int lo = 256, hi = -1;
+            for (int y=ty*TILE; y<std::min(height_, (ty+1)*TILE); y++) {
+                const Gray8 *row = depth.row(y);
+                for (int x=tx*TILE; x<std::min(width_, (tx+1)*TILE); x++) {
+                    if (!row[x]) continue; // background
+                    lo = std::min(lo, (int)row[x]);
+                    hi = std::max(hi, (int)row[x]);
+                }
+            }
+            if (hi >= 0) {
+                zmin_[ty*tiles_x_+tx] = lo;
+                zmax_[ty*tiles_x_+tx] = hi;
+            }
+        }
+    });
+
+    // two passes over the lights: count per tile, then fill. Lists stay in light order
+    Matrix to_screen = Viewport*Projection;
+    Arena &arena = FrameArena::local();
+    Span<Rect> rects = arena.array<Rect>((int)eye_.size());
+    Span<float> dlo = arena.array<float>((int)eye_.size()), dhi = arena.array<float>((int)eye_.size());
+    for (size_t i=0; i<eye_.size(); i++) {
+        if (cull) {
+            light_bounds(eye_[i], to_screen, width_, height_, rects[i], dlo[i], dhi[i]);
+        } else {
+            rects[i] = Rect(0, 0, width_, height_);
+            dlo[i] = -std::numeric_limits<float>::max();
+            dhi[i] = std::numeric_limits<float>::max();
+        }
+    }
+    offsets_.assign(ntiles+1, 0);
+    Span<int> fill = arena.array<int>(ntiles);
+    for (int pass=0; pass<2; pass++) {
+        if (pass==1) {
+            for (int t=0; t<ntiles; t++) offsets_[t+1] += offsets_[t];
+            indices_.resize(offsets_[ntiles]);
+        }
+        std::copy(offsets_.begin(), offsets_.end()-1, fill.begin());
+        for (size_t i=0; i<eye_.size(); i++) {
+            if (rects[i].empty()) continue;
+            for (int ty=rects[i].y0/TILE; ty<=(rects[i].y1-1)/TILE; ty++)
+                for (int tx=rects[i].x0/TILE; tx<=(rects[i].x1-1)/TILE; tx++) {
+                    int t = ty*tiles_x_+tx;
+                    if (zmax_[t] < 0 || dhi[i] < zmin_[t] || dlo[i] > zmax_[t]) continue;
+                    if (pass==0) offsets_[t+1]++;
+                    else indices_[fill[t]++] = (int)i;
+                }
+        }
+    }
+}
+
+int LightGrid::size() const {
+    return (int)eye_.size();
+}
+
+const Light &LightGrid::light(int i) const {
+    return eye_[i];
+}
+
+Span<const int> LightGrid::lights(int x, int y) const {
+    int t = (y/TILE)*tiles_x_ + x/TILE;
+    Span<const int> s = {indices_.data() + offsets_[t], indices_.data() + offsets_[t+1]};
+    return s;
+}
+
+LightGrid::Stats LightGrid::stats() const {
+    Stats s = {(int)eye_.size(), 0, (long)indices_.size(), 0};
+    for (size_t t=0; t<zmax_.size(); t++) {
+        if (zmax_[t] >= 0) s.tiles++;
+        s.max_per_tile = std::max(s.max_per_tile, offsets_[t+1]-offsets_[t]);
+    }
+    return s;
+}
@@ -1,18 +1,38 @@
 #include <vector>
 #include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <chrono>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+#include <limits>
 
 #include "../Include/tgaimage.h"
 #include "../Include/mesh.h"
 #include "../Include/math.h"
 #include "../Include/our_gl.h"
 #include "../Include/camera.h"
+#include "../Include/image_writer.h"
+#include "../Include/texture_cache.h"
+#include "../Include/postprocess.h"
+#include "../Include/frame_cache.h"
+#include "../Include/multiview.h"
+#include "../Include/scene.h"
+#include "../Include/pipeline_stats.h"
+#include "../Include/trace.h"
+#include "../Include/presenter.h"
+#include "../Include/frame_arena.h"
+#include "../Include/image_pool.h"
+#include "../Include/alloc_hook.h"
+#include "../../Lab_04/FrameScheduler.h"
+#include "../../Lab_04/InputReplay.h"
 
-Model *model     = NULL;
 const int width  = 800;
 const int height = 800;
 
-Vec3f light_dir(1,1,1);
-
 Camera cam(
     /* eye    */ Vec3f(2, 2, 10),
     /* center */ Vec3f(0, 0, 0),
@@ -35,81 +55,6 @@ int cube_faces[12][3] = {
     {0,3,7}, {0,7,4}  // левая грань
 };
 
-struct Shader : public IShader {
-    mat<3,3,float> varying_norm; // нормали по вершинам
-    mat<3,3,float> varying_pos;  // позиции по вершинам
-    mat<2,3,float> varying_uv;   // uv по вершинам
-
-
-    virtual Vec4f vertex(int iface, int nthvert) {
-        // UV
-        varying_uv.set_col(nthvert, model->uv(iface, nthvert));
-        // вершина из модели
-        Vec4f gl_Vertex = embed<4>(model->vert(iface, nthvert));
-
-        Vec4f pos_eye4 = ModelView * gl_Vertex;
-        Vec3f pos_eye = proj<3>(pos_eye4);
-        varying_pos.set_col(nthvert, pos_eye);
-
-        Vec4f n4 = embed<4>(model->normal(iface, nthvert), 0.0f);
-        Vec3f n_eye = proj<3>(ModelView * n4).normalize();
-        varying_norm.set_col(nthvert, n_eye);
-
-        return Viewport * Projection * ModelView * gl_Vertex;
-    }
-
-    // fragment: интерполируем нормаль/позицию/uv и считаем Phong
-    virtual bool fragment(Vec3f bar, TGAColor &color) {
-        // --- интерполяция ---
-        Vec2f interp_uv = varying_uv * bar;
-        Vec3f interp_pos = varying_pos * bar;
-        Vec3f interp_norm = (varying_norm * bar).normalize();
-
-        // нормализованный вектор света
-        Vec3f light_dir_eye = proj<3>(ModelView * embed<4>(::light_dir, 0.0f)).normalize();
-
-        // view vector
-        Vec3f view_dir = (Vec3f(0,0,0) - interp_pos).normalize();
-
-        const float ambient_strength = 0.1f;
-
-        // diffuse
-        float diff = std::max(0.f, interp_norm * light_dir_eye);
-
-        // specular (Phong)
-        // R = reflect(-L, N) = 2*(N·L)*N - L
-        Vec3f R = interp_norm * (2.f * (interp_norm * light_dir_eye)) - light_dir_eye;
-        float spec_angle = std::max(0.f, R * view_dir);
-
-        float spec_map = model->specular(Vec2f(interp_uv[0], interp_uv[1]));
-
-        if (spec_map < 1e-6f) spec_map = 16.f;
-        float shininess = spec_map;
-        float spec = std::pow(spec_angle, shininess);
-
-        // получаем base diffuse color из текстуры
-        Vec2f uv = Vec2f(interp_uv[0], interp_uv[1]);
-        TGAColor tex = model->diffuse(uv);
-        Vec3f tex_rgb = Vec3f((float)tex[2], (float)tex[1], (float)tex[0]);
-
-        Vec3f ambient = tex_rgb * ambient_strength;
-        Vec3f diffuse = tex_rgb * diff;
-        Vec3f specular = Vec3f(255.f,255.f,255.f) * spec * 0.5f;
-
-        Vec3f result = ambient + diffuse + specular;
-
-        for (int i=0;i<3;i++) {
-            if (result[i] > 255.f) result[i] = 255.f;
-            if (result[i] < 0.f)   result[i] = 0.f;
-        }
-        color[0] = (unsigned char)result[2]; // B
-        color[1] = (unsigned char)result[1]; // G
-        color[2] = (unsigned char)result[0]; // R
-        color[3] = 255; // A
-
-        return false;
-    }
-};
 struct CubeShader : public IShader {
     CubeShader(const TGAColor &c, float a) {
         base_color = c;
@@ -130,43 +75,560 @@ struct CubeShader : public IShader {
     }
 };
 
+// текущие ModelView/Projection/Viewport камеры
+View capture_view(const Camera &c) {
+    c.applyView();
+    c.applyProjection(width, height);
+    View v = {ModelView, Projection, Viewport};
+    return v;
+}
+
+// n камер по кругу вокруг головы, на высоте и расстоянии основной
+std::vector<View> orbit_views(int n) {
+    std::vector<View> views;
+    float r = std::sqrt(cam.eye.x*cam.eye.x + cam.eye.z*cam.eye.z);
+    float a0 = std::atan2(cam.eye.x, cam.eye.z);
+    for (int i = 0; i < n; i++) {
+        float a = a0 + 2.f*(float)M_PI*i/n;
+        views.push_back(capture_view(Camera(Vec3f(r*std::sin(a), cam.eye.y, r*std::cos(a)), cam.center, cam.up)));
+    }
+    return views;
+}
+
+// Все виды за один проход: вершины и нормали считаются сразу для всех камер
+// (MultiViewTransform), грани раскладываются по полосам каждого вида, а полосы
+// всех видов - одна очередь задач на пуле. Локальные источники не участвуют.
+void render_views(const std::vector<View> &views, std::vector<TGAImage> &frames, std::vector<TGAImage> &depths) {
+    MultiViewTransform transform;
+    transform.transform(*model, views);
+    std::vector<std::vector<PreparedFace> > faces(views.size());
+    std::vector<TileBins> bins(views.size());
+    for (size_t v = 0; v < views.size(); v++) {
+        Rect screen(0, 0, frames[v].get_width(), frames[v].get_height());
+        bins[v].reset(screen.width(), screen.height());
+        faces[v].reserve(model->nfaces());
+        for (int i = 0; i < model->nfaces(); i++) {
+            PreparedFace face;
+            for (int j = 0; j < 3; j++) {
+                Vec3i c = model->corner(i, j);
+                face.pts[j] = transform.clip((int)v, c[0]);
+                face.pos.set_col(j, transform.eye((int)v, c[0]));
+                face.norm.set_col(j, transform.normal((int)v, c[2]));
+                face.uv.set_col(j, model->uv(i, j));
+            }
+            Rect bounds = triangle_bounds(face.pts).intersect(screen);
+            if (bounds.empty()) continue;
+            bins[v].add((int)faces[v].size(), bounds);
+            faces[v].push_back(face);
+        }
+    }
+    int bands = bins[0].bands();
+    ThreadPool::instance().parallel_for((int)views.size()*bands, [&](int task) {
+        int v = task / bands, b = task % bands;
+        Shader local;
+        local.local_lights = false;
+        local.light_dir_eye = Shader::eye_light(views[v].model_view);
+        const std::vector<int> &tris = bins[v].triangles(b);
+        for (size_t t = 0; t < tris.size(); t++) {
+            PreparedFace &face = faces[v][tris[t]];
+            local.restore(face);
+            triangle(face.pts, local, frames[v].pixels<RGB8>(), depths[v].pixels<Gray8>(), bins[v].band(b));
+        }
+    });
+}
+
+// куб: alpha blending в порядке граней или weighted blended OIT
+void render_cube(Vec4f cube[12][3], const CubeShader &cubeshader, ImageView<RGB8> frame, ImageView<Gray8> depth,
+                 const Rect &dirty, OITBuffer *oit, TileBins &bins) {
+    bins.reset(frame.width(), frame.height());
+    for (int i = 0; i < 12; i++)
+        bins.add(i, triangle_bounds(cube[i]).intersect(dirty));
+    if (oit) oit->clear(dirty);
+    STATS_RASTERIZED(rasterized, 12);
+    draw_bands(bins, [&](const Rect &band, const std::vector<int> &tris) {
+        TRACE_SCOPE("blend band", band.y0/TileBins::BAND_ROWS);
+        CubeShader local = cubeshader;
+        Rect scissor = band.intersect(dirty);
+        for (size_t t = 0; t < tris.size(); t++) {
+            if (oit) STATS_TRIANGLE(rasterized, tris[t], triangle(cube[tris[t]], local, *oit, depth, scissor));
+            else     STATS_TRIANGLE(rasterized, tris[t], triangle(cube[tris[t]], local, frame, depth, scissor));
+        }
+    });
+    if (oit) oit->resolve(frame, dirty);
+}
+
+// всё, от чего зависит непрозрачный проход
+unsigned long long opaque_key(bool complete) {
+    unsigned long long h = hash_value(HASH_SEED, model);
+    h = hash_value(h, ModelView);
+    h = hash_value(h, Projection);
+    h = hash_value(h, Viewport);
+    h = hash_value(h, light_dir);
+    h = hash_bytes(h, Lights.data(), Lights.size()*sizeof(Light));
+    h = hash_value(h, shading_rate);
+    return hash_value(h, complete);
+}
+
+// PSNR кадра против эталона по пикселям головы (ненулевая глубина эталона), дБ
+double head_psnr(const TGAImage &test, const TGAImage &reference, const TGAImage &reference_depth) {
+    ImageView<const RGB8> a = test.pixels<RGB8>(), b = reference.pixels<RGB8>();
+    ImageView<const Gray8> mask = reference_depth.pixels<Gray8>();
+    double sum = 0.;
+    long n = 0;
+    for (int y = 0; y < b.height(); y++)
+        for (int x = 0; x < b.width(); x++) {
+            if (!mask(x, y)) continue;
+            int d[3] = {a(x, y).b - b(x, y).b, a(x, y).g - b(x, y).g, a(x, y).r - b(x, y).r};
+            sum += d[0]*d[0] + d[1]*d[1] + d[2]*d[2];
+            n += 3;
+        }
+    if (!n || sum == 0.) return std::numeric_limits<double>::infinity();
+    return 10.*std::log10(255.*255./(sum/n));
+}
+
+// медиана времени reps кадров головы с данным shading rate; последний кадр остаётся в image
+double time_opaque(int rate, int reps, TGAImage &image, TGAImage &zbuffer, TileBins &bins) {
+    shading_rate = rate;
+    std::vector<double> ms;
+    for (int i = 0; i < reps; i++) {
+        FrameArena::reset();
+        image.clear();
+        zbuffer.clear();
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        render_opaque(image.pixels<RGB8>(), zbuffer.pixels<Gray8>(), bins, std::function<void(int, TGAImage &, TGAImage &)>());
+        ms.push_back(elapsed_ms(t0));
+    }
+    std::sort(ms.begin(), ms.end());
+    return ms[ms.size()/2];
+}
+
+// Интерактивный режим: камера по орбите вокруг головы, управляется событиями
+// Lab_04 (мышь, стрелки, колесо) из окна или записи. Симуляция с фиксированным
+// шагом, кадр рисуется в свободный буфер презентера и отдаётся без копирования,
+// пока предыдущий ещё показывается. Задержка - от самого старого события,
+// вошедшего в кадр, до конца показа.
+int run_interactive(int frames, const std::string &target, const char *input, int buffers) {
+    model->require(Model::DIFFUSE);
+    model->require(Model::SPECULAR);
+    std::unique_ptr<InputRing> ring(new InputRing());
+    std::unique_ptr<Presenter> presenter;
+    if (target == "window") {
+        // у кольца один писатель: при воспроизведении записи окно событий не шлёт
+        presenter.reset(create_gdi_presenter(width, height, buffers, input ? NULL : ring.get()));
+        if (!presenter) {
+            std::cerr << "no window presenter on this platform" << std::endl;
+            return 1;
+        }
+    } else {
+        HeadlessPresenter *headless = new HeadlessPresenter(width, height, buffers, target);
+        presenter.reset(headless);
+        if (!headless->ok()) {
+            std::cerr << "can't open " << target << " (file patterns need exactly one %d, e.g. frame_%04d.tga)" << std::endl;
+            return 1;
+        }
+    }
+    InputReplay replay(*ring);
+    if (input) {
+        std::vector<InputEvent> events;
+        if (!LoadInputEvents(input, events)) {
+            std::cerr << "can't read " << input << std::endl;
+            return 1;
+        }
+        replay.Start(std::move(events), true);
+    }
+
+    float distance = (cam.eye - cam.center).norm();
+    float yaw = std::atan2(cam.eye.x, cam.eye.z);
+    float pitch = std::asin(cam.eye.y/distance);
+    float previous[3] = {yaw, pitch, distance};
+    bool keys[4] = {false, false, false, false}; // VK_LEFT, VK_UP, VK_RIGHT, VK_DOWN
+    unsigned long long oldest_input = 0;         // ещё не показанное событие
+    long events = 0;
+
+    SteadyFrameClock clock;
+    FrameSchedulerConfig config;
+    config.renderHz = 0; // рисуем, сколько успеваем; ограничивает acquire()
+    FrameScheduler scheduler(clock, config);
+    scheduler.SetSimulate([&](double dt) {
+        previous[0] = yaw; previous[1] = pitch; previous[2] = distance;
+        ring->Drain([&](const InputEvent &e) {
+            if (!oldest_input) oldest_input = e.time;
+            events++;
+            if (e.type == InputEventType::MouseDelta) {
+                yaw -= e.x*.005f;
+                pitch += e.y*.005f;
+            } else if (e.type == InputEventType::MouseWheel) {
+                distance *= std::pow(.9f, e.y/120.f);
+            } else if ((e.type == InputEventType::KeyDown || e.type == InputEventType::KeyUp) &&
+                       e.code >= 0x25 && e.code <= 0x28) {
+                keys[e.code - 0x25] = e.type == InputEventType::KeyDown;
+            }
+        });
+        yaw += (float)dt*((keys[2] ? 1.f : 0.f) - (keys[0] ? 1.f : 0.f));
+        pitch += (float)dt*((keys[1] ? 1.f : 0.f) - (keys[3] ? 1.f : 0.f));
+        pitch = std::max(-1.5f, std::min(1.5f, pitch));
+        distance = std::max(2.f, std::min(50.f, distance));
+    });
+    TileBins bins;
+    TGAImage zbuffer(width, height, TGAImage::GRAYSCALE);
+    scheduler.SetRender([&](double alpha) {
+        TRACE_SCOPE("frame");
+        FrameArena::reset();
+        float a = (float)alpha;
+        float y = previous[0] + (yaw - previous[0])*a;
+        float p = previous[1] + (pitch - previous[1])*a;
+        float d = previous[2] + (distance - previous[2])*a;
+        Camera view(cam.center + Vec3f(std::sin(y)*std::cos(p), std::sin(p), std::cos(y)*std::cos(p))*d, cam.center, cam.up);
+        capture_view(view);
+        TGAImage &image = presenter->acquire();
+        image.clear();
+        zbuffer.clear();
+        render_opaque(image.pixels<RGB8>(), zbuffer.pixels<Gray8>(), bins, std::function<void(int, TGAImage &, TGAImage &)>());
+        presenter->present(oldest_input);
+        oldest_input = 0;
+    });
+    scheduler.SetPump([&](unsigned long long until) {
+        clock.SleepUntil(until);
+        return !presenter->closed() && !(input && replay.Finished() && ring->SizeApprox() == 0 && frames <= 0);
+    });
+    scheduler.Run(frames > 0 ? frames : 0);
+    presenter->flush();
+    replay.Join();
+
+    FrameStats fs = scheduler.Stats();
+    Presenter::Stats ps = presenter->stats();
+    std::cerr << ps.presented << " frames presented, " << events << " input events, " << buffers << " buffers" << std::endl;
+    std::cerr << "frame work p50 " << fs.workP50Ms << " ms, p99 " << fs.workP99Ms << " ms; present interval p50 "
+              << ps.interval_p50_ms << " ms, p99 " << ps.interval_p99_ms << " ms" << std::endl;
+    std::cerr << "input to present p50 " << ps.latency_p50_ms << " ms, p99 " << ps.latency_p99_ms << " ms; renderer waited "
+              << ps.wait_ms << " ms for buffers" << std::endl;
+    return 0;
+}
+
 int main(int argc, char** argv) {
-    if (2==argc) {
-        model = new Model(argv[1]);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const char *obj = "../obj/african_head.obj";
+    const char *format = "tga";
+    bool compressed = false;
+    Texture::Filter filter = Texture::TRILINEAR;
+    bool serial = false;
+    std::string post; // пусто - без постобработки
+    int frames = 1;
+    bool frame_cache = true;
+    bool oit_mode = false;
+    int nlights = 0;
+    bool progressive = false;
+    int nviews = 0;
+    int interactive = -1; // кадров, 0 - пока не закроют окно или не кончится запись
+    std::string present;  // "", window, shm:/name или шаблон файла
+    const char *input = NULL;
+    int buffers = 2;
+    const char *stats_json = NULL; // счётчики конвейера по кадрам, только со сборкой RENDERER_STATS
+    bool heatmaps = false;         // overdraw и shading_cost рядом с output
+    const char *trace = getenv("RENDERER_TRACE"); // таймлайн потоков для chrome://tracing / Perfetto
+    bool check_allocs = false;     // кадры после прогрева не должны выделять память
+    bool rate_report = false;      // PSNR и ускорение shading rate против полного
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--bc")) compressed = true; // block-compressed textures
+        else if (!strcmp(argv[i], "--filter") && i+1 < argc) { // nearest - без мипов, как get() до Texture
+            std::string f = argv[++i];
+            if (f == "nearest") filter = Texture::NEAREST;
+            else if (f == "bilinear") filter = Texture::BILINEAR;
+            else if (f == "trilinear") filter = Texture::TRILINEAR;
+            else {
+                std::cerr << "unknown filter " << f << ", expected nearest, bilinear or trilinear" << std::endl;
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "--serial")) serial = true; // load everything before rendering
+        else if (!strcmp(argv[i], "--frames") && i+1 < argc) frames = std::max(1, atoi(argv[++i])); // куб меняет альфу каждый кадр
+        else if (!strcmp(argv[i], "--no-frame-cache")) frame_cache = false;
+        else if (!strcmp(argv[i], "--lights") && i+1 < argc) nlights = std::max(0, atoi(argv[++i])); // точечные и прожекторы
+        else if (!strcmp(argv[i], "--no-light-culling")) light_culling = false; // все источники в каждом тайле
+        else if (!strcmp(argv[i], "--shading-rate") && i+1 < argc) { // 1, 2, 4 или auto
+            i++;
+            shading_rate = !strcmp(argv[i], "auto") ? 0 : atoi(argv[i]);
+        }
+        else if (!strcmp(argv[i], "--rate-threshold") && i+2 < argc) {
+            rate_threshold[0] = atof(argv[++i]);
+            rate_threshold[1] = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--progressive")) progressive = true; // превью 1/8, 1/4, 1/2 до полного кадра
+        else if (!strcmp(argv[i], "--views") && i+1 < argc) nviews = std::max(0, atoi(argv[++i])); // камеры по кругу, view_N
+        else if (!strcmp(argv[i], "--oit")) oit_mode = true; // прозрачность без сортировки
+        else if (!strcmp(argv[i], "--post") && i+1 < argc) post = argv[++i]; // all or ssao,ssao-blur,tone-curve,fxaa
+        else if (!strcmp(argv[i], "--format") && i+1 < argc) format = argv[++i]; // tga, tga-raw, qoi, ppm, raw
+        else if (!strcmp(argv[i], "--interactive") && i+1 < argc) interactive = std::max(0, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--present") && i+1 < argc) present = argv[++i]; // window, shm:/name, frame_%04d.tga
+        else if (!strcmp(argv[i], "--input") && i+1 < argc) input = argv[++i]; // запись input_bench --record
+        else if (!strcmp(argv[i], "--buffers") && i+1 < argc) buffers = atoi(argv[++i]); // 2 или 3
+        else if (!strcmp(argv[i], "--stats") && i+1 < argc) stats_json = argv[++i];
+        else if (!strcmp(argv[i], "--trace") && i+1 < argc) trace = argv[++i];
+        else if (!strcmp(argv[i], "--heatmaps")) heatmaps = true; // кэш кадра выключается: каждый кадр рисуется целиком
+        else if (!strcmp(argv[i], "--check-allocs")) check_allocs = true;
+        else if (!strcmp(argv[i], "--shading-rate-report")) rate_report = true; // с --shading-rate 1 - все режимы
+        else obj = argv[i];
+    }
+    if ((stats_json || heatmaps) && !STATS_ENABLED) {
+        std::cerr << "built without RENDERER_STATS, --stats and --heatmaps are ignored" << std::endl;
+        stats_json = NULL;
+        heatmaps = false;
+    }
+    if (heatmaps) frame_cache = false;
+    // пишется при любом выходе из main, когда вся работа уже закончена
+    struct TraceOutput {
+        const char *file;
+        ~TraceOutput() {
+            if (!file) return;
+            if (!Trace::write(file)) std::cerr << "can't write " << file << std::endl;
+            else if (Trace::dropped()) std::cerr << "trace: " << Trace::dropped() << " events dropped" << std::endl;
+        }
+    } trace_output = {trace && *trace ? trace : NULL};
+    if (trace_output.file) {
+        Trace::name_thread("main");
+        Trace::start();
+    }
+    const ImageWriter *writer = image_writer(format);
+    if (!writer) {
+        std::cerr << "unknown output format " << format << std::endl;
+        return 1;
+    }
+    // OBJ и текстуры грузятся параллельно; рендер ждёт только геометрию
+    std::shared_ptr<Model> loaded;
+    if (serial) {
+        loaded = std::make_shared<Model>(obj, 0, compressed);
+        loaded->require(Model::DIFFUSE);
+        loaded->require(Model::SPECULAR);
     } else {
-        model = new Model("../obj/african_head.obj");
+        loaded = load_model_async(obj, 1<<Model::DIFFUSE | 1<<Model::SPECULAR, compressed).get();
+    }
+    model = loaded.get();
+    model->texture_filter(filter);
+    // загрузчики текстур выделяют память параллельно с кадрами и попали бы в счёт
+    if (check_allocs) {
+        model->require(Model::DIFFUSE);
+        model->require(Model::SPECULAR);
     }
 
     cam.applyView();
     cam.applyProjection(width, height);
     viewport(width/8, height/8, width*3/4, height*3/4);
     light_dir.normalize();
+    scatter_lights(nlights);
+
+    if (interactive >= 0)
+        return run_interactive(interactive, present, input, buffers);
+
+    // голова с n камер: один проход на все виды против n отдельных рендеров
+    if (nviews > 0) {
+        model->require(Model::DIFFUSE);
+        model->require(Model::SPECULAR);
+        std::vector<View> views = orbit_views(nviews);
+        std::vector<TGAImage> frames, depths, single_frames, single_depths;
+        for (int v = 0; v < nviews; v++) {
+            frames.push_back(TGAImage(width, height, TGAImage::RGB));
+            depths.push_back(TGAImage(width, height, TGAImage::GRAYSCALE));
+        }
+        single_frames = frames;
+        single_depths = depths;
+
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        TileBins bins;
+        for (int v = 0; v < nviews; v++) {
+            FrameArena::reset();
+            ModelView = views[v].model_view;
+            Projection = views[v].projection;
+            Viewport = views[v].viewport;
+            render_opaque(single_frames[v].pixels<RGB8>(), single_depths[v].pixels<Gray8>(), bins,
+                          std::function<void(int, TGAImage &, TGAImage &)>());
+        }
+        double separate = elapsed_ms(t0);
+        t0 = std::chrono::steady_clock::now();
+        render_views(views, frames, depths);
+        double together = elapsed_ms(t0);
+
+        int same = 0;
+        for (int v = 0; v < nviews; v++) {
+            same += !memcmp(frames[v].buffer(), single_frames[v].buffer(), width*height*3);
+            frames[v].flip_vertically();
+            writer->write(frames[v].view(), ("view_" + std::to_string(v) + writer->extension()).c_str());
+        }
+        std::cerr << nviews << " views: one pass " << together << " ms (" << nviews*1000./together << " views/s), separate "
+                  << separate << " ms (" << nviews*1000./separate << " views/s), " << same << "/" << nviews << " identical" << std::endl;
+        return 0;
+    }
+
+    // голова с полным шейдингом и с выбранным shading rate: ошибка и время, rate_N на диск
+    if (rate_report) {
+        model->require(Model::DIFFUSE);
+        model->require(Model::SPECULAR);
+        const int reps = 5;
+        std::vector<int> rates;
+        if (shading_rate == 1) rates = {2, 4, 0};
+        else rates.push_back(shading_rate);
+        TGAImage reference(width, height, TGAImage::RGB), reference_depth(width, height, TGAImage::GRAYSCALE);
+        TGAImage test(width, height, TGAImage::RGB), test_depth(width, height, TGAImage::GRAYSCALE);
+        TileBins bins;
+        time_opaque(1, 1, reference, reference_depth, bins); // прогрев: полосы, арена, кэши
+        double full = time_opaque(1, reps, reference, reference_depth, bins);
+        std::cerr << "shading rate 1: " << full << " ms (median of " << reps << ")" << std::endl;
+        for (int rate : rates) {
+            double ms = time_opaque(rate, reps, test, test_depth, bins);
+            std::string name = rate ? std::to_string(rate) : std::string("auto");
+            std::cerr << "shading rate " << name << ": " << ms << " ms, speedup " << full/ms << "x, PSNR "
+                      << head_psnr(test, reference, reference_depth) << " dB over the head" << std::endl;
+            test.flip_vertically();
+            writer->write(test.view(), ("rate_" + name + writer->extension()).c_str());
+        }
+        return 0;
+    }
 
     TGAImage image  (width, height, TGAImage::RGB);
     TGAImage zbuffer(width, height, TGAImage::GRAYSCALE);
-
-    Shader shader;
-    for (int i = 0; i < model->nfaces(); i++) {
-        Vec4f screen_coords[3];
-        for (int j = 0; j < 3; j++)
-            screen_coords[j] = shader.vertex(i, j);
-        triangle(screen_coords, shader, image, zbuffer);
+    ImageView<RGB8>  frame = image.pixels<RGB8>();
+    ImageView<Gray8> depth = zbuffer.pixels<Gray8>();
+
+    // голова перерисовывается только при смене камеры/модели/текстур,
+    // между кадрами меняется лишь куб
+    FrameCache cache;
+    TileBins bins;
+    OITBuffer oit;
+    if (oit_mode) oit = OITBuffer(width, height);
+    const char *redraw_names[] = {"full", "partial", "none"};
+    const int warmup_frames = 2; // арена, полосы, кэш кадра и списки источников набирают размер
+    std::vector<unsigned long long> frame_allocs;
+    frame_allocs.reserve(frames + 1);
+    OpaqueStats opaque = {}; // последней полной перерисовки головы
+    // куб текущего кадра. Превью собирается один раз и читает куб по ссылке:
+    // std::function из этой лямбды на каждом кадре выделял бы память
+    CubeShader cubeshader(TGAColor(50,150,255,255), 0.3f);
+    Vec4f cube[12][3];
+    // превью: голова и куб в уменьшенном кадре, сразу в файл
+    std::function<void(int, TGAImage &, TGAImage &)> preview;
+    if (progressive) preview = [&](int scale, TGAImage &small, TGAImage &small_depth) {
+        CubeShader local = cubeshader;
+        for (int i = 0; i < 12; i++) {
+            Vec4f pts[3];
+            for (int j = 0; j < 3; j++) pts[j] = scale_xy(cube[i][j], 1.f/scale);
+            triangle(pts, local, small.pixels<RGB8>(), small_depth.pixels<Gray8>());
+        }
+        small.flip_vertically();
+        std::string name = "preview_" + std::to_string(scale) + writer->extension();
+        writer->write(small.view(), name.c_str());
+        std::cerr << "preview 1/" << scale << " after " << elapsed_ms(start) << " ms" << std::endl;
+    };
+    bool complete = false;
+    for (int f = 0; f < frames || !complete; f++) {
+        TRACE_SCOPE("frame", f);
+        unsigned long long allocs_before = AllocHook::count();
+        FrameArena::reset();
+        // кадр с превью не сохраняем, перерисовываем с полными текстурами
+        if (f >= frames) {
+            model->require(Model::DIFFUSE);
+            model->require(Model::SPECULAR);
+        }
+        // проверяем до рендера: текстура может дозагрузиться посреди кадра
+        complete = model->loaded(Model::DIFFUSE) && model->loaded(Model::SPECULAR);
+        std::chrono::steady_clock::time_point frame_start = std::chrono::steady_clock::now();
+        if (heatmaps) PipelineStats::instance().heatmaps(width, height);
+
+        cubeshader.alpha = 0.3f + 0.1f * (std::min(f, frames - 1) % 5);
+        Rect bounds;
+        for (int i = 0; i < 12; i++) {
+            for (int j = 0; j < 3; j++)
+                cube[i][j] = cubeshader.vertex(i, j);
+            bounds = bounds.unite(triangle_bounds(cube[i]));
+        }
+        STATS_ADD(vertices_shaded, 36);
+        unsigned long long overlay_key = hash_value(hash_value(HASH_SEED, cubeshader.base_color), cubeshader.alpha);
+
+        if (!frame_cache) cache.invalidate();
+        FrameCache::Redraw redraw = cache.begin(opaque_key(complete), overlay_key, bounds, frame, depth);
+        if (redraw == FrameCache::FULL) {
+            opaque = render_opaque(frame, depth, bins, preview);
+            cache.store_opaque(frame, depth);
+        }
+        if (redraw != FrameCache::NONE) {
+            STATS_TIMER(STAGE_BLEND);
+            STATS_ADD(triangles_submitted, 12);
+            render_cube(cube, cubeshader, frame, depth, cache.dirty(), oit_mode ? &oit : NULL, bins);
+        }
+        if (stats_json) PipelineStats::instance().add_frame(PipelineStats::instance().collect(), elapsed_ms(frame_start));
+
+        if (f == 0)
+            std::cerr << "first frame after " << elapsed_ms(start) << " ms" << (complete ? "" : " (preview textures)") << std::endl;
+        if (frames > 1 || f > 0)
+            std::cerr << "frame " << f << ": " << redraw_names[redraw] << " redraw, " << elapsed_ms(frame_start) << " ms" << std::endl;
+        if (check_allocs && frame_allocs.size() < frame_allocs.capacity())
+            frame_allocs.push_back(AllocHook::count() - allocs_before);
     }
-
-    CubeShader cubeshader(TGAColor(50,150,255,255), 0.3f); // alpha = 0.3
-    for (int i = 0; i < 12; i++) {
-        Vec4f screen_coords[3];
-        for (int j = 0; j < 3; j++)
-            screen_coords[j] = cubeshader.vertex(i, j);
-        triangle(screen_coords, cubeshader, image, zbuffer);
+    unsigned long long steady_allocs = 0;
+    if (check_allocs) {
+        std::cerr << "heap allocations per frame:";
+        for (size_t f = 0; f < frame_allocs.size(); f++) {
+            std::cerr << " " << frame_allocs[f];
+            if ((int)f >= warmup_frames) steady_allocs += frame_allocs[f];
+        }
+        std::cerr << std::endl << "after " << warmup_frames << " warm-up frames: " << steady_allocs << " allocations, frame arena "
+                  << FrameArena::capacity() << " bytes" << std::endl;
     }
 
+    if (!post.empty()) {
+        std::chrono::steady_clock::time_point post_start = std::chrono::steady_clock::now();
+        PostProcessor pp = PostProcessor::standard();
+        if (post != "all") {
+            const char *names[] = {"ssao", "ssao-blur", "tone-curve", "fxaa"};
+            for (const char *n : names) pp.enable(n, false);
+            size_t from = 0;
+            while (from <= post.size()) {
+                size_t comma = std::min(post.find(',', from), post.size());
+                std::string n = post.substr(from, comma - from);
+                if (!pp.enable(n, true)) std::cerr << "unknown post pass " << n << std::endl;
+                from = comma + 1;
+            }
+        }
+        TRACE_SCOPE("post");
+        TGAImage processed = ImagePool::instance().acquire(width, height, TGAImage::RGB);
+        pp.process(image.pixels<RGB8>(), zbuffer.pixels<Gray8>(), processed.pixels<RGB8>());
+        ImagePool::instance().release(std::move(image));
+        image = std::move(processed);
+        std::vector<PostProcessor::Timing> t = pp.timings();
+        std::cerr << "post " << pp.wall_ms() << " ms:";
+        for (size_t i = 0; i < t.size(); i++) std::cerr << " " << t[i].name << " " << t[i].ms;
+        std::cerr << std::endl;
+        if (stats_json) {
+            PipelineStats::local().stage_ns[STAGE_POST] += (unsigned long long)(elapsed_ms(post_start)*1e6);
+            PipelineStats::instance().amend_frame(PipelineStats::instance().collect(), elapsed_ms(post_start));
+        }
+    }
 
     image.  flip_vertically();
     zbuffer.flip_vertically();
-    image.  write_tga_file("output.tga");
-    zbuffer.write_tga_file("zbuffer.tga");
-
-    delete model;
-    return 0;
-}
\ No newline at end of file
+    writer->write(image.view(),   (std::string("output")  + writer->extension()).c_str());
+    writer->write(zbuffer.view(), (std::string("zbuffer") + writer->extension()).c_str());
+    if (heatmaps) {
+        TGAImage overdraw = PipelineStats::instance().overdraw_image();
+        TGAImage cost = PipelineStats::instance().shading_cost_image();
+        overdraw.flip_vertically();
+        cost.flip_vertically();
+        writer->write(overdraw.view(), (std::string("overdraw") + writer->extension()).c_str());
+        writer->write(cost.view(), (std::string("shading_cost") + writer->extension()).c_str());
+    }
+    if (stats_json && !PipelineStats::instance().write_json(stats_json))
+        std::cerr << "can't write " << stats_json << std::endl;
+
+    model = NULL;
+    loaded.reset();
+    if (!shading_rate)
+        std::cerr << "shading rate tiles: " << opaque.rate_tiles[1] << " x1, " << opaque.rate_tiles[2] << " x2, "
+                  << opaque.rate_tiles[4] << " x4" << std::endl;
+    if (opaque.lights.lights) {
+        const LightGrid::Stats &ls = opaque.lights;
+        std::cerr << "lights: " << ls.lights << ", depth pass + culling " << opaque.light_ms << " ms, "
+                  << (ls.tiles ? (double)ls.references/ls.tiles : 0.) << " per tile (max " << ls.max_per_tile << ")" << std::endl;
+    }
+    TextureCache::Stats ts = TextureCache::instance().stats();
+    std::cerr << "texture cache: " << ts.hits << " hits, " << ts.misses << " misses, " << ts.duplicates << " duplicate decodes, " << ts.evictions << " evictions, "
+              << ts.entries << " entries, " << ts.bytes << "/" << ts.budget << " bytes" << std::endl;
+    return steady_allocs ? 3 : 0;
+}
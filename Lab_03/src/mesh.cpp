@@ -2,8 +2,23 @@
 #include <fstream>
 #include <sstream>
 #include "../Include/mesh.h"
+#include "../Include/texture_cache.h"
+#include "../Include/trace.h"
 
-Model::Model(const char *filename) : verts_(), faces_(), norms_(), uv_(), diffusemap_(), normalmap_(), specularmap_() {
+Model::Model(const char *filename, int prefetch, bool compressed) : verts_(), corners_(), faces_(1, 0), norms_(), uv_(), maps_(),
+                                                                   filter_(Texture::TRILINEAR) {
+    TRACE_SCOPE("load obj");
+    for (int i=0; i<3; i++) {
+        maps_[i].format = Texture::BGRA8;
+        maps_[i].current = NULL;
+        maps_[i].final = false;
+    }
+    texture_path(filename, "_diffuse.tga", DIFFUSE);
+    texture_path(filename, "_nm.tga",      NORMAL);
+    texture_path(filename, "_spec.tga",    SPECULAR);
+    if (compressed) compress_textures();
+    for (int i=0; i<3; i++)
+        if (prefetch & (1<<i)) this->prefetch((TextureMap)i);
     std::ifstream in;
     in.open (filename, std::ifstream::in);
     if (in.fail()) return;
@@ -22,7 +37,7 @@ Model::Model(const char *filename) : verts_(), faces_(), norms_(), uv_(), diffus
             iss >> trash >> trash;
             Vec3f n;
             for (int i=0;i<3;i++) iss >> n[i];
-            norms_.push_back(n);
+            norms_.push_back(n.normalize()); // once here, normal() is read-only and safe to call from any thread
         }
         else if (!line.compare(0, 3, "vt ")) {
             iss >> trash >> trash;
@@ -31,36 +46,43 @@ Model::Model(const char *filename) : verts_(), faces_(), norms_(), uv_(), diffus
             uv_.push_back(uv);
         }
         else if (!line.compare(0, 2, "f ")) {
-            std::vector<Vec3i> f;
             Vec3i tmp;
             iss >> trash;
             while (iss >> tmp[0] >> trash >> tmp[1] >> trash >> tmp[2]) {
                 for (int i=0; i<3; i++) tmp[i]--; // in wavefront obj all indices start at 1, not zero
-                f.push_back(tmp);
+                corners_.push_back(tmp);
             }
-            faces_.push_back(f);
+            faces_.push_back((int)corners_.size());
         }
     }
-    std::cerr << "# v# " << verts_.size() << " f# "  << faces_.size() << " vt# " << uv_.size() << " vn# " << norms_.size() << std::endl;
-    load_texture(filename, "_diffuse.tga", diffusemap_);
-    load_texture(filename, "_nm.tga",      normalmap_);
-    load_texture(filename, "_spec.tga",    specularmap_);
+    std::cerr << "# v# " << verts_.size() << " f# "  << nfaces() << " vt# " << uv_.size() << " vn# " << norms_.size() << std::endl;
+}
+
+// loader threads write into this object
+Model::~Model() {
+    for (int i=0; i<3; i++)
+        if (maps_[i].pending.valid()) maps_[i].pending.wait();
 }
 
-Model::~Model() {}
+std::shared_future<std::shared_ptr<Model> > load_model_async(const char *filename, int prefetch, bool compressed) {
+    std::string path(filename);
+    return std::async(std::launch::async, [path, prefetch, compressed]() {
+        Trace::name_thread("model loader");
+        return std::make_shared<Model>(path.c_str(), prefetch, compressed);
+    }).share();
+}
 
 int Model::nverts() {
     return (int)verts_.size();
 }
 
 int Model::nfaces() {
-    return (int)faces_.size();
+    return (int)faces_.size()-1;
 }
 
-std::vector<int> Model::face(int idx) {
-    std::vector<int> face;
-    for (int i=0; i<(int)faces_[idx].size(); i++) face.push_back(faces_[idx][i][0]);
-    return face;
+Span<const Vec3i> Model::face(int idx) {
+    Span<const Vec3i> s = {corners_.data() + faces_[idx], corners_.data() + faces_[idx+1]};
+    return s;
 }
 
 Vec3f Model::vert(int i) {
@@ -68,43 +90,150 @@ Vec3f Model::vert(int i) {
 }
 
 Vec3f Model::vert(int iface, int nthvert) {
-    return verts_[faces_[iface][nthvert][0]];
+    return verts_[corners_[faces_[iface]+nthvert][0]];
+}
+
+int Model::nnormals() {
+    return (int)norms_.size();
+}
+
+Vec3f Model::normal(int i) {
+    return norms_[i];
+}
+
+Vec3i Model::corner(int iface, int nthvert) {
+    return corners_[faces_[iface]+nthvert];
+}
+
+void Model::texture_path(std::string filename, const char *suffix, TextureMap map) {
+    size_t dot = filename.find_last_of(".");
+    if (dot!=std::string::npos) maps_[map].path = filename.substr(0,dot) + std::string(suffix);
+}
+
+static const Texture no_texture;
+
+// after the first texture (preview or full) is in, this is a single acquire load
+const Texture &Model::texture(TextureMap map) {
+    const Texture *tex = maps_[map].current.load(std::memory_order_acquire);
+    return tex ? *tex : wait_texture(map);
+}
+
+// first sample of a map nobody prefetched: wait for whatever arrives first
+const Texture &Model::wait_texture(TextureMap map) {
+    prefetch(map);
+    TextureSlot &slot = maps_[map];
+    std::unique_lock<std::mutex> lock(slot.mutex);
+    slot.arrived.wait(lock, [&slot]() { return slot.current.load(std::memory_order_relaxed)!=NULL; });
+    return *slot.current.load(std::memory_order_relaxed);
+}
+
+void Model::publish(TextureMap map, const std::shared_ptr<const Texture> &tex, bool final) {
+    TextureSlot &slot = maps_[map];
+    std::lock_guard<std::mutex> lock(slot.mutex);
+    if (final) {
+        slot.texture = tex;
+        slot.final = true;
+        slot.current.store(tex ? tex.get() : &no_texture, std::memory_order_release);
+    } else if (!slot.final) {
+        slot.preview = tex;
+        slot.current.store(tex.get(), std::memory_order_release);
+    }
+    slot.arrived.notify_all();
 }
 
-void Model::load_texture(std::string filename, const char *suffix, TGAImage &img) {
-    std::string texfile(filename);
-    size_t dot = texfile.find_last_of(".");
-    if (dot!=std::string::npos) {
-        texfile = texfile.substr(0,dot) + std::string(suffix);
-        std::cerr << "texture file " << texfile << " loading " << (img.read_tga_file(texfile.c_str()) ? "ok" : "failed") << std::endl;
-        img.flip_vertically();
+// runs on a loader thread
+void Model::load_texture(TextureMap map) {
+    Trace::name_thread("texture loader");
+    TRACE_SCOPE("load texture", map);
+    std::string path;
+    Texture::Format format;
+    {
+        std::lock_guard<std::mutex> lock(maps_[map].mutex);
+        path = maps_[map].path;
+        format = maps_[map].format;
+    }
+    std::shared_ptr<const Texture> tex;
+    if (!path.empty())
+        tex = TextureCache::instance().acquire(path, format, [this, map](const std::shared_ptr<const Texture> &preview) {
+            publish(map, preview, false);
+        });
+    publish(map, tex, true);
+}
+
+std::shared_future<void> Model::prefetch(TextureMap map) {
+    TextureSlot &slot = maps_[map];
+    std::lock_guard<std::mutex> lock(slot.mutex);
+    if (!slot.pending.valid())
+        slot.pending = std::async(std::launch::async, &Model::load_texture, this, map).share();
+    return slot.pending;
+}
+
+void Model::require(TextureMap map) {
+    prefetch(map).wait();
+}
+
+bool Model::loaded(TextureMap map) {
+    std::lock_guard<std::mutex> lock(maps_[map].mutex);
+    return maps_[map].final;
+}
+
+void Model::texture_filter(Texture::Filter f) {
+    filter_ = f;
+}
+
+// BC1 for the colour map, BC5 (two channels, Z rebuilt) for the normal map, BC4 for the specular map
+void Model::compress_textures() {
+    const Texture::Format formats[3] = {Texture::BC1, Texture::BC5, Texture::BC4};
+    for (int i=0; i<3; i++) {
+        TextureSlot &slot = maps_[i];
+        if (slot.pending.valid()) slot.pending.wait();
+        std::lock_guard<std::mutex> lock(slot.mutex);
+        slot.format = formats[i];
+        if (!slot.pending.valid()) continue;
+        slot.pending = std::shared_future<void>();
+        slot.current.store(NULL, std::memory_order_relaxed);
+        slot.final = false;
+        slot.texture.reset();
+        slot.preview.reset();
     }
 }
 
 TGAColor Model::diffuse(Vec2f uvf) {
-    Vec2i uv(uvf[0]*diffusemap_.get_width(), uvf[1]*diffusemap_.get_height());
-    return diffusemap_.get(uv[0], uv[1]);
+    return texture(DIFFUSE).sample(uvf, filter_);
 }
 
-Vec3f Model::normal(Vec2f uvf) {
-    Vec2i uv(uvf[0]*normalmap_.get_width(), uvf[1]*normalmap_.get_height());
-    TGAColor c = normalmap_.get(uv[0], uv[1]);
+TGAColor Model::diffuse(Vec2f uvf, Vec2f duvdx, Vec2f duvdy) {
+    return texture(DIFFUSE).sample(uvf, duvdx, duvdy, filter_);
+}
+
+static Vec3f decode_normal(const TGAColor &c) {
     Vec3f res;
     for (int i=0; i<3; i++)
         res[2-i] = (float)c[i]/255.f*2.f - 1.f;
     return res;
 }
 
+Vec3f Model::normal(Vec2f uvf) {
+    return decode_normal(texture(NORMAL).sample(uvf, filter_));
+}
+
+Vec3f Model::normal(Vec2f uvf, Vec2f duvdx, Vec2f duvdy) {
+    return decode_normal(texture(NORMAL).sample(uvf, duvdx, duvdy, filter_));
+}
+
 Vec2f Model::uv(int iface, int nthvert) {
-    return uv_[faces_[iface][nthvert][1]];
+    return uv_[corners_[faces_[iface]+nthvert][1]];
 }
 
 float Model::specular(Vec2f uvf) {
-    Vec2i uv(uvf[0]*specularmap_.get_width(), uvf[1]*specularmap_.get_height());
-    return specularmap_.get(uv[0], uv[1])[0]/1.f;
+    return texture(SPECULAR).sample(uvf, filter_)[0]/1.f;
+}
+
+float Model::specular(Vec2f uvf, Vec2f duvdx, Vec2f duvdy) {
+    return texture(SPECULAR).sample(uvf, duvdx, duvdy, filter_)[0]/1.f;
 }
 
 Vec3f Model::normal(int iface, int nthvert) {
-    int idx = faces_[iface][nthvert][2];
-    return norms_[idx].normalize();
+    int idx = corners_[faces_[iface]+nthvert][2];
+    return norms_[idx];
 }
@@ -0,0 +1,75 @@
+#include <cmath>
+#include "../Include/multiview.h"
+
+MultiViewTransform::MultiViewTransform() : px_(), py_(), pz_(), qx_(), qy_(), qz_(), out_() {}
+
+// out[r][i] = row r of m times (x[i], y[i], z[i], w), summed from the last
+// component down like vec's operator*, so the result is the same bits
+static void transform_rows(const Matrix &m, int rows, float w, const std::vector<float> &x, const std::vector<float> &y,
+                           const std::vector<float> &z, std::vector<float> *out[]) {
+    int n = (int)x.size();
+    const float *xs = x.data(), *ys = y.data(), *zs = z.data();
+    for (int r=0; r<rows; r++) {
+        float a0 = m[r][0], a1 = m[r][1], a2 = m[r][2], aw = 0.f + m[r][3]*w;
+        out[r]->resize(n);
+        float *o = out[r]->data();
+        for (int i=0; i<n; i++)
+            o[i] = ((aw + a2*zs[i]) + a1*ys[i]) + a0*xs[i];
+    }
+}
+
+void MultiViewTransform::transform(Model &model, const std::vector<View> &views) {
+    int nv = model.nverts(), nn = model.nnormals();
+    px_.resize(nv); py_.resize(nv); pz_.resize(nv);
+    for (int i=0; i<nv; i++) {
+        Vec3f v = model.vert(i);
+        px_[i] = v.x; py_[i] = v.y; pz_[i] = v.z;
+    }
+    qx_.resize(nn); qy_.resize(nn); qz_.resize(nn);
+    for (int i=0; i<nn; i++) {
+        Vec3f v = model.normal(i);
+        qx_[i] = v.x; qy_[i] = v.y; qz_[i] = v.z;
+    }
+
+    out_.resize(views.size());
+    for (size_t k=0; k<views.size(); k++) {
+        Transformed &t = out_[k];
+        Matrix screen = views[k].viewport*views[k].projection*views[k].model_view;
+        std::vector<float> *clip[] = {&t.cx, &t.cy, &t.cz, &t.cw};
+        std::vector<float> *eye[]  = {&t.ex, &t.ey, &t.ez};
+        std::vector<float> *norm[] = {&t.nx, &t.ny, &t.nz};
+        transform_rows(screen, 4, 1.f, px_, py_, pz_, clip);
+        transform_rows(views[k].model_view, 3, 1.f, px_, py_, pz_, eye);
+        transform_rows(views[k].model_view, 3, 0.f, qx_, qy_, qz_, norm);
+        for (int i=0; i<nn; i++) {
+            float inv = 1.f/std::sqrt(t.nx[i]*t.nx[i] + t.ny[i]*t.ny[i] + t.nz[i]*t.nz[i]);
+            t.nx[i] *= inv;
+            t.ny[i] *= inv;
+            t.nz[i] *= inv;
+        }
+    }
+}
+
+int MultiViewTransform::views() const {
+    return (int)out_.size();
+}
+
+Vec4f MultiViewTransform::clip(int view, int vert) const {
+    const Transformed &t = out_[view];
+    Vec4f v;
+    v[0] = t.cx[vert];
+    v[1] = t.cy[vert];
+    v[2] = t.cz[vert];
+    v[3] = t.cw[vert];
+    return v;
+}
+
+Vec3f MultiViewTransform::eye(int view, int vert) const {
+    const Transformed &t = out_[view];
+    return Vec3f(t.ex[vert], t.ey[vert], t.ez[vert]);
+}
+
+Vec3f MultiViewTransform::normal(int view, int norm) const {
+    const Transformed &t = out_[view];
+    return Vec3f(t.nx[norm], t.ny[norm], t.nz[norm]);
+}
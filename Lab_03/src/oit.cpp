@@ -0,0 +1,91 @@
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "../Include/oit.h"
+#include "../Include/image_kernels.h"
+#include "../Include/thread_pool.h"
+
+OITBuffer::OITBuffer() : width_(0), height_(0), accum_(), revealage_() {}
+
+OITBuffer::OITBuffer(int width, int height) : width_(width), height_(height),
+        accum_((size_t)width*height), revealage_((size_t)width*height) {
+    clear();
+}
+
+int OITBuffer::width() const {
+    return width_;
+}
+
+int OITBuffer::height() const {
+    return height_;
+}
+
+void OITBuffer::clear() {
+    clear(Rect(0, 0, width_, height_));
+}
+
+void OITBuffer::clear(const Rect &rect) {
+    Rect r = rect.intersect(Rect(0, 0, width_, height_));
+    const RGBAf zero = {0.f, 0.f, 0.f, 0.f};
+    for (int y=r.y0; y<r.y1; y++) {
+        std::fill(&accum_[(size_t)y*width_ + r.x0], &accum_[(size_t)y*width_ + r.x1], zero);
+        std::fill(&revealage_[(size_t)y*width_ + r.x0], &revealage_[(size_t)y*width_ + r.x1], 1.f);
+    }
+}
+
+ImageView<const RGBAf> OITBuffer::accum() const {
+    return ImageView<const RGBAf>(accum_.data(), width_, height_);
+}
+
+ImageView<const float> OITBuffer::revealage() const {
+    return ImageView<const float>(revealage_.data(), width_, height_);
+}
+
+// one pixel: the colour channels go through the SSE lanes together
+template<class Pixel> static inline void composite(Pixel &p, const RGBAf &acc, float reveal) {
+#ifdef __SSE2__
+    __m128 a = _mm_loadu_ps(&acc.r);                                    // r g b a
+    __m128 sum = _mm_max_ps(_mm_shuffle_ps(a, a, 0xff), _mm_set1_ps(1e-5f));
+    __m128 avg = _mm_mul_ps(_mm_div_ps(a, sum), _mm_set1_ps(255.f*(1.f-reveal)));
+    __m128 dst = _mm_setr_ps(p.r, p.g, p.b, 0.f);
+    __m128 res = _mm_add_ps(_mm_add_ps(avg, _mm_mul_ps(dst, _mm_set1_ps(reveal))), _mm_set1_ps(.5f));
+    res = _mm_min_ps(res, _mm_set1_ps(255.f));
+    __m128i v = _mm_cvttps_epi32(res);
+    p.r = (unsigned char)_mm_cvtsi128_si32(v);
+    p.g = (unsigned char)_mm_cvtsi128_si32(_mm_srli_si128(v, 4));
+    p.b = (unsigned char)_mm_cvtsi128_si32(_mm_srli_si128(v, 8));
+#else
+    float k = 255.f*(1.f-reveal)/std::max(acc.a, 1e-5f);
+    p.r = (unsigned char)std::min(255.f, acc.r*k + p.r*reveal + .5f);
+    p.g = (unsigned char)std::min(255.f, acc.g*k + p.g*reveal + .5f);
+    p.b = (unsigned char)std::min(255.f, acc.b*k + p.b*reveal + .5f);
+#endif
+}
+
+template<class Pixel> static void resolve_rows(const std::vector<RGBAf> &accum, const std::vector<float> &revealage, int width,
+                                               ImageView<Pixel> frame, const Rect &r) {
+    if (r.empty()) return;
+    int nblocks = (long)r.width()*r.height() < KERNEL_PARALLEL_PIXELS ? 1 : ThreadPool::instance().size()*4;
+    int rows = (r.height()+nblocks-1)/nblocks;
+    ThreadPool::instance().parallel_for((r.height()+rows-1)/rows, [&](int b) {
+        int y1 = std::min(r.y1, r.y0+(b+1)*rows);
+        for (int y=r.y0+b*rows; y<y1; y++) {
+            const RGBAf *acc = &accum[(size_t)y*width];
+            const float *rev = &revealage[(size_t)y*width];
+            Pixel *row = frame.row(y);
+            for (int x=r.x0; x<r.x1; x++)
+                if (rev[x]<1.f) composite(row[x], acc[x], rev[x]); // untouched pixels keep the opaque colour
+        }
+    });
+}
+
+void OITBuffer::resolve(ImageView<RGB8> frame, const Rect &rect) const {
+    Rect r = rect.intersect(Rect(0, 0, std::min(width_, frame.width()), std::min(height_, frame.height())));
+    resolve_rows(accum_, revealage_, width_, frame, r);
+}
+
+void OITBuffer::resolve(ImageView<RGBA8> frame, const Rect &rect) const {
+    Rect r = rect.intersect(Rect(0, 0, std::min(width_, frame.width()), std::min(height_, frame.height())));
+    resolve_rows(accum_, revealage_, width_, frame, r);
+}
@@ -1,11 +1,14 @@
 #include <cmath>
 #include <limits>
 #include <cstdlib>
+#include <algorithm>
 #include "../Include/our_gl.h"
+#include "../Include/pipeline_stats.h"
 
 Matrix ModelView;
 Matrix Viewport;
 Matrix Projection;
+std::vector<Light> Lights;
 
 IShader::~IShader() {}
 
@@ -24,6 +27,14 @@ void projection(float coeff) {
     Projection[3][2] = coeff;
 }
 
+void add_light(const Light &light) {
+    Lights.push_back(light);
+}
+
+void clear_lights() {
+    Lights.clear();
+}
+
 void lookat(Vec3f eye, Vec3f center, Vec3f up) {
     Vec3f z = (eye-center).normalize();
     Vec3f x = cross(up,z).normalize();
@@ -49,16 +60,93 @@ Vec3f barycentric(Vec2f A, Vec2f B, Vec2f C, Vec2f P) {
         return Vec3f(1.f-(u.x+u.y)/u.z, u.y/u.z, u.x/u.z);
     return Vec3f(-1,1,1);
 }
-void alphaBlendPixel(TGAImage &image, int x, int y, const TGAColor &src, float alpha) {
-    TGAColor dst = image.get(x,y);
-    TGAColor out = dst;
-    for(int i=0;i<3;i++) {
-        out[i] = (unsigned char)(dst[i]*(1-alpha) + src[i]*alpha);
-    }
-    out[3]=255;
-    image.set(x,y,out);
+static inline void store(RGB8 &p, const TGAColor &c) {
+    p.b = c[0];
+    p.g = c[1];
+    p.r = c[2];
 }
-void triangle(Vec4f *pts, IShader &shader, TGAImage &image, TGAImage &zbuffer) {
+
+static inline void store(RGBA8 &p, const TGAColor &c) {
+    p.b = c[0];
+    p.g = c[1];
+    p.r = c[2];
+    p.a = c[3];
+}
+
+static inline void store(Gray8 &p, const TGAColor &c) {
+    p = c[0];
+}
+
+static inline void alphaBlendPixel(RGB8 &p, const TGAColor &src, float alpha) {
+    p.b = (unsigned char)(p.b*(1-alpha) + src[0]*alpha);
+    p.g = (unsigned char)(p.g*(1-alpha) + src[1]*alpha);
+    p.r = (unsigned char)(p.r*(1-alpha) + src[2]*alpha);
+}
+
+static inline void alphaBlendPixel(RGBA8 &p, const TGAColor &src, float alpha) {
+    p.b = (unsigned char)(p.b*(1-alpha) + src[0]*alpha);
+    p.g = (unsigned char)(p.g*(1-alpha) + src[1]*alpha);
+    p.r = (unsigned char)(p.r*(1-alpha) + src[2]*alpha);
+    p.a = 255;
+}
+
+static inline void alphaBlendPixel(Gray8 &p, const TGAColor &src, float alpha) {
+    p = (unsigned char)(p*(1-alpha) + src[0]*alpha);
+}
+
+#if STATS_ENABLED
+// one draw's counts, added to the thread's counters when it ends; heatmap
+// pixels are only touched by the band that owns them
+struct DrawStats {
+    PipelineCounters counts;
+    unsigned short *overdraw;
+    float *cost;
+    int width;
+    bool blend;
+    std::chrono::steady_clock::time_point t0;
+
+    DrawStats(int w, int h, bool blend_)
+        : overdraw(PipelineStats::instance().overdraw(w, h)), cost(PipelineStats::instance().shading_ns(w, h)),
+          width(w), blend(blend_) {}
+    ~DrawStats() {
+        PipelineStats::local().add(counts);
+    }
+    void tested(bool passed) {
+        counts.pixels_covered++;
+        counts.pixels_depth_tested++;
+        counts.pixels_depth_passed += passed;
+    }
+    void begin_shade() {
+        t0 = std::chrono::steady_clock::now();
+    }
+    // fragment() time goes to the pixels it colours
+    void end_shade(bool discard, const int *px, const int *py, int n) {
+        float ns = (float)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+        counts.pixels_shaded++;
+        counts.pixels_discarded += discard;
+        if (cost)
+            for (int k = 0; k < n; k++) cost[py[k]*width + px[k]] += ns/n;
+    }
+    void wrote(int x, int y) {
+        if (blend) counts.pixels_blended++;
+        else       counts.pixels_written++;
+        if (overdraw && overdraw[y*width + x] < 65535) overdraw[y*width + x]++;
+    }
+};
+#define DRAW_STATS(call) stats.call
+#else
+#define DRAW_STATS(call) ((void)0)
+#endif
+
+// Walks the triangle's bbox (clipped to width x height and the scissor) in 2x2
+// quads, or in coarse blocks at the shader's shading rate, and hands every fragment that passes test(x, y, depth) to the fragment
+// shader, and every one it keeps to write(x, y, depth, color). Testing first
+// skips shading for hidden fragments; nothing else touches the buffers in between.
+template<class Test, class Write> static void rasterize(Vec4f *pts, IShader &shader, int width, int height, const Rect &scissor,
+                                                        Test &&test, Write &&write) {
+#if STATS_ENABLED
+    DrawStats stats(width, height, shader.alpha > 0.0f);
+#endif
     Vec2f bboxmin(std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
     Vec2f bboxmax(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
 
@@ -69,40 +157,258 @@ void triangle(Vec4f *pts, IShader &shader, TGAImage &image, TGAImage &zbuffer) {
             bboxmax[j] = std::max(bboxmax[j], v);
         }
 
-    Vec2i P;
+    // clip once here, the pixel loop below does no bounds checks. Quads stay
+    // aligned to even coordinates, so a scissored draw shades exactly like a full one
+    int xmin = std::max(std::max(0, scissor.x0), (int)bboxmin.x);
+    int ymin = std::max(std::max(0, scissor.y0), (int)bboxmin.y);
+    int xmax = std::min(std::min(width,  scissor.x1)-1, (int)bboxmax.x);
+    int ymax = std::min(std::min(height, scissor.y1)-1, (int)bboxmax.y);
+
+    Vec2f A = proj<2>(pts[0]/pts[0][3]);
+    Vec2f B = proj<2>(pts[1]/pts[1][3]);
+    Vec2f C = proj<2>(pts[2]/pts[2][3]);
     TGAColor color;
 
-    for (P.x = bboxmin.x; P.x <= bboxmax.x; P.x++) {
-        for (P.y = bboxmin.y; P.y <= bboxmax.y; P.y++) {
-            Vec3f bc = barycentric(
-                proj<2>(pts[0]/pts[0][3]),
-                proj<2>(pts[1]/pts[1][3]),
-                proj<2>(pts[2]/pts[2][3]),
-                proj<2>(P)
-            );
+    // walk the bbox in 2x2 quads so the shader gets screen-space derivatives
+    auto shade_quad = [&](int qx, int qy) {
+        Vec3f quad[4];
+        for (int k = 0; k < 4; k++)
+            quad[k] = barycentric(A, B, C, Vec2f(qx + (k&1), qy + (k>>1)));
+        shader.bar_ddx = quad[1] - quad[0];
+        shader.bar_ddy = quad[2] - quad[0];
 
+        for (int k = 0; k < 4; k++) {
+            int x = qx + (k&1);
+            int y = qy + (k>>1);
+            if (x < xmin || x > xmax || y < ymin || y > ymax) continue;
+            Vec3f bc = quad[k];
             if (bc.x < 0 || bc.y < 0 || bc.z < 0) continue;
 
             float z = pts[0][2]*bc.x + pts[1][2]*bc.y + pts[2][2]*bc.z;
             float w = pts[0][3]*bc.x + pts[1][3]*bc.y + pts[2][3]*bc.z;
             int frag_depth = std::max(0, std::min(255, int(z/w + 0.5f)));
+            bool passed = test(x, y, frag_depth);
+            DRAW_STATS(tested(passed));
+            if (!passed) continue;
 
+            shader.frag_coord = Vec2i(x, y);
+            DRAW_STATS(begin_shade());
             bool discard = shader.fragment(bc, color);
+            DRAW_STATS(end_shade(discard, &x, &y, 1));
             if (discard) continue;
+            write(x, y, frag_depth, color);
+            DRAW_STATS(wrote(x, y));
+        }
+    };
+
+    // coarse shading: coverage and depth per pixel, one fragment() per r x r block.
+    // The block is shaded at its centre, or at its first covered pixel when the
+    // centre is outside the triangle, so varyings are never extrapolated
+    auto shade_block = [&](int bx, int by, int r) {
+        int n = 0, px[16], py[16], pdepth[16];
+        Vec3f first;
+        for (int j = 0; j < r; j++)
+            for (int i = 0; i < r; i++) {
+                int x = bx + i, y = by + j;
+                if (x < xmin || x > xmax || y < ymin || y > ymax) continue;
+                Vec3f bc = barycentric(A, B, C, Vec2f(x, y));
+                if (bc.x < 0 || bc.y < 0 || bc.z < 0) continue;
 
-            // прозрачный объект (куб)
-            if (shader.alpha > 0.0f) {
-                // НЕ проверяем z-buffer, чтобы видеть модель внутри
-                alphaBlendPixel(image, P.x, P.y, color, shader.alpha);
-            } else {
-                // непрозрачный объект — обычная запись и проверка глубины
-                if (zbuffer.get(P.x, P.y)[0] > frag_depth) continue;
-                zbuffer.set(P.x, P.y, TGAColor(frag_depth));
-                image.set(P.x, P.y, color);
+                float z = pts[0][2]*bc.x + pts[1][2]*bc.y + pts[2][2]*bc.z;
+                float w = pts[0][3]*bc.x + pts[1][3]*bc.y + pts[2][3]*bc.z;
+                int frag_depth = std::max(0, std::min(255, int(z/w + 0.5f)));
+                bool passed = test(x, y, frag_depth);
+                DRAW_STATS(tested(passed));
+                if (!passed) continue;
+                if (!n) first = bc;
+                px[n] = x;
+                py[n] = y;
+                pdepth[n++] = frag_depth;
             }
+        if (!n) return;
+
+        Vec3f b0 = barycentric(A, B, C, Vec2f(bx, by));
+        shader.bar_ddx = (barycentric(A, B, C, Vec2f(bx + 1, by)) - b0)*(float)r;
+        shader.bar_ddy = (barycentric(A, B, C, Vec2f(bx, by + 1)) - b0)*(float)r;
+        float c = (r - 1)*.5f;
+        Vec3f bc = barycentric(A, B, C, Vec2f(bx + c, by + c));
+        if (bc.x < 0 || bc.y < 0 || bc.z < 0) bc = first;
+
+        shader.frag_coord = Vec2i(bx, by);
+        DRAW_STATS(begin_shade());
+        bool discard = shader.fragment(bc, color);
+        DRAW_STATS(end_shade(discard, px, py, n));
+        if (discard) return;
+        for (int k = 0; k < n; k++) {
+            write(px[k], py[k], pdepth[k], color);
+            DRAW_STATS(wrote(px[k], py[k]));
         }
+    };
+
+    if (shader.shading_rate <= 1 && !shader.rate_map) {
+        for (int qy = ymin & ~1; qy <= ymax; qy += 2)
+            for (int qx = xmin & ~1; qx <= xmax; qx += 2)
+                shade_quad(qx, qy);
+        return;
     }
+    // 4x4 cells aligned to the screen, each at the rate of its tile
+    for (int cy = ymin & ~3; cy <= ymax; cy += 4)
+        for (int cx = xmin & ~3; cx <= xmax; cx += 4) {
+            int r = shader.rate_map ? shader.rate_map->rate(cx, cy) : shader.shading_rate;
+            r = r >= 4 ? 4 : (r >= 2 ? 2 : 1);
+            if (r == 1) {
+                for (int k = 0; k < 4; k++)
+                    shade_quad(cx + (k&1)*2, cy + (k>>1)*2);
+                continue;
+            }
+            for (int by = cy; by < cy + 4; by += r)
+                for (int bx = cx; bx < cx + 4; bx += r)
+                    shade_block(bx, by, r);
+        }
 }
 
+template<class Pixel> static void draw(Vec4f *pts, IShader &shader, ImageView<Pixel> image, ImageView<Gray8> zbuffer,
+                                       const Rect &scissor) {
+    int width  = std::min(image.width(),  zbuffer.width());
+    int height = std::min(image.height(), zbuffer.height());
+    bool transparent = shader.alpha > 0.0f;
+    rasterize(pts, shader, width, height, scissor, [&](int x, int y, int frag_depth) {
+        // прозрачный объект (куб): НЕ проверяем z-buffer, чтобы видеть модель внутри
+        return transparent || zbuffer(x, y) <= frag_depth;
+    }, [&](int x, int y, int frag_depth, const TGAColor &color) {
+        if (transparent) {
+            alphaBlendPixel(image(x, y), color, shader.alpha);
+        } else {
+            // непрозрачный объект — обычная запись, глубина уже проверена
+            zbuffer(x, y) = (Gray8)frag_depth;
+            store(image(x, y), color);
+        }
+    });
+}
 
+static const Rect no_scissor(0, 0, std::numeric_limits<int>::max(), std::numeric_limits<int>::max());
 
+void triangle(Vec4f *pts, IShader &shader, ImageView<RGB8> image, ImageView<Gray8> zbuffer) {
+    draw(pts, shader, image, zbuffer, no_scissor);
+}
+
+void triangle(Vec4f *pts, IShader &shader, ImageView<RGBA8> image, ImageView<Gray8> zbuffer) {
+    draw(pts, shader, image, zbuffer, no_scissor);
+}
+
+void triangle(Vec4f *pts, IShader &shader, ImageView<RGB8> image, ImageView<Gray8> zbuffer, const Rect &scissor) {
+    draw(pts, shader, image, zbuffer, scissor);
+}
+
+void triangle(Vec4f *pts, IShader &shader, ImageView<RGBA8> image, ImageView<Gray8> zbuffer, const Rect &scissor) {
+    draw(pts, shader, image, zbuffer, scissor);
+}
+
+void triangle(Vec4f *pts, IShader &shader, OITBuffer &oit, ImageView<const Gray8> zbuffer, const Rect &scissor) {
+    int width  = std::min(oit.width(),  zbuffer.width());
+    int height = std::min(oit.height(), zbuffer.height());
+    rasterize(pts, shader, width, height, scissor, [&](int x, int y, int frag_depth) {
+        // проверка глубины против непрозрачной сцены, без записи
+        return zbuffer(x, y) <= frag_depth;
+    }, [&](int x, int y, int frag_depth, const TGAColor &color) {
+        oit.add(x, y, color, shader.alpha, frag_depth);
+    });
+}
+
+// the pre-pass writes depth in the test, the shader never runs
+struct DepthOnlyShader : public IShader {
+    virtual Vec4f vertex(int, int) { return Vec4f(); }
+    virtual bool fragment(Vec3f, TGAColor &) { return true; }
+};
+
+void triangle(Vec4f *pts, ImageView<Gray8> zbuffer, const Rect &scissor) {
+    DepthOnlyShader shader;
+    rasterize(pts, shader, zbuffer.width(), zbuffer.height(), scissor, [&](int x, int y, int frag_depth) {
+        Gray8 &depth = zbuffer(x, y);
+        if (depth <= frag_depth) depth = (Gray8)frag_depth;
+        return false;
+    }, [](int, int, int, const TGAColor &) {});
+}
+
+Rect triangle_bounds(const Vec4f *pts) {
+    float xmin = std::numeric_limits<float>::max(), ymin = xmin;
+    float xmax = -std::numeric_limits<float>::max(), ymax = xmax;
+    for (int i = 0; i < 3; i++) {
+        float x = pts[i][0] / pts[i][3], y = pts[i][1] / pts[i][3];
+        xmin = std::min(xmin, x);
+        ymin = std::min(ymin, y);
+        xmax = std::max(xmax, x);
+        ymax = std::max(ymax, y);
+    }
+    // same truncation as the rasterizer, one past the last pixel it may touch
+    return Rect((int)std::floor(xmin), (int)std::floor(ymin), (int)xmax + 1, (int)ymax + 1);
+}
+
+void triangle(Vec4f *pts, IShader &shader, TGAImage &image, TGAImage &zbuffer) {
+    ImageView<Gray8> depth = zbuffer.pixels<Gray8>();
+    if (depth.empty()) return;
+    switch (image.get_bytespp()) {
+        case TGAImage::RGB:       draw(pts, shader, image.pixels<RGB8>(),  depth, no_scissor); break;
+        case TGAImage::RGBA:      draw(pts, shader, image.pixels<RGBA8>(), depth, no_scissor); break;
+        case TGAImage::GRAYSCALE: draw(pts, shader, image.pixels<Gray8>(), depth, no_scissor); break;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+
+TileBins::TileBins() : width_(0), height_(0), bins_() {}
+
+void TileBins::reset(int width, int height) {
+    width_ = width;
+    height_ = height;
+    size_t n = (size_t)std::max(0, (height+BAND_ROWS-1)/BAND_ROWS);
+    if (bins_.size() < n) bins_.resize(n);
+    for (size_t i = 0; i < bins_.size(); i++) bins_[i].clear();
+}
+
+void TileBins::add(int tri, const Rect &bounds) {
+    Rect r = bounds.intersect(Rect(0, 0, width_, height_));
+    if (r.empty()) return;
+    for (int b = r.y0/BAND_ROWS; b <= (r.y1-1)/BAND_ROWS; b++)
+        bins_[b].push_back(tri);
+}
+
+int TileBins::bands() const {
+    return (height_+BAND_ROWS-1)/BAND_ROWS;
+}
+
+Rect TileBins::band(int i) const {
+    return Rect(0, i*BAND_ROWS, width_, std::min(height_, (i+1)*BAND_ROWS));
+}
+
+const std::vector<int> &TileBins::triangles(int band) const {
+    return bins_[band];
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+
+ShadingRateMap::ShadingRateMap() : tiles_x_(0), tiles_y_(0), rates_() {}
+
+void ShadingRateMap::reset(int width, int height, int rate) {
+    tiles_x_ = (width+TILE-1)/TILE;
+    tiles_y_ = (height+TILE-1)/TILE;
+    rates_.assign((size_t)tiles_x_*tiles_y_, (unsigned char)rate);
+}
+
+void ShadingRateMap::set(int tx, int ty, int rate) {
+    rates_[(size_t)ty*tiles_x_ + tx] = (unsigned char)rate;
+}
+
+int ShadingRateMap::rate(int x, int y) const {
+    int tx = x/TILE, ty = y/TILE;
+    if (tx >= tiles_x_ || ty >= tiles_y_) return 1;
+    return rates_[(size_t)ty*tiles_x_ + tx];
+}
+
+int ShadingRateMap::tiles_x() const {
+    return tiles_x_;
+}
+
+int ShadingRateMap::tiles_y() const {
+    return tiles_y_;
+}
@@ -0,0 +1,134 @@
+#include <algorithm>
+#include <cassert>
+#include "../Include/pass_graph.h"
+
+PassBuffer::PassBuffer() : width_(0), height_(0), data_() {}
+
+void PassBuffer::resize(int width, int height) {
+    width_ = width;
+    height_ = height;
+    data_.assign((size_t)width*height, Texel());
+}
+
+void PassBuffer::clear() {
+    std::fill(data_.begin(), data_.end(), Texel());
+}
+
+PassInputs::PassInputs() : frame(0), time(0), time_delta(0), mouse() {
+    for (int i=0; i<256; i++) keys[i] = false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+
+PassGraph::PassGraph() : passes_(), keyboard_(), front_(0), frame_(0), waves_(0), jobs_() {
+    keyboard_.resize(256, 3);
+    for (int i=0; i<256; i++) keys_prev_[i] = false;
+}
+
+int PassGraph::add_pass(const std::string &name, int width, int height, const PassFunc &f) {
+    Pass p;
+    p.name = name;
+    p.func = f;
+    for (int ch=0; ch<4; ch++) p.source[ch] = UNBOUND;
+    p.buffer[0].resize(width, height);
+    p.buffer[1].resize(width, height);
+    passes_.push_back(p);
+    return (int)passes_.size() - 1;
+}
+
+void PassGraph::bind(int pass, int ch, int source) {
+    assert(pass >= 0 && pass < (int)passes_.size() && ch >= 0 && ch < 4);
+    assert(source == KEYBOARD || source == UNBOUND || (source >= 0 && source < (int)passes_.size()));
+    passes_[pass].source[ch] = source;
+}
+
+void PassGraph::reset() {
+    for (size_t i=0; i<passes_.size(); i++) {
+        passes_[i].buffer[0].clear();
+        passes_[i].buffer[1].clear();
+    }
+    keyboard_.clear();
+    for (int i=0; i<256; i++) keys_prev_[i] = false;
+    front_ = 0;
+    frame_ = 0;
+}
+
+const PassBuffer &PassGraph::output(int pass) const {
+    // after step() the written buffer has been swapped to the back
+    return passes_[pass].buffer[1 - front_];
+}
+
+// earlier passes have already run this frame, the rest still hold the last one
+const PassBuffer *PassGraph::channel_buffer(int pass, int source) const {
+    if (source == KEYBOARD) return &keyboard_;
+    if (source < 0) return NULL;
+    return &passes_[source].buffer[source < pass ? front_ : 1 - front_];
+}
+
+// ShaderToy's keyboard texture: row 0 held, row 1 pressed this frame, row 2 toggled
+void PassGraph::update_keyboard(const PassInputs &in) {
+    Texel *held = keyboard_.row(0), *pressed = keyboard_.row(1), *toggle = keyboard_.row(2);
+    for (int i=0; i<256; i++) {
+        bool down = in.keys[i], hit = down && !keys_prev_[i];
+        held[i].x = down ? 1.f : 0.f;
+        pressed[i].x = hit ? 1.f : 0.f;
+        if (hit) toggle[i].x = 1.f - toggle[i].x;
+        keys_prev_[i] = down;
+    }
+}
+
+void PassGraph::run_job(const Job &j, const PassInputs &in) {
+    Pass &p = passes_[j.pass];
+    PassContext ctx;
+    ctx.in = &in;
+    for (int ch=0; ch<4; ch++) ctx.channel[ch] = channel_buffer(j.pass, p.source[ch]);
+    PassBuffer &out = p.buffer[front_];
+    for (int y=j.y0; y<j.y1; y++) {
+        Texel *row = out.row(y);
+        for (int x=0; x<out.width(); x++)
+            row[x] = p.func(ctx, x, y);
+    }
+}
+
+void PassGraph::step(const PassInputs &inputs, ThreadPool &pool) {
+    PassInputs in = inputs;
+    in.frame = frame_;
+    update_keyboard(in);
+
+    // a pass waits for the earlier passes it reads; everything else shares its wave
+    int n = (int)passes_.size();
+    std::vector<int> level(n, 0);
+    int nlevels = 0;
+    for (int i=0; i<n; i++) {
+        for (int ch=0; ch<4; ch++) {
+            int s = passes_[i].source[ch];
+            if (s >= 0 && s < i) level[i] = std::max(level[i], level[s] + 1);
+        }
+        nlevels = std::max(nlevels, level[i] + 1);
+    }
+
+    for (int l=0; l<nlevels; l++) {
+        jobs_.clear();
+        long texels = 0;
+        for (int i=0; i<n; i++) {
+            if (level[i] != l) continue;
+            const PassBuffer &b = passes_[i].buffer[front_];
+            texels += (long)b.width()*b.height();
+            // a small pass is one job, a large one a job per block of rows
+            int block = (long)b.width()*b.height() < SMALL_WAVE ? b.height() : ROW_BLOCK;
+            for (int y=0; y<b.height(); y+=block) {
+                Job j = {i, y, std::min(y + block, b.height())};
+                jobs_.push_back(j);
+            }
+        }
+        if (texels < SMALL_WAVE) {
+            for (size_t k=0; k<jobs_.size(); k++) run_job(jobs_[k], in);
+        } else {
+            pool.parallel_for((int)jobs_.size(), [&](int k) { run_job(jobs_[k], in); });
+        }
+    }
+    waves_ = nlevels;
+
+    front_ = 1 - front_;
+    frame_++;
+}
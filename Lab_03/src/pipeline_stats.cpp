@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include "../Include/pipeline_stats.h"
+#include "../Include/frame_arena.h"
+
+PipelineCounters::PipelineCounters() {
+    memset((void *)this, 0, sizeof(*this));
+}
+
+void PipelineCounters::add(const PipelineCounters &c) {
+    const unsigned long long *src = (const unsigned long long *)&c;
+    unsigned long long *dst = (unsigned long long *)this;
+    for (size_t i = 0; i < sizeof(*this)/sizeof(unsigned long long); i++) dst[i] += src[i];
+}
+
+RasterizedTriangles::RasterizedTriangles(int triangles)
+    : covered_(FrameArena::local().array<std::atomic<bool> >(triangles)) {
+    for (int i = 0; i < covered_.size(); i++) covered_[i].store(false, std::memory_order_relaxed);
+}
+
+// after draw_bands has returned, so every band's flags are visible
+RasterizedTriangles::~RasterizedTriangles() {
+    int n = 0;
+    for (int i = 0; i < covered_.size(); i++) n += covered_[i].load(std::memory_order_relaxed);
+    PipelineStats::local().triangles_rasterized += n;
+}
+
+PipelineStats::PipelineStats() : width_(0), height_(0) {}
+
+PipelineStats &PipelineStats::instance() {
+    static PipelineStats stats;
+    return stats;
+}
+
+PipelineCounters &PipelineStats::local() {
+    // never freed: a thread may exit before the next collect()
+    thread_local PipelineCounters *counters = NULL;
+    if (!counters) {
+        counters = new PipelineCounters();
+        PipelineStats &s = instance();
+        std::lock_guard<std::mutex> lock(s.mutex_);
+        s.threads_.push_back(counters);
+    }
+    return *counters;
+}
+
+void PipelineStats::heatmaps(int width, int height) {
+    width_ = std::max(0, width);
+    height_ = std::max(0, height);
+    overdraw_.assign((size_t)width_*height_, 0);
+    shading_ns_.assign((size_t)width_*height_, 0.f);
+}
+
+unsigned short *PipelineStats::overdraw(int width, int height) {
+    return width == width_ && height == height_ && !overdraw_.empty() ? overdraw_.data() : NULL;
+}
+
+float *PipelineStats::shading_ns(int width, int height) {
+    return width == width_ && height == height_ && !shading_ns_.empty() ? shading_ns_.data() : NULL;
+}
+
+PipelineCounters PipelineStats::collect() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    PipelineCounters sum;
+    for (size_t i = 0; i < threads_.size(); i++) {
+        sum.add(*threads_[i]);
+        *threads_[i] = PipelineCounters();
+    }
+    return sum;
+}
+
+const char *PipelineStats::stage_name(int stage) {
+    static const char *names[STAGE_COUNT] = {"vertex", "preview", "depth_prepass", "light_culling", "binning",
+                                             "raster", "blend", "post"};
+    return stage >= 0 && stage < STAGE_COUNT ? names[stage] : "";
+}
+
+// heatmaps are bottom-up like the frame, so they flip together with it
+TGAImage PipelineStats::overdraw_image() const {
+    static const unsigned char palette[7][3] = { // RGB
+        {0, 0, 0}, {0, 0, 255}, {0, 255, 255}, {0, 255, 0}, {255, 255, 0}, {255, 0, 0}, {255, 255, 255}};
+    TGAImage img(width_, height_, TGAImage::RGB);
+    ImageView<RGB8> px = img.pixels<RGB8>();
+    for (int y = 0; y < height_; y++)
+        for (int x = 0; x < width_; x++) {
+            const unsigned char *c = palette[std::min<int>(6, overdraw_[(size_t)y*width_ + x])];
+            px(x, y).r = c[0];
+            px(x, y).g = c[1];
+            px(x, y).b = c[2];
+        }
+    return img;
+}
+
+TGAImage PipelineStats::shading_cost_image() const {
+    TGAImage img(width_, height_, TGAImage::RGB);
+    std::vector<float> shaded;
+    for (size_t i = 0; i < shading_ns_.size(); i++)
+        if (shading_ns_[i] > 0.f) shaded.push_back(shading_ns_[i]);
+    if (shaded.empty()) return img;
+    size_t k = (size_t)(.99*(shaded.size() - 1));
+    std::nth_element(shaded.begin(), shaded.begin() + k, shaded.end());
+    float top = std::max(shaded[k], 1e-3f);
+    ImageView<RGB8> px = img.pixels<RGB8>();
+    for (int y = 0; y < height_; y++)
+        for (int x = 0; x < width_; x++) {
+            float t = std::min(1.f, shading_ns_[(size_t)y*width_ + x]/top)*3.f;
+            px(x, y).r = (unsigned char)(255.f*std::min(1.f, t));
+            px(x, y).g = (unsigned char)(255.f*std::max(0.f, std::min(1.f, t - 1.f)));
+            px(x, y).b = (unsigned char)(255.f*std::max(0.f, t - 2.f));
+        }
+    return img;
+}
+
+void PipelineStats::add_frame(const PipelineCounters &c, double frame_ms) {
+    frames_.push_back(std::make_pair(c, frame_ms));
+}
+
+void PipelineStats::amend_frame(const PipelineCounters &c, double ms) {
+    if (frames_.empty()) {
+        add_frame(c, ms);
+        return;
+    }
+    frames_.back().first.add(c);
+    frames_.back().second += ms;
+}
+
+bool PipelineStats::write_json(const char *filename) const {
+    std::ofstream out(filename);
+    if (!out) return false;
+    out << "{\n  \"frames\": [\n";
+    for (size_t f = 0; f < frames_.size(); f++) {
+        const PipelineCounters &c = frames_[f].first;
+        out << "    {\n      \"frame\": " << f << ",\n      \"frame_ms\": " << frames_[f].second << ",\n"
+            << "      \"vertices_shaded\": " << c.vertices_shaded << ",\n"
+            << "      \"triangles_submitted\": " << c.triangles_submitted << ",\n"
+            << "      \"triangles_culled\": " << c.triangles_culled << ",\n"
+            << "      \"triangles_clipped\": " << c.triangles_clipped << ",\n"
+            << "      \"triangles_rasterized\": " << c.triangles_rasterized << ",\n"
+            << "      \"pixels_covered\": " << c.pixels_covered << ",\n"
+            << "      \"pixels_depth_tested\": " << c.pixels_depth_tested << ",\n"
+            << "      \"pixels_depth_passed\": " << c.pixels_depth_passed << ",\n"
+            << "      \"pixels_shaded\": " << c.pixels_shaded << ",\n"
+            << "      \"pixels_written\": " << c.pixels_written << ",\n"
+            << "      \"pixels_blended\": " << c.pixels_blended << ",\n"
+            << "      \"pixels_discarded\": " << c.pixels_discarded << ",\n"
+            << "      \"stage_ms\": {";
+        for (int s = 0; s < STAGE_COUNT; s++)
+            out << (s ? ", " : "") << "\"" << stage_name(s) << "\": " << c.stage_ns[s]*1e-6;
+        out << "}\n    }" << (f + 1 < frames_.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    return (bool)out;
+}
@@ -0,0 +1,337 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include "../Include/postprocess.h"
+#include "../Include/thread_pool.h"
+#include "../Include/trace.h"
+#include "../Include/frame_arena.h"
+
+// sRGB <-> linear. Decoding is a 256-entry table; encoding indexes a 64K table
+// with the linear value, fine enough that every decoded byte encodes back to itself.
+struct SRGBTables {
+    float decode[256];
+    unsigned char encode[65536];
+
+    SRGBTables() {
+        for (int i=0; i<256; i++) {
+            float c = i/255.f;
+            decode[i] = c<=0.04045f ? c/12.92f : std::pow((c+0.055f)/1.055f, 2.4f);
+        }
+        int code = 0;
+        for (int i=0; i<65536; i++) {
+            float v = i/65535.f;
+            // the midpoint between two decoded codes is the switch-over point
+            while (code<255 && v>=.5f*(decode[code]+decode[code+1])) code++;
+            encode[i] = (unsigned char)code;
+        }
+    }
+};
+
+static const SRGBTables &srgb() {
+    static const SRGBTables tables;
+    return tables;
+}
+
+static unsigned char encode_srgb(const SRGBTables &t, float v) {
+    v = std::min(1.f, std::max(0.f, v));
+    return t.encode[(int)(v*65535.f + .5f)];
+}
+
+static float luma(const RGBAf &c) {
+    return std::sqrt(c.r*.299f + c.g*.587f + c.b*.114f); // roughly perceptual, as FXAA wants
+}
+
+PostPass::~PostPass() {}
+
+/////////////////////////////////////////////////////////////////////////////////
+
+// 4x4 ordered-dither order, so neighbouring pixels get far-apart rotations
+static const int rotation_order[16] = {0, 8, 2, 10, 12, 4, 14, 6, 3, 11, 1, 9, 15, 7, 13, 5};
+
+SSAOPass::SSAOPass(int samples, float radius, float range, float strength) :
+        offsets_(), samples_(std::max(2, samples & ~1)), radius_(radius), range_(range), strength_(strength) {
+    int pairs = samples_/2;
+    offsets_.resize(16*pairs*2);
+    for (int r=0; r<16; r++) {
+        float rot = rotation_order[r]*(float)M_PI/16.f; // pairs cover half a turn
+        for (int k=0; k<pairs; k++) {
+            float a = rot + k*(float)M_PI/pairs;
+            float d = radius_*(k+1.f)/pairs;     // spread the pairs over the radius
+            offsets_[(r*pairs+k)*2]   = (int)std::lround(std::cos(a)*d);
+            offsets_[(r*pairs+k)*2+1] = (int)std::lround(std::sin(a)*d);
+        }
+    }
+}
+
+void SSAOPass::run(const PostTile &src, const PostTile &dst, const PostContext &ctx) const {
+    const ImageView<const Gray8> &depth = ctx.depth;
+    int w = std::min(depth.width(), dst.frame_width), h = std::min(depth.height(), dst.frame_height);
+    int pairs = samples_/2;
+    float bias = 1.f;
+    for (int y=dst.y0; y<dst.y1(); y++) {
+        for (int x=dst.x0; x<dst.x1(); x++) {
+            RGBAf c = src(x, y);
+            float dc = x<w && y<h ? depth(x, y) : 0.f;
+            float occ = 0.f;
+            if (dc>0.f) {
+                const int *o = &offsets_[(((y&3)<<2) | (x&3))*pairs*2];
+                for (int k=0; k<pairs; k++, o+=2) {
+                    int ax = std::min(w-1, std::max(0, x+o[0])), ay = std::min(h-1, std::max(0, y+o[1]));
+                    int bx = std::min(w-1, std::max(0, x-o[0])), by = std::min(h-1, std::max(0, y-o[1]));
+                    float da = depth(ax, ay) - dc, db = depth(bx, by) - dc;
+                    // a pair reaching past a silhouette (background or a far layer) says nothing
+                    if (std::fabs(da)>range_ || std::fabs(db)>range_) continue;
+                    float bend = .5f*(da+db) - bias;
+                    if (bend>0.f) occ += std::min(1.f, bend*4.f/range_);
+                }
+                occ /= pairs;
+            }
+            c.a = std::max(0.f, 1.f - strength_*occ);
+            dst(x, y) = c;
+        }
+    }
+}
+
+// per-thread scratch for passes that need a plane of their own
+static thread_local std::vector<float> plane;
+
+// separable: 4-wide row sums over the source rows, then 4-tall sums of those
+void AOBlurPass::run(const PostTile &src, const PostTile &dst, const PostContext &) const {
+    int w = dst.pixels.width();
+    int y0 = std::max(0, dst.y0-2), y1 = std::min(dst.frame_height, dst.y1()+1);
+    plane.resize((size_t)w*(y1-y0));
+    for (int y=y0; y<y1; y++) {
+        float *row = &plane[(size_t)(y-y0)*w];
+        for (int x=dst.x0; x<dst.x1(); x++)
+            row[x-dst.x0] = src.clamped(x-2, y).a + src.clamped(x-1, y).a + src.clamped(x, y).a + src.clamped(x+1, y).a;
+    }
+    for (int y=dst.y0; y<dst.y1(); y++) {
+        const float *rows[4];
+        for (int j=0; j<4; j++) rows[j] = &plane[(size_t)(std::min(y1-1, std::max(y0, y+j-2))-y0)*w];
+        for (int x=dst.x0; x<dst.x1(); x++) {
+            int i = x-dst.x0;
+            float ao = (rows[0][i] + rows[1][i] + rows[2][i] + rows[3][i])*(1.f/16.f);
+            RGBAf c = src(x, y);
+            c.r *= ao;
+            c.g *= ao;
+            c.b *= ao;
+            c.a = ao;
+            dst(x, y) = c;
+        }
+    }
+}
+
+ToneCurvePass::ToneCurvePass(float exposure) : exposure_(exposure) {}
+
+static float aces(float x) {
+    x = (x*(2.51f*x + .03f))/(x*(2.43f*x + .59f) + .14f);
+    return std::min(1.f, std::max(0.f, x));
+}
+
+void ToneCurvePass::run(const PostTile &src, const PostTile &dst, const PostContext &) const {
+    for (int y=dst.y0; y<dst.y1(); y++) {
+        for (int x=dst.x0; x<dst.x1(); x++) {
+            RGBAf c = src(x, y);
+            c.r = aces(c.r*exposure_);
+            c.g = aces(c.g*exposure_);
+            c.b = aces(c.b*exposure_);
+            dst(x, y) = c;
+        }
+    }
+}
+
+static RGBAf bilinear(const PostTile &t, float fx, float fy) {
+    int x = (int)std::floor(fx), y = (int)std::floor(fy);
+    float u = fx-x, v = fy-y;
+    const RGBAf &a = t.clamped(x, y),   &b = t.clamped(x+1, y);
+    const RGBAf &c = t.clamped(x, y+1), &d = t.clamped(x+1, y+1);
+    RGBAf res;
+    res.r = (a.r + (b.r-a.r)*u)*(1.f-v) + (c.r + (d.r-c.r)*u)*v;
+    res.g = (a.g + (b.g-a.g)*u)*(1.f-v) + (c.g + (d.g-c.g)*u)*v;
+    res.b = (a.b + (b.b-a.b)*u)*(1.f-v) + (c.b + (d.b-c.b)*u)*v;
+    res.a = (a.a + (b.a-a.a)*u)*(1.f-v) + (c.a + (d.a-c.a)*u)*v;
+    return res;
+}
+
+static RGBAf mix(const RGBAf &a, const RGBAf &b, float wa, float wb) {
+    RGBAf res = {a.r*wa + b.r*wb, a.g*wa + b.g*wb, a.b*wa + b.b*wb, a.a*wa + b.a*wb};
+    return res;
+}
+
+void FXAAPass::run(const PostTile &src, const PostTile &dst, const PostContext &) const {
+    const float reduce_mul = 1.f/8.f, reduce_min = 1.f/128.f;
+    // luma once per source pixel, the 3x3 neighbourhoods then read the plane
+    int sw = src.pixels.width();
+    plane.resize((size_t)sw*src.pixels.height());
+    for (int y=src.y0; y<src.y1(); y++)
+        for (int x=src.x0; x<src.x1(); x++)
+            plane[(size_t)(y-src.y0)*sw + (x-src.x0)] = luma(src(x, y));
+    for (int y=dst.y0; y<dst.y1(); y++) {
+        const float *up   = &plane[(size_t)(std::max(0, y-1)-src.y0)*sw] - src.x0;
+        const float *mid  = &plane[(size_t)(y-src.y0)*sw] - src.x0;
+        const float *down = &plane[(size_t)(std::min(dst.frame_height-1, y+1)-src.y0)*sw] - src.x0;
+        for (int x=dst.x0; x<dst.x1(); x++) {
+            const RGBAf &m = src(x, y);
+            int xl = std::max(0, x-1), xr = std::min(dst.frame_width-1, x+1);
+            float lnw = up[xl],   lne = up[xr];
+            float lsw = down[xl], lse = down[xr];
+            float lm = mid[x];
+            float lmin = std::min(lm, std::min(std::min(lnw, lne), std::min(lsw, lse)));
+            float lmax = std::max(lm, std::max(std::max(lnw, lne), std::max(lsw, lse)));
+            if (lmax-lmin < 1.f/32.f) { // flat area, nothing to smooth
+                dst(x, y) = m;
+                continue;
+            }
+            // perpendicular to the luma gradient
+            float dx = -((lnw + lne) - (lsw + lse));
+            float dy =  ((lnw + lsw) - (lne + lse));
+            float reduce = std::max((lnw + lne + lsw + lse)*.25f*reduce_mul, reduce_min);
+            float scale = 1.f/(std::min(std::fabs(dx), std::fabs(dy)) + reduce);
+            dx = std::min((float)SPAN, std::max(-(float)SPAN, dx*scale));
+            dy = std::min((float)SPAN, std::max(-(float)SPAN, dy*scale));
+
+            RGBAf a = mix(bilinear(src, x + dx*(1.f/3.f-.5f), y + dy*(1.f/3.f-.5f)),
+                          bilinear(src, x + dx*(2.f/3.f-.5f), y + dy*(2.f/3.f-.5f)), .5f, .5f);
+            RGBAf b = mix(a, mix(bilinear(src, x - dx*.5f, y - dy*.5f),
+                                 bilinear(src, x + dx*.5f, y + dy*.5f), .25f, .25f), .5f, 1.f);
+            float lb = luma(b);
+            dst(x, y) = (lb<lmin || lb>lmax) ? a : b;
+        }
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+
+PostProcessor::PostProcessor() : stages_(), tile_width_(128), tile_height_(128), timings_(), wall_ms_(0) {}
+
+PostProcessor PostProcessor::standard() {
+    PostProcessor p;
+    p.add(std::unique_ptr<PostPass>(new SSAOPass()));
+    p.add(std::unique_ptr<PostPass>(new AOBlurPass()));
+    p.add(std::unique_ptr<PostPass>(new ToneCurvePass()));
+    p.add(std::unique_ptr<PostPass>(new FXAAPass()));
+    return p;
+}
+
+void PostProcessor::add(std::unique_ptr<PostPass> pass, bool enabled) {
+    Stage s;
+    s.pass = std::move(pass);
+    s.enabled = enabled;
+    stages_.push_back(std::move(s));
+}
+
+bool PostProcessor::enable(const std::string &name, bool on) {
+    for (size_t i=0; i<stages_.size(); i++) {
+        if (name!=stages_[i].pass->name()) continue;
+        stages_[i].enabled = on;
+        return true;
+    }
+    return false;
+}
+
+bool PostProcessor::enabled(const std::string &name) const {
+    for (size_t i=0; i<stages_.size(); i++)
+        if (name==stages_[i].pass->name()) return stages_[i].enabled;
+    return false;
+}
+
+void PostProcessor::set_tile_size(int width, int height) {
+    tile_width_ = std::max(0, width);
+    tile_height_ = std::max(0, height);
+}
+
+std::vector<PostProcessor::Timing> PostProcessor::timings() const {
+    return timings_;
+}
+
+double PostProcessor::wall_ms() const {
+    return wall_ms_;
+}
+
+// ping-pong tile buffers, reused across frames
+static thread_local std::vector<RGBAf> scratch[2];
+
+static PostTile make_tile(std::vector<RGBAf> &buf, const Rect &r, int w, int h) {
+    buf.resize((size_t)r.width()*r.height());
+    PostTile t = {ImageView<RGBAf>(buf.data(), r.width(), r.height()), r.x0, r.y0, w, h};
+    return t;
+}
+
+void PostProcessor::process(ImageView<const RGB8> src, ImageView<const Gray8> depth, ImageView<RGB8> dst) {
+    typedef std::chrono::steady_clock clock;
+    clock::time_point start = clock::now();
+    const SRGBTables &tables = srgb();
+    int w = std::min(src.width(), dst.width()), h = std::min(src.height(), dst.height());
+
+    Arena &arena = FrameArena::local();
+    Span<const PostPass *> passes = arena.array<const PostPass *>((int)stages_.size());
+    int npasses = 0;
+    for (size_t i=0; i<stages_.size(); i++)
+        if (stages_[i].enabled) passes[npasses++] = stages_[i].pass.get();
+    // halo[i]: how far around the tile pass i has to produce output for the passes after it
+    Span<int> halo = arena.array<int>(npasses, 0);
+    int load_halo = 0;
+    for (int i=npasses-1; i>=0; i--) {
+        halo[i] = load_halo;
+        load_halo += passes[i]->radius();
+    }
+
+    int tw = tile_width_>0 ? tile_width_ : std::max(1, w);
+    int th = tile_height_>0 ? tile_height_ : std::max(1, h);
+    int nx = (w+tw-1)/tw, ny = (h+th-1)/th;
+    int counters = npasses+2;
+    Span<double> ms = arena.array<double>(std::max(0, nx*ny)*counters, 0.);
+    PostContext ctx;
+    ctx.depth = depth;
+
+    ThreadPool::instance().parallel_for(nx*ny, [&](int t) {
+        TRACE_SCOPE("post tile", t);
+        Rect frame(0, 0, w, h);
+        Rect r = Rect((t%nx)*tw, (t/nx)*th, (t%nx+1)*tw, (t/nx+1)*th).intersect(frame);
+        double *tile_ms = &ms[(size_t)t*counters];
+
+        clock::time_point t0 = clock::now();
+        Rect lr = r.grow(load_halo).intersect(frame);
+        PostTile cur = make_tile(scratch[0], lr, w, h);
+        for (int y=lr.y0; y<lr.y1; y++) {
+            const RGB8 *s = src.row(y);
+            for (int x=lr.x0; x<lr.x1; x++) {
+                RGBAf c = {tables.decode[s[x].r], tables.decode[s[x].g], tables.decode[s[x].b], 1.f};
+                cur(x, y) = c;
+            }
+        }
+        clock::time_point t1 = clock::now();
+        tile_ms[0] += std::chrono::duration<double, std::milli>(t1-t0).count();
+
+        for (int i=0; i<npasses; i++) {
+            TRACE_SCOPE(passes[i]->name(), t);
+            PostTile next = make_tile(scratch[(i+1)&1], r.grow(halo[i]).intersect(frame), w, h);
+            passes[i]->run(cur, next, ctx);
+            cur = next;
+            clock::time_point t2 = clock::now();
+            tile_ms[i+1] += std::chrono::duration<double, std::milli>(t2-t1).count();
+            t1 = t2;
+        }
+
+        for (int y=r.y0; y<r.y1; y++) {
+            RGB8 *d = dst.row(y);
+            for (int x=r.x0; x<r.x1; x++) {
+                const RGBAf &c = cur(x, y);
+                d[x].r = encode_srgb(tables, c.r);
+                d[x].g = encode_srgb(tables, c.g);
+                d[x].b = encode_srgb(tables, c.b);
+            }
+        }
+        tile_ms[npasses+1] += std::chrono::duration<double, std::milli>(clock::now()-t1).count();
+    });
+
+    timings_.assign(counters, Timing());
+    timings_[0].name = "load";
+    for (int i=0; i<npasses; i++) timings_[i+1].name = passes[i]->name();
+    timings_[npasses+1].name = "store";
+    for (int c=0; c<counters; c++) {
+        timings_[c].ms = 0;
+        for (int t=0; t<nx*ny; t++) timings_[c].ms += ms[(size_t)t*counters+c];
+    }
+    wall_ms_ = std::chrono::duration<double, std::milli>(clock::now()-start).count();
+}
@@ -0,0 +1,206 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include "../Include/presenter.h"
+#include "../Include/image_writer.h"
+#include "../Include/trace.h"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+static unsigned long long now_ns() {
+    return (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Presenter::Presenter(int width, int height, int buffers)
+    : width_(width), height_(height), slots_(std::max(2, std::min(3, buffers))), free_(), queued_(),
+      acquired_(-1), showing_(-1), submitted_(0), stop_(false), wait_ms_(0), presented_(0), last_shown_(0),
+      latency_ms_(), interval_ms_() {
+    for (size_t i = 0; i < slots_.size(); i++) {
+        slots_[i].image = TGAImage(width, height, TGAImage::RGB);
+        free_.push_back((int)i);
+    }
+    thread_ = std::thread(&Presenter::run, this);
+}
+
+Presenter::~Presenter() {
+    shutdown();
+}
+
+void Presenter::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stop_) return;
+        stop_ = true;
+    }
+    wake_.notify_all();
+    if (thread_.joinable()) thread_.join();
+}
+
+TGAImage &Presenter::acquire() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (acquired_ < 0) {
+        unsigned long long t0 = now_ns();
+        released_.wait(lock, [this] { return !free_.empty(); });
+        wait_ms_ += (now_ns() - t0)*1e-6;
+        acquired_ = free_.front();
+        free_.pop_front();
+    }
+    return slots_[acquired_].image;
+}
+
+void Presenter::present(unsigned long long input_ns) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (acquired_ < 0) return;
+        Slot &s = slots_[acquired_];
+        s.input_ns = input_ns;
+        s.number = submitted_++;
+        queued_.push_back(acquired_);
+        acquired_ = -1;
+    }
+    wake_.notify_one();
+}
+
+void Presenter::flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    released_.wait(lock, [this] { return queued_.empty() && showing_ < 0; });
+}
+
+static void record(std::vector<float> &samples, long n, int capacity, float v) {
+    if ((int)samples.size() < capacity) samples.push_back(v);
+    else samples[n % capacity] = v;
+}
+
+void Presenter::run() {
+    Trace::name_thread("presenter");
+    for (;;) {
+        int slot;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this] { return stop_ || !queued_.empty(); });
+            if (queued_.empty()) return; // stopping, nothing left to show
+            slot = queued_.front();
+            queued_.pop_front();
+            showing_ = slot;
+        }
+        Slot &s = slots_[slot];
+        {
+            TRACE_SCOPE("present", (int)s.number);
+            show(s.image, s.number);
+        }
+        unsigned long long t = now_ns();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (s.input_ns && t > s.input_ns) record(latency_ms_, presented_, SAMPLES, (t - s.input_ns)*1e-6f);
+            if (last_shown_) record(interval_ms_, presented_, SAMPLES, (t - last_shown_)*1e-6f);
+            last_shown_ = t;
+            presented_++;
+            showing_ = -1;
+            free_.push_back(slot);
+        }
+        released_.notify_all();
+    }
+}
+
+static double percentile(std::vector<float> v, double p) {
+    if (v.empty()) return 0.;
+    size_t k = std::min(v.size() - 1, (size_t)(p*(v.size() - 1) + .5));
+    std::nth_element(v.begin(), v.begin() + k, v.end());
+    return v[k];
+}
+
+Presenter::Stats Presenter::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats s;
+    s.presented = presented_;
+    s.wait_ms = wait_ms_;
+    s.latency_p50_ms = percentile(latency_ms_, .5);
+    s.latency_p99_ms = percentile(latency_ms_, .99);
+    s.interval_p50_ms = percentile(interval_ms_, .5);
+    s.interval_p99_ms = percentile(interval_ms_, .99);
+    return s;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+
+// the file pattern goes to snprintf with one int: it must hold exactly one
+// %d with optional flags and width, and no other conversion ("%%" is fine)
+static bool frame_pattern(const std::string &pattern) {
+    int conversions = 0;
+    for (size_t i = 0; i < pattern.size(); i++) {
+        if (pattern[i] != '%') continue;
+        if (++i < pattern.size() && pattern[i] == '%') continue;
+        while (i < pattern.size() && strchr("-+ 0#", pattern[i])) i++;
+        while (i < pattern.size() && pattern[i] >= '0' && pattern[i] <= '9') i++;
+        if (i >= pattern.size() || pattern[i] != 'd') return false;
+        conversions++;
+    }
+    return conversions == 1;
+}
+
+HeadlessPresenter::HeadlessPresenter(int width, int height, int buffers, const std::string &target)
+    : Presenter(width, height, buffers), target_(target), ok_(true), shm_(NULL), shm_size_(0) {
+    if (target_.compare(0, 4, "shm:") != 0) {
+        ok_ = target_.empty() || frame_pattern(target_);
+        return;
+    }
+#ifndef _WIN32
+    std::string name = target_.substr(4);
+    shm_size_ = sizeof(SharedFrameHeader) + (unsigned long)width*height*3;
+    int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd >= 0 && ftruncate(fd, shm_size_) == 0)
+        shm_ = mmap(NULL, shm_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (fd >= 0) close(fd);
+    if (shm_ == MAP_FAILED) shm_ = NULL;
+    if (shm_) {
+        SharedFrameHeader *h = (SharedFrameHeader *)shm_;
+        memcpy(h->magic, "RNDRFRM", 8);
+        h->width = width;
+        h->height = height;
+        h->seq = 0;
+        h->frame = 0;
+    }
+#endif
+    ok_ = shm_ != NULL;
+}
+
+HeadlessPresenter::~HeadlessPresenter() {
+    shutdown();
+#ifndef _WIN32
+    if (shm_) munmap(shm_, shm_size_);
+#endif
+}
+
+void HeadlessPresenter::show(TGAImage &frame, long number) {
+    if (target_.empty()) return;
+    if (shm_) {
+        // seqlock: readers retry while seq is odd or changed under them
+        SharedFrameHeader *h = (SharedFrameHeader *)shm_;
+        h->seq = h->seq + 1;
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        unsigned char *dst = (unsigned char *)shm_ + sizeof(SharedFrameHeader);
+        int stride = width()*3;
+        for (int y = 0; y < height(); y++)
+            memcpy(dst + (size_t)y*stride, frame.buffer() + (size_t)(height() - 1 - y)*stride, stride);
+        h->frame = number;
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        h->seq = h->seq + 1;
+        return;
+    }
+    char name[1024];
+    snprintf(name, sizeof(name), target_.c_str(), (int)number); // checked by frame_pattern()
+    frame.flip_vertically(); // the buffer is ours until show() returns
+    if (!write_image(frame.view(), name))
+        std::fprintf(stderr, "can't write %s\n", name);
+}
+
+#ifndef _WIN32
+Presenter *create_gdi_presenter(int, int, int, InputRing *) {
+    return NULL;
+}
+#endif
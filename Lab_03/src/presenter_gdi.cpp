@@ -0,0 +1,160 @@
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <windowsx.h>
+#include <atomic>
+#include <cstring>
+#include "../Include/presenter.h"
+
+// The window lives on its own thread with its own message loop, so a render
+// stall never freezes it. show() paints straight from the presenter buffer:
+// a bottom-up 24-bit DIB is the TGAImage layout as is (BGR, rows from the
+// bottom), only rows whose length is not a multiple of 4 bytes need padding.
+class GdiPresenter : public Presenter {
+public:
+    GdiPresenter(int width, int height, int buffers, InputRing *input)
+        : Presenter(width, height, buffers), input_(input), hwnd_(NULL), closed_(false), ready_(false) {
+        window_thread_ = std::thread(&GdiPresenter::window_loop, this);
+        std::unique_lock<std::mutex> lock(window_mutex_);
+        created_.wait(lock, [this] { return ready_; });
+        if (width*3 % 4) padded_.resize((size_t)(width*3 + 3)/4*4*height);
+    }
+
+    ~GdiPresenter() {
+        shutdown();
+        if (hwnd_) PostMessage(hwnd_, WM_CLOSE, 0, 0);
+        if (window_thread_.joinable()) window_thread_.join();
+    }
+
+    bool ok() const { return hwnd_ != NULL; }
+    bool closed() const { return closed_.load(std::memory_order_relaxed); }
+
+protected:
+    void show(TGAImage &frame, long) {
+        if (closed()) return;
+        const unsigned char *pixels = frame.buffer();
+        int stride = width()*3;
+        if (!padded_.empty()) {
+            int padded_stride = (stride + 3)/4*4;
+            for (int y = 0; y < height(); y++)
+                memcpy(&padded_[(size_t)y*padded_stride], pixels + (size_t)y*stride, stride);
+            pixels = padded_.data();
+        }
+        BITMAPINFO info = {};
+        info.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+        info.bmiHeader.biWidth = width();
+        info.bmiHeader.biHeight = height(); // positive: bottom-up
+        info.bmiHeader.biPlanes = 1;
+        info.bmiHeader.biBitCount = 24;
+        info.bmiHeader.biCompression = BI_RGB;
+        RECT client;
+        GetClientRect(hwnd_, &client);
+        HDC dc = GetDC(hwnd_);
+        StretchDIBits(dc, 0, 0, client.right, client.bottom, 0, 0, width(), height(),
+                      pixels, &info, DIB_RGB_COLORS, SRCCOPY);
+        ReleaseDC(hwnd_, dc);
+    }
+
+private:
+    void push(InputEventType type, uint16_t code, int x, int y, uint8_t flags = 0) {
+        if (!input_) return;
+        InputEvent e = {};
+        e.time = InputClockNs();
+        e.type = type;
+        e.flags = flags;
+        e.code = code;
+        e.x = x;
+        e.y = y;
+        input_->TryPush(e); // a full ring drops: the renderer is far behind anyway
+    }
+
+    static LRESULT CALLBACK window_proc(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp) {
+        GdiPresenter *self = (GdiPresenter *)GetWindowLongPtr(hwnd, GWLP_USERDATA);
+        if (msg == WM_NCCREATE) {
+            self = (GdiPresenter *)((CREATESTRUCT *)lp)->lpCreateParams;
+            SetWindowLongPtr(hwnd, GWLP_USERDATA, (LONG_PTR)self);
+        }
+        if (!self) return DefWindowProc(hwnd, msg, wp, lp);
+        switch (msg) {
+        case WM_MOUSEMOVE: {
+            int x = GET_X_LPARAM(lp), y = GET_Y_LPARAM(lp);
+            // drag with the left button orbits: relative motion, like raw input
+            if ((wp & MK_LBUTTON) && self->dragging_)
+                self->push(InputEventType::MouseDelta, 0, x - self->last_x_, y - self->last_y_);
+            self->dragging_ = (wp & MK_LBUTTON) != 0;
+            self->last_x_ = x;
+            self->last_y_ = y;
+            return 0;
+        }
+        case WM_MOUSEWHEEL:
+            self->push(InputEventType::MouseWheel, 0, 0, GET_WHEEL_DELTA_WPARAM(wp));
+            return 0;
+        case WM_KEYDOWN:
+            self->push(InputEventType::KeyDown, (uint16_t)wp, 0, 0, (lp & (1 << 30)) ? 1 : 0);
+            return 0;
+        case WM_KEYUP:
+            self->push(InputEventType::KeyUp, (uint16_t)wp, 0, 0);
+            return 0;
+        case WM_CLOSE:
+            self->closed_.store(true, std::memory_order_relaxed);
+            DestroyWindow(hwnd);
+            return 0;
+        case WM_DESTROY:
+            PostQuitMessage(0);
+            return 0;
+        }
+        return DefWindowProc(hwnd, msg, wp, lp);
+    }
+
+    void window_loop() {
+        HINSTANCE instance = GetModuleHandle(NULL);
+        WNDCLASSW wc = {};
+        wc.lpfnWndProc = window_proc;
+        wc.hInstance = instance;
+        wc.hCursor = LoadCursor(NULL, IDC_ARROW);
+        wc.lpszClassName = L"Lab03Presenter";
+        RegisterClassW(&wc);
+        RECT r = {0, 0, width(), height()};
+        AdjustWindowRect(&r, WS_OVERLAPPEDWINDOW, FALSE);
+        HWND hwnd = CreateWindowW(wc.lpszClassName, L"Lab_03", WS_OVERLAPPEDWINDOW | WS_VISIBLE,
+                                  CW_USEDEFAULT, CW_USEDEFAULT, r.right - r.left, r.bottom - r.top,
+                                  NULL, NULL, instance, this);
+        {
+            std::lock_guard<std::mutex> lock(window_mutex_);
+            hwnd_ = hwnd;
+            ready_ = true;
+        }
+        created_.notify_all();
+        if (!hwnd) {
+            closed_.store(true, std::memory_order_relaxed);
+            return;
+        }
+        MSG msg;
+        while (GetMessage(&msg, NULL, 0, 0) > 0) {
+            TranslateMessage(&msg);
+            DispatchMessage(&msg);
+        }
+        closed_.store(true, std::memory_order_relaxed);
+    }
+
+    InputRing *input_;
+    HWND hwnd_;
+    std::atomic<bool> closed_;
+    bool ready_;
+    bool dragging_ = false;
+    int last_x_ = 0, last_y_ = 0;
+    std::vector<unsigned char> padded_;
+    std::thread window_thread_;
+    std::mutex window_mutex_;
+    std::condition_variable created_;
+};
+
+Presenter *create_gdi_presenter(int width, int height, int buffers, InputRing *input) {
+    GdiPresenter *p = new GdiPresenter(width, height, buffers, input);
+    if (!p->ok()) {
+        delete p;
+        return NULL;
+    }
+    return p;
+}
+#endif
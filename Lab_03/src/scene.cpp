@@ -0,0 +1,197 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include "../Include/scene.h"
+#include "../Include/pipeline_stats.h"
+#include "../Include/trace.h"
+#include "../Include/frame_arena.h"
+#include "../Include/image_pool.h"
+
+Model *model = NULL;
+
+Vec3f light_dir(1,1,1);
+LightGrid light_grid; // списки локальных источников по тайлам
+bool light_culling = true;
+int shading_rate = 1;     // 1, 2, 4; 0 - по тайлам из разброса нормалей
+ShadingRateMap rate_map;
+float rate_threshold[2] = {.06f, .02f}; // разброс нормалей тайла: ниже [0] - 2x2, ниже [1] - 4x4
+
+// N источников вокруг головы, детерминированно; каждый четвёртый - прожектор в центр
+void scatter_lights(int n) {
+    unsigned int seed = 12345;
+    auto rnd = [&seed]() {
+        seed = seed*1664525u + 1013904223u;
+        return (seed >> 8)*(1.f/16777216.f);
+    };
+    for (int i = 0; i < n; i++) {
+        float phi = 2.f*(float)M_PI*rnd();
+        float z = rnd();
+        float r = std::sqrt(1.f - z*z);
+        Vec3f pos = Vec3f(r*std::cos(phi), r*std::sin(phi), z)*1.2f;
+        Vec3f color(rnd()*.6f, rnd()*.6f, rnd()*.6f);
+        float radius = .3f + .3f*rnd();
+        if (i % 4 == 3) add_light(Light::spot(pos, pos*-1.f, color, radius*2.f, 15.f, 30.f));
+        else            add_light(Light::point(pos, color, radius));
+    }
+}
+
+// вклад локального источника (eye space), та же модель Phong, что и у light_dir
+Vec3f local_light(const Light &l, Vec3f pos, Vec3f n, Vec3f view_dir, Vec3f tex_rgb, float shininess) {
+    Vec3f L = l.position - pos;
+    float d2 = L*L;
+    float r2 = l.radius*l.radius;
+    if (d2 >= r2 || d2 < 1e-12f) return Vec3f(0,0,0);
+    L = L / std::sqrt(d2);
+    float atten = 1.f - d2/r2;
+    atten *= atten;
+    if (l.type == Light::SPOT) {
+        float c = -(L*l.direction);
+        if (c <= l.cos_outer) return Vec3f(0,0,0);
+        float t = std::min(1.f, (c - l.cos_outer)/(l.cos_inner - l.cos_outer));
+        atten *= t*t*(3.f - 2.f*t);
+    }
+    float diff = std::max(0.f, n*L);
+    Vec3f R = n*(2.f*(n*L)) - L;
+    float spec = std::pow(std::max(0.f, R*view_dir), shininess);
+    Vec3f c = (tex_rgb*diff + Vec3f(255.f,255.f,255.f)*spec*0.5f)*atten;
+    return Vec3f(c.x*l.color.x, c.y*l.color.y, c.z*l.color.z);
+}
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// масштаб экранных координат: превью рисуются в уменьшенный кадр из тех же вершин
+Vec4f scale_xy(Vec4f v, float scale) {
+    v[0] *= scale;
+    v[1] *= scale;
+    return v;
+}
+
+// грани в полосы на пуле потоков; у каждой полосы свой шейдер с varyings из faces.
+// depth_only - только глубина (pre-pass), full - полный кадр: локальные источники и shading rate
+void draw_faces(Span<const PreparedFace> faces, ImageView<RGB8> frame, ImageView<Gray8> depth, float scale,
+                bool depth_only, bool full, TileBins &bins) {
+    {
+        STATS_TIMER(STAGE_BINNING);
+        TRACE_SCOPE("binning");
+        bins.reset(frame.width(), frame.height());
+        for (int i = 0; i < faces.size(); i++) {
+            Vec4f pts[3];
+            for (int j = 0; j < 3; j++) pts[j] = scale_xy(faces[i].pts[j], scale);
+            bins.add(i, triangle_bounds(pts));
+        }
+    }
+    STATS_TIMER(!full ? STAGE_PREVIEW : (depth_only ? STAGE_DEPTH_PREPASS : STAGE_RASTER));
+    // only the pass that shades the frame counts triangles; previews and the pre-pass don't
+    STATS_RASTERIZED(rasterized, full && !depth_only ? faces.size() : 0);
+    draw_bands(bins, [&](const Rect &band, const std::vector<int> &tris) {
+        TRACE_SCOPE(!full ? "preview band" : (depth_only ? "depth band" : "raster band"), band.y0/TileBins::BAND_ROWS);
+        Shader local;
+        local.local_lights = full;
+        if (full) {
+            local.shading_rate = shading_rate;
+            if (!shading_rate) local.rate_map = &rate_map;
+        }
+        for (size_t t = 0; t < tris.size(); t++) {
+            const PreparedFace &face = faces[tris[t]];
+            Vec4f pts[3];
+            for (int j = 0; j < 3; j++) pts[j] = scale_xy(face.pts[j], scale);
+            if (depth_only) {
+                triangle(pts, depth, band);
+            } else {
+                local.restore(face);
+                STATS_TRIANGLE(rasterized, tris[t], triangle(pts, local, frame, depth, band));
+            }
+        }
+    });
+}
+
+// Голова. vertex() считается один раз на грань, дальше все проходы берут готовые вершины.
+// С preview сначала рисуются кадры 1/8, 1/4, 1/2, каждый отдаётся в preview(scale, кадр, глубина)
+OpaqueStats render_opaque(ImageView<RGB8> frame, ImageView<Gray8> depth, TileBins &bins,
+                          const std::function<void(int, TGAImage &, TGAImage &)> &preview) {
+    OpaqueStats stats = {};
+    Shader shader;
+    // грани и суммы по тайлам живут до конца кадра, в арене кадра
+    Arena &arena = FrameArena::local();
+    Span<PreparedFace> prepared = arena.array<PreparedFace>(model->nfaces());
+    int nfaces = 0;
+    Rect screen(0, 0, frame.width(), frame.height());
+    // для shading_rate 0: сумма нормалей треугольников, задевающих тайл
+    Span<Vec3f> tile_norm = {NULL, NULL};
+    Span<int> tile_count = {NULL, NULL};
+    if (!shading_rate) {
+        rate_map.reset(frame.width(), frame.height());
+        tile_norm = arena.array<Vec3f>(rate_map.tiles_x()*rate_map.tiles_y(), Vec3f(0,0,0));
+        tile_count = arena.array<int>(tile_norm.size(), 0);
+    }
+    {
+        STATS_TIMER(STAGE_VERTEX);
+        TRACE_SCOPE("vertex");
+        for (int i = 0; i < model->nfaces(); i++) {
+            PreparedFace face;
+            for (int j = 0; j < 3; j++)
+                face.pts[j] = shader.vertex(i, j);
+            STATS_ADD(vertices_shaded, 3);
+            STATS_ADD(triangles_submitted, 1);
+            Rect full = triangle_bounds(face.pts);
+            Rect bounds = full.intersect(screen);
+            if (bounds.empty()) { // вне экрана ни в одном проходе
+                STATS_ADD(triangles_culled, 1);
+                continue;
+            }
+            STATS_ADD(triangles_clipped, bounds != full);
+            shader.save(face);
+            prepared[nfaces++] = face;
+            if (shading_rate) continue;
+            Vec3f n = shader.varying_norm.col(0) + shader.varying_norm.col(1) + shader.varying_norm.col(2);
+            for (int ty = bounds.y0/ShadingRateMap::TILE; ty <= (bounds.y1-1)/ShadingRateMap::TILE; ty++)
+                for (int tx = bounds.x0/ShadingRateMap::TILE; tx <= (bounds.x1-1)/ShadingRateMap::TILE; tx++) {
+                    tile_norm[ty*rate_map.tiles_x() + tx] = tile_norm[ty*rate_map.tiles_x() + tx] + n;
+                    tile_count[ty*rate_map.tiles_x() + tx] += 3;
+                }
+        }
+    }
+    // гладкий тайл (средняя нормаль почти единичная) - крупные блоки
+    if (!shading_rate) {
+        for (int t = 0; t < tile_norm.size(); t++) {
+            if (!tile_count[t]) continue;
+            float spread = 1.f - (tile_norm[t]/(float)tile_count[t]).norm();
+            int r = spread < rate_threshold[1] ? 4 : (spread < rate_threshold[0] ? 2 : 1);
+            rate_map.set(t % rate_map.tiles_x(), t / rate_map.tiles_x(), r);
+            stats.rate_tiles[r]++;
+        }
+    }
+
+    Span<const PreparedFace> faces = {prepared.begin(), prepared.begin() + nfaces};
+    if (preview) {
+        ImagePool &pool = ImagePool::instance();
+        for (int s = 8; s > 1; s /= 2) {
+            TGAImage image   = pool.acquire(frame.width()/s, frame.height()/s, TGAImage::RGB);
+            TGAImage zbuffer = pool.acquire(frame.width()/s, frame.height()/s, TGAImage::GRAYSCALE);
+            draw_faces(faces, image.pixels<RGB8>(), zbuffer.pixels<Gray8>(), 1.f/s, false, false, bins);
+            preview(s, image, zbuffer);
+            pool.release(std::move(image));
+            pool.release(std::move(zbuffer));
+        }
+    }
+
+    // с локальными источниками сначала только глубина: по её min/max режем источники по тайлам,
+    // а полный шейдер потом выполняется один раз на пиксель
+    if (!Lights.empty()) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        draw_faces(faces, frame, depth, 1.f, true, true, bins);
+        {
+            STATS_TIMER(STAGE_LIGHT_CULLING);
+            TRACE_SCOPE("light culling");
+            light_grid.build(Lights, depth, light_culling);
+        }
+        stats.lights = light_grid.stats();
+        stats.light_ms = elapsed_ms(start);
+    } else {
+        light_grid.clear();
+    }
+    draw_faces(faces, frame, depth, 1.f, false, true, bins);
+    return stats;
+}
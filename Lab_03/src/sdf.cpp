@@ -0,0 +1,407 @@
+#include <cmath>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include "../Include/sdf.h"
+#include "../Include/simd8.h"
+
+SdfScene::SdfScene() : mouse(-1, -1), turret(0, 0), bullet(0, 0, 0), bullet_live(false), craters(), crater_grid() {
+    animate(0.f);
+}
+
+void SdfScene::animate(float t) {
+    const int index[2] = {3, 5};
+    for (int k=0; k<2; k++) {
+        float i = (float)index[k];
+        Plane &pl = planes[k];
+        pl.pos = Vec3f(std::sin(t)*i, 0.f, std::cos(t)*i);
+        // buffer C takes the direction from the last frame's position: the tangent of the circle
+        pl.dir = Vec3f(std::cos(t), 0.f, -std::sin(t));
+        pl.right = cross(Vec3f(0, 1, 0), pl.dir).normalize();
+        pl.up = cross(pl.dir, pl.right).normalize();
+        // the bomb drops from under the plane with gravity 1 until it reaches y = -5
+        float fall = std::fmod(t, std::sqrt(2.f*4.7f));
+        pl.bomb = pl.pos - Vec3f(0.f, .3f + .5f*fall*fall, 0.f);
+    }
+}
+
+void SdfScene::scatter_craters(int n) {
+    unsigned int seed = 2024;
+    craters.clear();
+    for (int i=0; i<n; i++) {
+        seed = seed*1664525u + 1013904223u;
+        float x = (seed >> 8)*(1.f/16777216.f);
+        seed = seed*1664525u + 1013904223u;
+        float z = (seed >> 8)*(1.f/16777216.f);
+        craters.push_back(Vec3f(x*24.f - 12.f, -.4f, z*24.f - 6.f));
+    }
+    index_craters();
+}
+
+void SdfScene::index_craters() {
+    crater_grid.update(craters);
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+
+CraterGrid::CraterGrid() : x0_(0), z0_(0), cell_(CELL), inv_cell_(1.f/CELL), nx_(0), nz_(0), indexed_(), cells_() {}
+
+void CraterGrid::build(const std::vector<Vec3f> &craters) {
+    indexed_.clear();
+    cells_.clear();
+    nx_ = nz_ = 0;
+    if (craters.empty()) return;
+    float x1 = craters[0].x, z1 = craters[0].z;
+    x0_ = x1; z0_ = z1;
+    for (size_t i=1; i<craters.size(); i++) {
+        x0_ = std::min(x0_, craters[i].x); x1 = std::max(x1, craters[i].x);
+        z0_ = std::min(z0_, craters[i].z); z1 = std::max(z1, craters[i].z);
+    }
+    x0_ -= RADIUS; z0_ -= RADIUS;
+    x1 += RADIUS; z1 += RADIUS;
+    cell_ = std::max(CELL, std::sqrt((x1 - x0_)*(z1 - z0_)/MAX_CELLS));
+    inv_cell_ = 1.f/cell_;
+    nx_ = (int)((x1 - x0_)*inv_cell_) + 1;
+    nz_ = (int)((z1 - z0_)*inv_cell_) + 1;
+    cells_.resize(nx_*nz_);
+    for (size_t i=0; i<craters.size(); i++) insert(craters[i], (int)i);
+    indexed_ = craters;
+}
+
+void CraterGrid::update(const std::vector<Vec3f> &craters) {
+    bool same = craters.size() >= indexed_.size();
+    for (size_t i=0; same && i<indexed_.size(); i++)
+        same = craters[i].x == indexed_[i].x && craters[i].z == indexed_[i].z;
+    if (!same) {
+        build(craters);
+        return;
+    }
+    for (size_t i=indexed_.size(); i<craters.size(); i++) {
+        if (!insert(craters[i], (int)i)) {
+            build(craters);
+            return;
+        }
+        indexed_.push_back(craters[i]);
+    }
+}
+
+// into every cell the bump's square reaches; false when that leaves the grid
+bool CraterGrid::insert(const Vec3f &c, int index) {
+    if (!nx_) return false;
+    float fx0 = (c.x - RADIUS - x0_)*inv_cell_, fx1 = (c.x + RADIUS - x0_)*inv_cell_;
+    float fz0 = (c.z - RADIUS - z0_)*inv_cell_, fz1 = (c.z + RADIUS - z0_)*inv_cell_;
+    if (fx0 < 0.f || fz0 < 0.f || fx1 >= nx_ || fz1 >= nz_) return false;
+    Entry e = {c.x, c.z, index};
+    for (int z=(int)fz0; z<=(int)fz1; z++)
+        for (int x=(int)fx0; x<=(int)fx1; x++)
+            cells_[z*nx_ + x].push_back(e);
+    return true;
+}
+
+long CraterGrid::references() const {
+    long n = 0;
+    for (size_t i=0; i<cells_.size(); i++) n += (long)cells_[i].size();
+    return n;
+}
+
+// rotateX/rotateY of Image.txt applied as v *= m
+static Vec3f rotate_x(Vec3f v, float a) {
+    float c = std::cos(a), s = std::sin(a);
+    return Vec3f(v.x, c*v.y - s*v.z, s*v.y + c*v.z);
+}
+
+static Vec3f rotate_y(Vec3f v, float a) {
+    float c = std::cos(a), s = std::sin(a);
+    return Vec3f(c*v.x + s*v.z, v.y, -s*v.x + c*v.z);
+}
+
+// per-frame constants of map()
+struct SceneConsts {
+    const SdfScene *scene;
+    const CraterGrid *grid; // NULL: every crater at every sample
+    Vec3f barrel; // player's turret direction from the keyboard angles
+};
+
+static const float SHADOW_K = 8.f;
+static const float SHADOW_MIN = .02f;
+static const float SHADOW_MAX = 10.f;
+
+static Vec3f sun_dir() {
+    return Vec3f(.5f, 1.f, -.7f).normalize();
+}
+
+// per-lane state of the primary march; depth is where the last map() was taken
+struct March {
+    float depth;
+    float last;
+    int steps;
+};
+
+struct Shadow {
+    float t, res, ph;
+    int steps;
+    bool done;
+};
+
+/////////////////////////////////////////////////////////////////////////////////
+
+struct SdfCamera {
+    Vec3f ro;
+    float mx, my;
+    int width, height;
+
+    Vec3f ray(float fx, float fy, float &uvy) const {
+        float ux = (fx*2.f - width)/height, uy = (fy*2.f - height)/height;
+        uvy = uy;
+        Vec3f rd = Vec3f(ux*SdfScene::FOV, uy*SdfScene::FOV, 1.f).normalize();
+        return rotate_y(rotate_x(rd, -my*3.14159f), -mx*6.28318f);
+    }
+};
+
+// counters of one tile, summed at the end
+struct TileStats {
+    long shadow_rays;
+    long packets;
+    long fallback_rays;
+};
+
+// per ray, further down; a packet hands its diverged lanes to them
+static void march_scalar(const SceneConsts &c, Vec3f ro, Vec3f rd, March &m);
+static void shadow_scalar(const SceneConsts &c, Vec3f ro, Vec3f rd, Shadow &s);
+static Vec3f shade(const SceneConsts &c, Vec3f ro, Vec3f rd, float uvy, float depth, float last, Vec3f n, float shadow);
+static void store(RGB8 &px, Vec3f col);
+
+/////////////////////////////////////////////////////////////////////////////////
+// sdf_lanes.h twice: the portable lanes for the scalar code and any CPU, and
+// AVX2 lanes for the packets when the CPU has it, whatever the build flags.
+// The lanes' own vabs(V3) would hide the scalar and F8 ones, hence the usings
+
+namespace {
+namespace lanes_generic {
+using namespace simd8_generic;
+using simd8_generic::vabs;
+using ::vabs;
+#include "sdf_lanes.h"
+}
+
+#ifdef SIMD8_AVX2
+SIMD8_AVX2_BEGIN
+namespace lanes_avx2 {
+using namespace simd8_avx2;
+using simd8_avx2::vabs;
+using ::vabs;
+#include "sdf_lanes.h"
+}
+SIMD8_AVX2_END
+#endif
+}
+
+using namespace lanes_generic;
+
+/////////////////////////////////////////////////////////////////////////////////
+// materials and lighting, per ray
+
+static float hash(float x, float y) {
+    float h = std::sin(x*127.1f + y*311.7f)*43758.5453f;
+    return h - std::floor(h);
+}
+
+static int tank_material(const TankParts<float> &t, float d, int sphere, int box) {
+    if (d==t.sphere) return sphere;
+    if (d==t.box) return box;
+    if (d==t.cylinder) return 4;
+    if (d==t.track) return 5;
+    if (d==t.wheel) return 6;
+    return 0;
+}
+
+// the material chain of map()
+static int material(const SceneConsts &c, Vec3f p) {
+    SceneDist<float> r = scene_parts(c, V3<float>(p));
+    float d = r.min();
+    if (d==r.ground) return 1;
+    if (d==r.player.min()) return tank_material(r.player, d, 2, 3);
+    if (d==r.enemy.min()) return tank_material(r.enemy, d, 7, 8);
+    if (d==r.bullet) return 9;
+    // both planes take the material of sdFly(.., 3), as in the shader
+    if (d==vmin(r.fly[0], r.bomb[0]) || d==vmin(r.fly[1], r.bomb[1])) return r.fly[0] <= r.bomb[0] ? 10 : 0;
+    return 0;
+}
+
+static Vec3f crater_color(const Vec3f &h) {
+    return Vec3f(.4f + .5f*hash(h.x, h.y), .4f + .5f*hash(h.y, h.z), .2f + .5f*hash(h.z, h.x));
+}
+
+// the first crater whose bump is above .1 here; that is well inside RADIUS,
+// so the cell's list, kept in crater order, finds the same one
+static Vec3f ground_color(const SceneConsts &c, Vec3f p) {
+    const std::vector<Vec3f> &cr = c.scene->craters;
+    if (!c.grid) {
+        for (size_t k=0; k<cr.size(); k++)
+            if (crater_bump(p.x, p.z, cr[k].x, cr[k].z) > .1f) return crater_color(cr[k]);
+    } else {
+        int cell = c.grid->cell(p.x, p.z);
+        if (cell >= 0) {
+            Span<const CraterGrid::Entry> e = c.grid->entries(cell);
+            for (int k=0; k<e.size(); k++)
+                if (crater_bump(p.x, p.z, e[k].x, e[k].z) > .1f) return crater_color(cr[e[k].index]);
+        }
+    }
+    return Vec3f(0.f, .9f, 0.f);
+}
+
+static Vec3f material_color(const SceneConsts &c, int m, Vec3f p) {
+    switch (m) {
+        case 1:  return ground_color(c, p);
+        case 2:  return Vec3f(0.f, .6f, 0.f);  // башня
+        case 3:  return Vec3f(0.f, .6f, 0.f);  // корпус
+        case 4:  return Vec3f(.3f, .3f, .3f);  // ствол
+        case 5:  return Vec3f(.1f, .1f, .1f);  // гусеница
+        case 6:  return Vec3f(0.f, .3f, 0.f);  // колёса
+        case 7:  return Vec3f(5.f, 0.f, 0.f);  // башня противника
+        case 8:  return Vec3f(8.f, 0.f, 0.f);  // корпус противника
+        case 9:  return Vec3f(1.f, 1.f, 0.f);  // пули
+        case 10: return Vec3f(1.f, 0.f, 0.f);  // самолёты
+    }
+    return Vec3f(1.f, 1.f, 1.f);
+}
+
+static void march_scalar(const SceneConsts &c, Vec3f ro, Vec3f rd, March &m) {
+    for (; m.steps < SdfScene::MAX_MARCHING_STEPS; m.steps++) {
+        float d = map(c, V3<float>(ro + rd*m.depth));
+        m.last = m.depth;
+        m.depth += d;
+        if (d < SdfScene::PRECISION || m.depth > SdfScene::MAX_DIST) {
+            m.steps++;
+            return;
+        }
+    }
+}
+
+static void shadow_scalar(const SceneConsts &c, Vec3f ro, Vec3f rd, Shadow &s) {
+    for (; !s.done && s.steps < SdfScene::MAX_SHADOW_STEPS && s.t < SHADOW_MAX; s.steps++) {
+        float h = map(c, V3<float>(ro + rd*s.t));
+        if (h < SdfScene::PRECISION) {
+            s.res = 0.f;
+            s.done = true;
+            return;
+        }
+        float y = h*h/(2.f*s.ph);
+        float d = std::sqrt(h*h - y*y);
+        s.res = vmin(SHADOW_K*d/vmax(0.f, s.t - y), s.res);
+        s.ph = h;
+        s.t += h;
+    }
+    s.done = true;
+}
+
+static Vec3f normal_scalar(const SceneConsts &c, Vec3f p) {
+    const float e = .0005f;
+    Vec3f n = Vec3f(e, -e, -e)*map(c, V3<float>(p + Vec3f(e, -e, -e)))
+            + Vec3f(-e, -e, e)*map(c, V3<float>(p + Vec3f(-e, -e, e)))
+            + Vec3f(-e, e, -e)*map(c, V3<float>(p + Vec3f(-e, e, -e)))
+            + Vec3f(e, e, e)*map(c, V3<float>(p + Vec3f(e, e, e)));
+    return n.normalize();
+}
+
+// mainImage after the march: material, sun with soft shadow, fog; or the sky
+static Vec3f shade(const SceneConsts &c, Vec3f ro, Vec3f rd, float uvy, float depth, float last, Vec3f n, float shadow) {
+    if (depth >= SdfScene::MAX_DIST)
+        return Vec3f(.5f, .7f, 1.f)*(1.f - (uvy*.5f + .5f)) + Vec3f(1.f, 1.f, 1.f)*(uvy*.5f + .5f);
+    Vec3f p = ro + rd*depth;
+    Vec3f color = material_color(c, material(c, ro + rd*last), p);
+    float diff = std::max(n*sun_dir(), 0.f);
+    float half_lambert = diff*.5f + .5f;
+    Vec3f sun(1.f, .98f, .95f);
+    float k = half_lambert*half_lambert*shadow;
+    Vec3f col(color.x*sun.x*k, color.y*sun.y*k, color.z*sun.z*k);
+    float fog = std::exp(-depth*.02f);
+    return col*fog*fog + Vec3f(.7f, .8f, 1.f)*(1.f - fog);
+}
+
+static void store(RGB8 &px, Vec3f col) {
+    px.r = (unsigned char)(std::min(std::max(col.x, 0.f), 1.f)*255.f + .5f);
+    px.g = (unsigned char)(std::min(std::max(col.y, 0.f), 1.f)*255.f + .5f);
+    px.b = (unsigned char)(std::min(std::max(col.z, 0.f), 1.f)*255.f + .5f);
+}
+
+static void render_pixel(const SceneConsts &c, const SdfCamera &cam, ImageView<RGB8> frame, int x, int y, TileStats &st) {
+    float uvy;
+    Vec3f rd = cam.ray(x + .5f, y + .5f, uvy);
+    March m = {SdfScene::MIN_DIST, SdfScene::MIN_DIST, 0};
+    march_scalar(c, cam.ro, rd, m);
+    Vec3f n(0, 1, 0);
+    float shadow = 1.f;
+    if (m.depth < SdfScene::MAX_DIST) {
+        Vec3f p = cam.ro + rd*m.depth;
+        n = normal_scalar(c, p);
+        Shadow s = {SHADOW_MIN, 1.f, 1e20f, 0, false};
+        shadow_scalar(c, p + n*.01f, sun_dir(), s);
+        shadow = s.res;
+        st.shadow_rays++;
+    }
+    store(frame(x, y), shade(c, cam.ro, rd, uvy, m.depth, m.last, n, shadow));
+}
+
+SdfStats render_sdf(const SdfScene &scene, ImageView<RGB8> frame, ThreadPool &pool, bool packets, bool crater_grid) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    SceneConsts c;
+    c.scene = &scene;
+    c.grid = NULL;
+    CraterGrid local; // for craters changed without index_craters()
+    if (crater_grid && !scene.craters.empty()) {
+        c.grid = &scene.crater_grid;
+        if (scene.crater_grid.size() != (int)scene.craters.size()) {
+            local.build(scene.craters);
+            c.grid = &local;
+        }
+    }
+    c.barrel = rotate_y(rotate_x(Vec3f(0.f, .5f, 1.25f), scene.turret.y), scene.turret.x);
+
+    SdfCamera cam;
+    cam.width = frame.width();
+    cam.height = frame.height();
+    Vec2f mouse = scene.mouse.x < 0 ? Vec2f(cam.width*.5f, cam.height*.5f) : scene.mouse;
+    cam.mx = (mouse.x*2.f - cam.width)/cam.height;
+    cam.my = (mouse.y*2.f - cam.height)/cam.height;
+    cam.ro = rotate_y(rotate_x(Vec3f(0.f, 0.f, -10.f), -cam.my*3.14159f), -cam.mx*6.28318f);
+
+    const int TILE = 32;
+    int tiles_x = (frame.width()+TILE-1)/TILE, tiles_y = (frame.height()+TILE-1)/TILE;
+    std::atomic<long> shadow_rays(0), npackets(0), fallback(0);
+    void (*packet)(const SceneConsts &, const SdfCamera &, ImageView<RGB8>, int, int, TileStats &) = render_packet;
+    bool avx2 = false;
+#ifdef SIMD8_AVX2
+    if (simd8_cpu_avx2()) {
+        packet = lanes_avx2::render_packet;
+        avx2 = true;
+    }
+#endif
+    pool.parallel_for(tiles_x*tiles_y, [&](int t) {
+        TileStats st = {0, 0, 0};
+        int x0 = (t % tiles_x)*TILE, y0 = (t / tiles_x)*TILE;
+        int x1 = std::min(frame.width(), x0+TILE), y1 = std::min(frame.height(), y0+TILE);
+        if (packets) {
+            for (int y=y0; y<y1; y+=2)
+                for (int x=x0; x<x1; x+=4)
+                    packet(c, cam, frame, x, y, st);
+        } else {
+            for (int y=y0; y<y1; y++)
+                for (int x=x0; x<x1; x++)
+                    render_pixel(c, cam, frame, x, y, st);
+        }
+        shadow_rays += st.shadow_rays;
+        npackets += st.packets;
+        fallback += st.fallback_rays;
+    });
+
+    SdfStats s;
+    s.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    s.primary_rays = (long)frame.width()*frame.height();
+    s.shadow_rays = shadow_rays;
+    s.packets = npackets;
+    s.crater_refs = c.grid ? c.grid->references() : 0;
+    s.fallback_rays = fallback;
+    s.avx2 = packets && avx2;
+    return s;
+}
@@ -0,0 +1,261 @@
+// The scene distance, written once for a lane type F: float or F8, and the
+// 8-wide packet marcher. No include guard: sdf.cpp includes this twice, into
+// a namespace using simd8_generic and into one using simd8_avx2, so each F8
+// gets its own copy of every function here.
+
+template<class F> struct V3 {
+    F x, y, z;
+    V3() {}
+    V3(F a, F b, F c) : x(a), y(b), z(c) {}
+    V3(const Vec3f &v) : x(v.x), y(v.y), z(v.z) {}
+};
+
+template<class F> static inline V3<F> operator+(const V3<F> &a, const V3<F> &b) { return V3<F>(a.x+b.x, a.y+b.y, a.z+b.z); }
+template<class F> static inline V3<F> operator-(const V3<F> &a, const V3<F> &b) { return V3<F>(a.x-b.x, a.y-b.y, a.z-b.z); }
+template<class F> static inline V3<F> operator*(const V3<F> &a, F s) { return V3<F>(a.x*s, a.y*s, a.z*s); }
+template<class F> static inline F dot(const V3<F> &a, const V3<F> &b) { return a.x*b.x + a.y*b.y + a.z*b.z; }
+template<class F> static inline F length(const V3<F> &a) { return vsqrt(dot(a, a)); }
+template<class F> static inline F length(F x, F y) { return vsqrt(x*x + y*y); }
+template<class F> static inline V3<F> vabs(const V3<F> &a) { return V3<F>(vabs(a.x), vabs(a.y), vabs(a.z)); }
+template<class F> static inline V3<F> vmax0(const V3<F> &a) { return V3<F>(vmax(a.x, F(0.f)), vmax(a.y, F(0.f)), vmax(a.z, F(0.f))); }
+
+template<class F> static inline F sd_sphere(const V3<F> &p, float r) {
+    return length(p) - F(r);
+}
+
+template<class F> static inline F sd_box(const V3<F> &p, const Vec3f &b) {
+    V3<F> q = vabs(p) - V3<F>(b);
+    return length(vmax0(q)) + vmin(vmax(q.x, vmax(q.y, q.z)), F(0.f));
+}
+
+template<class F> static inline F sd_cylinder(const V3<F> &p, const Vec3f &a, const Vec3f &b, float r) {
+    Vec3f ba = b - a;
+    V3<F> pa = p - V3<F>(a);
+    float baba = ba*ba;
+    F paba = dot(pa, V3<F>(ba));
+    F x = length(pa*F(baba) - V3<F>(ba)*paba) - F(r*baba);
+    F y = vabs(paba - F(baba*.5f)) - F(baba*.5f);
+    F x2 = x*x;
+    F y2 = y*y*F(baba);
+    F zero(0.f);
+    F d = select(vmax(x, y) < zero, -vmin(x2, y2), select(x > zero, x2, zero) + select(y > zero, y2, zero));
+    F s = vsqrt(vabs(d));
+    return select(d < zero, -s, s)*F(1.f/baba);
+}
+
+template<class F> static inline F sd_rounded_cylinder(const V3<F> &p, float ra, float rb, float h) {
+    F dx = length(p.y, p.z) - F(ra - rb);
+    F dy = vabs(p.x) - F(h - rb);
+    return vmin(vmax(dx, dy), F(0.f)) + length(vmax(dx, F(0.f)), vmax(dy, F(0.f))) - F(rb);
+}
+
+template<class F> static inline F sd_link(const V3<F> &p, float le, float r1, float r2) {
+    F qy = vmax(vabs(p.z) - F(le), F(0.f));
+    return length(length(p.y, qy) - F(r1), p.x) - F(r2);
+}
+
+// sdPlayer/sdEnemy, one distance per part
+template<class F> struct TankParts {
+    F sphere, cylinder, box, wheel, track;
+    F min() const { return vmin(sphere, vmin(cylinder, vmin(box, vmin(wheel, track)))); }
+};
+
+template<class F> static inline TankParts<F> sd_tank(const V3<F> &p, const Vec3f &barrel) {
+    TankParts<F> t;
+    t.sphere = sd_sphere(p*F(2.f) - V3<F>(Vec3f(0.f, .5f, 0.f)), 1.f)*F(.5f);
+    t.cylinder = sd_cylinder(p, Vec3f(0.f, .5f, 0.f), barrel, .1f);
+    t.box = sd_box(p*F(2.f), Vec3f(1.5f, .5f, 2.f))*F(.5f);
+    F wheel = sd_rounded_cylinder(p - V3<F>(Vec3f(0.f, 0.f, -.8f)), .2f, .1f, .9f);
+    for (int i=-1; i<=2; i++)
+        wheel = vmin(wheel, sd_rounded_cylinder(p - V3<F>(Vec3f(0.f, 0.f, .4f*i)), .2f, .1f, .9f));
+    t.wheel = wheel;
+    t.track = vmin(sd_link(p - V3<F>(Vec3f(.8f, 0.f, 0.f)), .85f, .25f, .1f),
+                   sd_link(p - V3<F>(Vec3f(-.8f, 0.f, 0.f)), .85f, .25f, .1f));
+    return t;
+}
+
+// sdFly: airframe and bomb. p is relative to (0, 3, 0)
+template<class F> static inline void sd_fly(const V3<F> &p, const SdfScene::Plane &pl, F &airframe, F &bomb) {
+    V3<F> d = p - V3<F>(pl.pos);
+    V3<F> local(dot(d, V3<F>(pl.right)), dot(d, V3<F>(pl.up)), dot(d, V3<F>(pl.dir)));
+    F wings     = sd_box(local, Vec3f(.5f, .02f, .2f));
+    F body      = sd_box(local + V3<F>(Vec3f(0.f, 0.f, .2f)), Vec3f(.1f, .07f, .6f));
+    F propeller = sd_box(local + V3<F>(Vec3f(0.f, 0.f, -.4f)), Vec3f(.2f, .1f, .05f));
+    airframe = vmin(vmin(body, wings), propeller);
+    bomb = sd_sphere(p - V3<F>(pl.bomb), .08f);
+}
+
+template<class F> struct SceneDist {
+    F ground, bullet;
+    TankParts<F> player, enemy;
+    F fly[2], bomb[2];
+    F min() const {
+        F d = vmin(ground, vmin(player.min(), enemy.min()));
+        for (int k=0; k<2; k++) d = vmin(d, vmin(fly[k], bomb[k]));
+        return vmin(d, bullet);
+    }
+};
+
+static inline float crater_bump(float x, float z, float cx, float cz) {
+    float dx = x - cx, dz = z - cz;
+    return .6f*vexp((dx*dx + dz*dz)*-2.f);
+}
+
+static inline F8 crater_bump(F8 x, F8 z, float cx, float cz) {
+    F8 dx = x - F8(cx), dz = z - F8(cz);
+    return F8(.6f)*vexp((dx*dx + dz*dz)*F8(-2.f));
+}
+
+// sum of the crater bumps under (x, z), in crater order
+static inline float crater_bumps(const SceneConsts &c, float x, float z) {
+    float sum = 0.f;
+    if (!c.grid) {
+        const std::vector<Vec3f> &cr = c.scene->craters;
+        for (size_t k=0; k<cr.size(); k++) sum += crater_bump(x, z, cr[k].x, cr[k].z);
+        return sum;
+    }
+    int cell = c.grid->cell(x, z);
+    if (cell < 0) return sum;
+    Span<const CraterGrid::Entry> e = c.grid->entries(cell);
+    for (int k=0; k<e.size(); k++) sum += crater_bump(x, z, e[k].x, e[k].z);
+    return sum;
+}
+
+// lanes in the same cell share one pass over its list; the others add 0 meanwhile
+static inline F8 crater_bumps(const SceneConsts &c, F8 x, F8 z) {
+    F8 sum(0.f);
+    if (!c.grid) {
+        const std::vector<Vec3f> &cr = c.scene->craters;
+        for (size_t k=0; k<cr.size(); k++) sum += crater_bump(x, z, cr[k].x, cr[k].z);
+        return sum;
+    }
+    float xs[8], zs[8];
+    x.store(xs);
+    z.store(zs);
+    int cells[8], pending = 0;
+    for (int i=0; i<8; i++) {
+        cells[i] = c.grid->cell(xs[i], zs[i]);
+        if (cells[i] >= 0) pending |= 1 << i;
+    }
+    while (pending) {
+        int cell = cells[__builtin_ctz(pending)], lanes = 0;
+        for (int i=0; i<8; i++)
+            if (cells[i] == cell) lanes |= 1 << i;
+        pending &= ~lanes;
+        Span<const CraterGrid::Entry> e = c.grid->entries(cell);
+        if (lanes == 0xff) {
+            for (int k=0; k<e.size(); k++) sum += crater_bump(x, z, e[k].x, e[k].z);
+        } else {
+            Mask8 m = Mask8::lanes(lanes);
+            for (int k=0; k<e.size(); k++) sum += select(m, crater_bump(x, z, e[k].x, e[k].z), F8(0.f));
+        }
+    }
+    return sum;
+}
+
+template<class F> static inline SceneDist<F> scene_parts(const SceneConsts &c, const V3<F> &p) {
+    const SdfScene &s = *c.scene;
+    SceneDist<F> r;
+    r.player = sd_tank(p, c.barrel);
+    r.enemy = sd_tank(p + V3<F>(Vec3f(10.f, 0.f, 10.f)), Vec3f(0.f, .5f, 1.25f));
+    V3<F> fp = p - V3<F>(Vec3f(0.f, 3.f, 0.f));
+    for (int k=0; k<2; k++) sd_fly(fp, s.planes[k], r.fly[k], r.bomb[k]);
+    r.ground = p.y + F(.4f) + crater_bumps(c, p.x, p.z);
+    r.bullet = s.bullet_live ? sd_sphere(p - V3<F>(s.bullet), .08f) : F(SdfScene::MAX_DIST);
+    return r;
+}
+
+template<class F> static inline F map(const SceneConsts &c, const V3<F> &p) {
+    return scene_parts(c, p).min();
+}
+
+// lanes still marching when the packet gives up on SIMD
+static const int PACKET_MIN_ACTIVE = 3;
+
+static void render_packet(const SceneConsts &c, const SdfCamera &cam, ImageView<RGB8> frame, int bx, int by, TileStats &st) {
+    float dx[8], dy[8], dz[8], uvy[8];
+    for (int i=0; i<8; i++) {
+        Vec3f rd = cam.ray(bx + (i&3) + .5f, by + (i>>2) + .5f, uvy[i]);
+        dx[i] = rd.x; dy[i] = rd.y; dz[i] = rd.z;
+    }
+    V3<F8> ro(F8(cam.ro.x), F8(cam.ro.y), F8(cam.ro.z));
+    V3<F8> rd(F8::load(dx), F8::load(dy), F8::load(dz));
+    st.packets++;
+
+    // primary rays, 8 at a time while enough of them are still going
+    F8 depth(SdfScene::MIN_DIST), last(SdfScene::MIN_DIST);
+    int active = 0xff, steps = 0;
+    for (; steps < SdfScene::MAX_MARCHING_STEPS && __builtin_popcount(active) >= PACKET_MIN_ACTIVE; steps++) {
+        F8 d = map(c, ro + rd*depth);
+        Mask8 live = Mask8::lanes(active);
+        last = select(live, depth, last);
+        depth = select(live, depth + d, depth);
+        active &= ~((d < F8(SdfScene::PRECISION)) | (depth > F8(SdfScene::MAX_DIST))).bits();
+    }
+    float depv[8], lv[8];
+    depth.store(depv);
+    last.store(lv);
+    for (int i=0; i<8; i++) {
+        if (!(active >> i & 1)) continue;
+        March m = {depv[i], lv[i], steps};
+        march_scalar(c, cam.ro, Vec3f(dx[i], dy[i], dz[i]), m);
+        depv[i] = m.depth;
+        lv[i] = m.last;
+        st.fallback_rays++;
+    }
+
+    // normals and shadows of the lanes that hit, again 8-wide
+    int hit = 0;
+    for (int i=0; i<8; i++)
+        if (depv[i] < SdfScene::MAX_DIST) hit |= 1 << i;
+    float nx[8], ny[8], nz[8], shadow[8];
+    for (int i=0; i<8; i++) {
+        nx[i] = 0.f; ny[i] = 1.f; nz[i] = 0.f; shadow[i] = 1.f;
+    }
+    if (hit) {
+        V3<F8> p = ro + rd*F8::load(depv);
+        const float e = .0005f;
+        const Vec3f k[4] = {Vec3f(e, -e, -e), Vec3f(-e, -e, e), Vec3f(-e, e, -e), Vec3f(e, e, e)};
+        V3<F8> n(F8(0.f), F8(0.f), F8(0.f));
+        for (int j=0; j<4; j++)
+            n = n + V3<F8>(k[j])*map(c, p + V3<F8>(k[j]));
+        F8 inv = F8(1.f)/length(n);
+        n = n*inv;
+        n.x.store(nx); n.y.store(ny); n.z.store(nz);
+
+        Vec3f sd = sun_dir();
+        V3<F8> so = p + n*F8(.01f), srd(sd);
+        F8 t(SHADOW_MIN), res(1.f), ph(1e20f);
+        int going = hit, ssteps = 0;
+        for (; ssteps < SdfScene::MAX_SHADOW_STEPS && __builtin_popcount(going) >= PACKET_MIN_ACTIVE; ssteps++) {
+            F8 h = map(c, so + srd*t);
+            F8 y = h*h/(F8(2.f)*ph);
+            F8 dd = vsqrt(h*h - y*y);
+            Mask8 live = Mask8::lanes(going);
+            Mask8 blocked = live & (h < F8(SdfScene::PRECISION));
+            res = select(blocked, F8(0.f), select(live, vmin(F8(SHADOW_K)*dd/vmax(F8(0.f), t - y), res), res));
+            ph = select(live, h, ph);
+            t = select(live, t + h, t);
+            going &= ~(blocked | ~(t < F8(SHADOW_MAX))).bits();
+        }
+        float tv[8], rv[8], pv[8];
+        t.store(tv); res.store(rv); ph.store(pv);
+        for (int i=0; i<8; i++) {
+            if (going >> i & 1) {
+                Shadow s = {tv[i], rv[i], pv[i], ssteps, false};
+                shadow_scalar(c, Vec3f(so.x[i], so.y[i], so.z[i]), sd, s);
+                rv[i] = s.res;
+                st.fallback_rays++;
+            }
+            shadow[i] = rv[i];
+        }
+        st.shadow_rays += __builtin_popcount(hit);
+    }
+
+    for (int i=0; i<8; i++) {
+        int x = bx + (i&3), y = by + (i>>2);
+        if (x >= frame.width() || y >= frame.height()) continue;
+        store(frame(x, y), shade(c, cam.ro, Vec3f(dx[i], dy[i], dz[i]), uvy[i], depv[i], lv[i],
+                                 Vec3f(nx[i], ny[i], nz[i]), shadow[i]));
+    }
+}
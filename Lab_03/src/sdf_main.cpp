@@ -0,0 +1,114 @@
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <thread>
+#include <chrono>
+
+#include "../Include/tgaimage.h"
+#include "../Include/thread_pool.h"
+#include "../Include/sdf.h"
+
+// Сцена Lab_02 без ShaderToy: рендер в TGA и Mrays/s
+int main(int argc, char** argv) {
+    int width = 800, height = 450;
+    float time = 0.f;
+    int ncraters = 8;
+    bool packets = true;
+    bool sweep = false;
+    int frames = 0;
+    bool crater_grid = true;
+    bool crater_sweep = false;
+    std::vector<Vec3i> holds; // клавиша, первый и последний кадр
+    const char *out = "sdf.tga";
+    SdfScene scene;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--size") && i+1 < argc) sscanf(argv[++i], "%dx%d", &width, &height);
+        else if (!strcmp(argv[i], "--time") && i+1 < argc) time = atof(argv[++i]); // iTime для самолётов и бомб
+        else if (!strcmp(argv[i], "--craters") && i+1 < argc) ncraters = std::max(0, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--mouse") && i+2 < argc) { // iMouse в пикселях
+            scene.mouse.x = atof(argv[++i]);
+            scene.mouse.y = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--turret") && i+2 < argc) { // углы башни, как с клавиатуры
+            scene.turret.x = atof(argv[++i]);
+            scene.turret.y = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--scalar")) packets = false; // каждый луч отдельно
+        else if (!strcmp(argv[i], "--threads-sweep")) sweep = true; // 1, 2, 4, ... потоков
+        else if (!strcmp(argv[i], "--linear-craters")) crater_grid = false; // все кратеры в каждой точке, как в шейдере
+        else if (!strcmp(argv[i], "--crater-sweep")) crater_sweep = true; // время кадра от 10 до 10000 кратеров
+        else if (!strcmp(argv[i], "--frames") && i+1 < argc) frames = std::max(0, atoi(argv[++i])); // прогнать буферы A-D
+        else if (!strcmp(argv[i], "--hold") && i+3 < argc) { // код клавиши держится с кадра по кадр
+            int key = atoi(argv[++i]), from = atoi(argv[++i]), to = atoi(argv[++i]);
+            holds.push_back(Vec3i(key & 255, from, to));
+        }
+        else out = argv[i];
+    }
+    if (width <= 0 || height <= 0) {
+        std::cerr << "bad size " << width << "x" << height << std::endl;
+        return 1;
+    }
+    if (frames > 0) {
+        // состояние сцены считают буферы A-D, как в ShaderToy, по 60 кадров в секунду
+        PassGraph graph;
+        SdfPasses passes = add_sdf_passes(graph, ncraters);
+        PassInputs in;
+        in.time_delta = 1.f/60.f;
+        auto t0 = std::chrono::steady_clock::now();
+        for (int f = 0; f < frames; f++) {
+            in.time = f*in.time_delta;
+            for (int k = 0; k < 256; k++) in.keys[k] = false;
+            for (size_t k = 0; k < holds.size(); k++)
+                if (f >= holds[k].y && f <= holds[k].z) in.keys[holds[k].x] = true;
+            graph.step(in, ThreadPool::instance());
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        scene.load(graph, passes);
+        std::cerr << frames << " frames of " << graph.passes() << " buffer passes in " << graph.waves() << " waves: "
+                  << ms << " ms, " << scene.craters.size() << " craters" << std::endl;
+    } else {
+        scene.animate(time);
+        scene.scatter_craters(ncraters);
+    }
+
+    TGAImage image(width, height, TGAImage::RGB);
+    if (crater_sweep) {
+        for (int n = 10; n <= 10000; n *= 10) {
+            scene.scatter_craters(n);
+            SdfStats g = render_sdf(scene, image.pixels<RGB8>(), ThreadPool::instance(), packets, true);
+            std::cerr << n << " craters: grid " << g.ms << " ms (" << g.crater_refs << " cell entries)";
+            if (n <= 1000 || !crater_grid) { // линейный проход по 10000 кратеров идёт минутами
+                SdfStats l = render_sdf(scene, image.pixels<RGB8>(), ThreadPool::instance(), packets, false);
+                std::cerr << ", linear scan " << l.ms << " ms";
+            }
+            std::cerr << std::endl;
+        }
+        return 0;
+    }
+    std::vector<int> threads;
+    if (sweep) {
+        int hw = std::max(1, (int)std::thread::hardware_concurrency());
+        for (int n = 1; n < hw; n *= 2) threads.push_back(n);
+        threads.push_back(hw);
+    } else {
+        threads.push_back(ThreadPool::instance().size());
+    }
+    for (size_t k = 0; k < threads.size(); k++) {
+        ThreadPool local(threads[k]);
+        ThreadPool &pool = sweep ? local : ThreadPool::instance();
+        SdfStats st = render_sdf(scene, image.pixels<RGB8>(), pool, packets, crater_grid);
+        std::cerr << pool.size() << " threads, " << (!packets ? "single rays" : st.avx2 ? "8-wide AVX2 packets" : "8-wide packets") << ": " << st.ms << " ms, "
+                  << st.primary_rays/(st.ms*1000.) << " Mrays/s primary, " << (st.primary_rays + st.shadow_rays)/(st.ms*1000.)
+                  << " Mrays/s with shadow rays";
+        if (packets)
+            std::cerr << ", " << st.fallback_rays << " rays finished alone";
+        std::cerr << std::endl;
+    }
+
+    image.flip_vertically(); // fragCoord.y растёт вверх
+    if (!image.write_tga_file(out)) {
+        std::cerr << "can't write " << out << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,156 @@
+#include <cmath>
+#include <algorithm>
+#include "../Include/sdf.h"
+
+// Lab_02's buffers A-D, texel for texel. Each buffer is only as large as the
+// texels its readers fetch, so the control passes are a handful of texels.
+
+static const int KEY_LEFT  = 37;
+static const int KEY_UP    = 38;
+static const int KEY_RIGHT = 39;
+static const int KEY_DOWN  = 40;
+static const int KEY_SPACE = 32;
+
+static const float SPEED_OF_TURN = 1.f;
+static const float GROUND_Y = -5.f;
+static const int   PLANE_INDEX[2] = {3, 5};
+
+// A: turret angles from the arrows, space state in z. iChannel0 = A, iChannel1 = keyboard
+static Texel pass_a(const PassContext &c, int, int) {
+    Texel s = c.fetch(0, 0, 0);
+    float offset_x = s.x, offset_y = s.y, space_pressed = s.z;
+    float left = c.fetch(1, KEY_LEFT, 0).x, up = c.fetch(1, KEY_UP, 0).x;
+    float right = c.fetch(1, KEY_RIGHT, 0).x, down = c.fetch(1, KEY_DOWN, 0).x;
+    float space = c.fetch(1, KEY_SPACE, 0).x;
+
+    offset_x += (right - left)*SPEED_OF_TURN*c.in->time_delta;
+    offset_y += (down - up)*SPEED_OF_TURN*c.in->time_delta;
+    if (space > 0.f && space_pressed == 0.f) space_pressed = 1.f;
+    else if (space == 0.f) space_pressed = 0.f;
+    offset_y = std::min(std::max(offset_y, -.25f), .12f);
+    return Texel(offset_x, offset_y, space_pressed, 0.f);
+}
+
+static bool bullet_hit(const Vec3f &pos) {
+    return pos.y < -.4f || (pos - Vec3f(10.f, .5f, 10.f)).norm() < 1.f;
+}
+
+// B: (0,0) fire trigger, (1,0) bullet, (2,0) explosion. iChannel0 = B, iChannel1 = A
+static Texel pass_b(const PassContext &c, int x, int y) {
+    if (c.in->frame == 0) return Texel();
+    Texel prev = c.fetch(0, x, y);
+    const Vec3f start(0.f, .5f, 0.f);
+    if (x == 0 && y == 0) {
+        float space_pressed = c.fetch(1, 0, 0).z;
+        if (space_pressed > .5f && prev.w < .5f) return Texel(1.f, 0.f, 0.f, c.in->time);
+        return Texel(0.f, 0.f, 0.f, space_pressed);
+    }
+    if (x == 1 && y == 0) {
+        Texel control = c.fetch(0, 0, 0);
+        if (control.w > 0.f && prev.w == 0.f) {
+            // rotateX(rot.y)*rotateY(-rot.x)*(0, 0, 1)
+            Texel rot = c.fetch(1, 0, 0);
+            Vec3f d(std::sin(rot.x), 0.f, std::cos(rot.x));
+            float cx = std::cos(rot.y), sx = std::sin(rot.y);
+            d = Vec3f(d.x, cx*d.y + sx*d.z, -sx*d.y + cx*d.z).normalize();
+            return Texel(start + d*.8f, 1.f);
+        }
+        if (prev.w > 0.f) {
+            Vec3f dir = (prev.xyz() - start).normalize();
+            Vec3f pos = prev.xyz() + dir*(10.f*c.in->time_delta);
+            if (bullet_hit(pos)) return Texel();
+            return Texel(pos, 1.f);
+        }
+        return Texel();
+    }
+    if (x == 2 && y == 0) {
+        Texel bullet = c.fetch(0, 1, 0);
+        if (bullet_hit(bullet.xyz()) && bullet.w > 0.f) return Texel(bullet.xyz(), 1.f);
+        prev.w *= std::pow(.92f, c.in->time_delta*60.f);
+        if (prev.w < .0005f) prev.w = 0.f;
+        return prev;
+    }
+    return prev;
+}
+
+// C: column i holds plane i: position, right, up, dir, then the bomb. iChannel0 = C
+static Texel pass_c(const PassContext &c, int x, int y) {
+    float i = (float)x, t = c.in->time;
+    Vec3f now(std::sin(t)*i, 0.f, std::cos(t)*i);
+    Vec3f dir = (now - c.fetch(0, x, 0).xyz()).normalize();
+    Vec3f right = cross(Vec3f(0.f, 1.f, 0.f), dir).normalize();
+    Vec3f up = cross(dir, right).normalize();
+    switch (y) {
+        case 0: return Texel(now, 1.f);
+        case 1: return Texel(right, 1.f);
+        case 2: return Texel(up, 1.f);
+        case 3: return Texel(dir, 1.f);
+        case 4: {
+            Texel prev = c.fetch(0, x, 4);
+            Vec3f bomb = prev.xyz();
+            float start = prev.w;
+            if (start <= 0.f) {
+                bomb = now - Vec3f(0.f, .3f, 0.f);
+                start = t;
+            }
+            float fall = t - start;
+            bomb.y = std::max(bomb.y - .5f*fall*fall, GROUND_Y);
+            if (bomb.y <= GROUND_Y) start = 0.f;
+            return Texel(bomb, start);
+        }
+    }
+    return Texel();
+}
+
+// D: column k lists the craters of plane k, the count in row 0. iChannel0 = D, iChannel1 = C
+static Texel pass_d(const PassContext &c, int x, int y) {
+    if (x > 1) return Texel();
+    Vec3f bomb = c.fetch(1, PLANE_INDEX[x], 4).xyz();
+    int count = (int)c.fetch(0, x, 0).x;
+    bool landed = bomb.y <= GROUND_Y;
+    if (y == 0) return Texel((float)(count + landed), 0.f, 0.f, 0.f);
+    if (landed && y == count + 1) return Texel(bomb, 0.f);
+    return Texel(c.fetch(0, x, y).xyz(), 0.f);
+}
+
+SdfPasses add_sdf_passes(PassGraph &graph, int max_craters) {
+    SdfPasses p;
+    p.a = graph.add_pass("A", 1, 1, pass_a);
+    p.b = graph.add_pass("B", 3, 1, pass_b);
+    p.c = graph.add_pass("C", PLANE_INDEX[1] + 1, 5, pass_c);
+    p.d = graph.add_pass("D", 2, max_craters + 1, pass_d);
+    graph.bind(p.a, 0, p.a);
+    graph.bind(p.a, 1, PassGraph::KEYBOARD);
+    graph.bind(p.b, 0, p.b);
+    graph.bind(p.b, 1, p.a);
+    graph.bind(p.c, 0, p.c);
+    graph.bind(p.d, 0, p.d);
+    graph.bind(p.d, 1, p.c);
+    return p;
+}
+
+void SdfScene::load(const PassGraph &graph, const SdfPasses &p) {
+    const PassBuffer &a = graph.output(p.a), &b = graph.output(p.b);
+    const PassBuffer &c = graph.output(p.c), &d = graph.output(p.d);
+    Texel keys = a.fetch(0, 0);
+    turret = Vec2f(keys.x, keys.y);
+    Texel shot = b.fetch(1, 0);
+    bullet = shot.xyz();
+    bullet_live = shot.w > 0.f;
+    for (int k=0; k<2; k++) {
+        Plane &pl = planes[k];
+        int i = PLANE_INDEX[k];
+        pl.pos = c.fetch(i, 0).xyz();
+        pl.right = c.fetch(i, 1).xyz();
+        pl.up = c.fetch(i, 2).xyz();
+        pl.dir = c.fetch(i, 3).xyz();
+        pl.bomb = c.fetch(i, 4).xyz();
+    }
+    craters.clear();
+    for (int k=0; k<2; k++) {
+        int count = std::min((int)d.fetch(k, 0).x, d.height() - 1);
+        for (int j=1; j<=count; j++)
+            craters.push_back(d.fetch(k, j).xyz());
+    }
+    index_craters();
+}
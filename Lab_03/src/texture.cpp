@@ -0,0 +1,295 @@
+#include <cmath>
+#include <algorithm>
+#include <utility>
+#include <string.h>
+#include "../Include/texture.h"
+#include "../Include/block_compression.h"
+#include "../Include/thread_pool.h"
+
+static const int TILE_SHIFT = 3;
+static const int TILE_SIZE  = 1<<TILE_SHIFT;
+static const int TILE_MASK  = TILE_SIZE-1;
+
+// bit interleave of a 3-bit coordinate: 0bcba -> 0b0c0b0a
+static const unsigned char morton_spread[TILE_SIZE] = {0x00, 0x01, 0x04, 0x05, 0x10, 0x11, 0x14, 0x15};
+
+static inline int morton_offset(int x, int y) {
+    return morton_spread[x & TILE_MASK] | (morton_spread[y & TILE_MASK] << 1);
+}
+
+static inline void to_bgra(const Gray8 &p, unsigned char *dst) {
+    dst[0] = p;
+    dst[1] = dst[2] = 0;
+    dst[3] = 255;
+}
+
+static inline void to_bgra(const RGB8 &p, unsigned char *dst) {
+    dst[0] = p.b;
+    dst[1] = p.g;
+    dst[2] = p.r;
+    dst[3] = 255;
+}
+
+static inline void to_bgra(const RGBA8 &p, unsigned char *dst) {
+    memcpy(dst, &p, 4);
+}
+
+template<class T> static void expand(ImageView<const T> src, unsigned char *dst) {
+    for (int y=0; y<src.height(); y++) {
+        const T *row = src.row(y);
+        for (int x=0; x<src.width(); x++, dst+=4) to_bgra(row[x], dst);
+    }
+}
+
+Texture::Texture() : levels_(), bytespp_(0), filter_(TRILINEAR), format_(BGRA8) {
+}
+
+Texture::Texture(const TGAImage &img, Filter f) : levels_(), bytespp_(0), filter_(f), format_(BGRA8) {
+    load(img);
+}
+
+void Texture::load(const TGAImage &img) {
+    levels_.clear();
+    format_ = BGRA8;
+    bytespp_ = img.get_bytespp();
+    int w = img.get_width();
+    int h = img.get_height();
+    if (!img.buffer() || w<=0 || h<=0) return;
+    if (bytespp_!=TGAImage::GRAYSCALE && bytespp_!=TGAImage::RGB && bytespp_!=TGAImage::RGBA) return;
+
+    // level 0 in linear BGRA, expanded from whatever the source format is
+    std::vector<unsigned char> linear(w*h*4);
+    switch (bytespp_) {
+        case TGAImage::GRAYSCALE: expand(img.pixels<Gray8>(), &linear[0]); break;
+        case TGAImage::RGB:       expand(img.pixels<RGB8>(),  &linear[0]); break;
+        default:                  expand(img.pixels<RGBA8>(), &linear[0]); break;
+    }
+
+    while (true) {
+        Level l;
+        l.width   = w;
+        l.height  = h;
+        l.tiles_x = (w+TILE_MASK)>>TILE_SHIFT;
+        int tiles_y = (h+TILE_MASK)>>TILE_SHIFT;
+        l.texels.assign(l.tiles_x*tiles_y*TILE_SIZE*TILE_SIZE*4, 0);
+        for (int y=0; y<h; y++) {
+            for (int x=0; x<w; x++) {
+                memcpy(&l.texels[offset(l, x, y)], &linear[(x+y*w)*4], 4);
+            }
+        }
+        levels_.push_back(std::move(l));
+        if (w==1 && h==1) break;
+
+        // 2x2 box filter; odd edges reuse the last row/column
+        int nw = std::max(1, w>>1);
+        int nh = std::max(1, h>>1);
+        std::vector<unsigned char> next(nw*nh*4);
+        for (int y=0; y<nh; y++) {
+            int y0 = std::min(2*y, h-1), y1 = std::min(2*y+1, h-1);
+            for (int x=0; x<nw; x++) {
+                int x0 = std::min(2*x, w-1), x1 = std::min(2*x+1, w-1);
+                for (int t=0; t<4; t++) {
+                    int sum = linear[(x0+y0*w)*4+t] + linear[(x1+y0*w)*4+t] +
+                              linear[(x0+y1*w)*4+t] + linear[(x1+y1*w)*4+t];
+                    next[(x+y*nw)*4+t] = (unsigned char)((sum+2)>>2);
+                }
+            }
+        }
+        linear.swap(next);
+        w = nw;
+        h = nh;
+    }
+}
+
+void Texture::set_filter(Filter f) {
+    filter_ = f;
+}
+
+Texture::Filter Texture::get_filter() const {
+    return filter_;
+}
+
+int Texture::get_width() const {
+    return levels_.empty() ? 0 : levels_[0].width;
+}
+
+int Texture::get_height() const {
+    return levels_.empty() ? 0 : levels_[0].height;
+}
+
+int Texture::get_bytespp() const {
+    return bytespp_;
+}
+
+int Texture::levels() const {
+    return (int)levels_.size();
+}
+
+bool Texture::empty() const {
+    return levels_.empty();
+}
+
+int Texture::offset(const Level &l, int x, int y) {
+    x = std::max(0, std::min(l.width-1,  x));
+    y = std::max(0, std::min(l.height-1, y));
+    int tile = (y>>TILE_SHIFT)*l.tiles_x + (x>>TILE_SHIFT);
+    return ((tile<<(2*TILE_SHIFT)) + morton_offset(x, y))*4;
+}
+
+int Texture::block_offset(const Level &l, int bx, int by, int block_bytes) {
+    int tile = (by>>1)*l.tiles_x + (bx>>1);
+    return ((tile<<2) + (bx&1) + ((by&1)<<1))*block_bytes;
+}
+
+void Texture::texel(const Level &l, int x, int y, unsigned char *bgra) const {
+    if (BGRA8==format_) {
+        memcpy(bgra, &l.texels[offset(l, x, y)], 4);
+        return;
+    }
+    x = std::max(0, std::min(l.width-1,  x));
+    y = std::max(0, std::min(l.height-1, y));
+    int i = (x&3) + ((y&3)<<2);
+    switch (format_) {
+        case BC1:
+            decode_bc1(&l.texels[block_offset(l, x>>2, y>>2, BC1_BLOCK_BYTES)], i, bgra);
+            break;
+        case BC4:
+            bgra[0] = decode_bc4(&l.texels[block_offset(l, x>>2, y>>2, BC4_BLOCK_BYTES)], i);
+            bgra[1] = bgra[2] = 0;
+            bgra[3] = 255;
+            break;
+        case BC5:
+        default:
+            decode_bc5(&l.texels[block_offset(l, x>>2, y>>2, BC5_BLOCK_BYTES)], i, bgra);
+            break;
+    }
+}
+
+Texture::Format Texture::get_format() const {
+    return format_;
+}
+
+unsigned long Texture::memory_bytes() const {
+    unsigned long total = 0;
+    for (size_t i=0; i<levels_.size(); i++) total += levels_[i].texels.size();
+    return total;
+}
+
+bool Texture::compress(Format f) {
+    if (levels_.empty() || f==format_) return f==format_;
+    if (format_!=BGRA8) return false; // no transcoding between block formats
+    int block_bytes = (BC5==f ? BC5_BLOCK_BYTES : BC1_BLOCK_BYTES);
+    for (size_t lv=0; lv<levels_.size(); lv++) {
+        Level &l = levels_[lv];
+        int blocks_x = l.tiles_x*2;
+        int blocks_y = ((l.height+7)>>3)*2;
+        std::vector<unsigned char> blocks(blocks_x*blocks_y*block_bytes, 0);
+        // one job per row of blocks; each row writes disjoint blocks
+        ThreadPool::instance().parallel_for(blocks_y, [&](int by) {
+            unsigned char src[64];
+            for (int bx=0; bx<blocks_x; bx++) {
+                for (int i=0; i<16; i++)
+                    texel(l, bx*4+(i&3), by*4+(i>>2), src+i*4);
+                unsigned char *dst = &blocks[block_offset(l, bx, by, block_bytes)];
+                switch (f) {
+                    case BC1: encode_bc1(src, dst);    break;
+                    case BC4: encode_bc4(src, 0, dst); break;
+                    default:  encode_bc5(src, dst);    break;
+                }
+            }
+        });
+        l.texels.swap(blocks);
+    }
+    format_ = f;
+    return true;
+}
+
+TGAColor Texture::fetch(int level, int x, int y) const {
+    if (levels_.empty()) return TGAColor();
+    level = std::max(0, std::min(levels()-1, level));
+    unsigned char c[4];
+    texel(levels_[level], x, y, c);
+    return TGAColor(c, bytespp_);
+}
+
+Vec4f Texture::nearest(int level, Vec2f uv) const {
+    const Level &l = levels_[level];
+    unsigned char p[4];
+    texel(l, (int)std::floor(uv.x*l.width), (int)std::floor(uv.y*l.height), p);
+    Vec4f res;
+    for (int t=0; t<4; t++) res[t] = p[t];
+    return res;
+}
+
+Vec4f Texture::bilinear(int level, Vec2f uv) const {
+    const Level &l = levels_[level];
+    float fx = uv.x*l.width  - .5f;
+    float fy = uv.y*l.height - .5f;
+    int x = (int)std::floor(fx);
+    int y = (int)std::floor(fy);
+    float ax = fx-x;
+    float ay = fy-y;
+    unsigned char p00[4], p10[4], p01[4], p11[4];
+    texel(l, x,   y,   p00);
+    texel(l, x+1, y,   p10);
+    texel(l, x,   y+1, p01);
+    texel(l, x+1, y+1, p11);
+    Vec4f res;
+    for (int t=0; t<4; t++) {
+        float top    = p00[t] + (p10[t]-p00[t])*ax;
+        float bottom = p01[t] + (p11[t]-p01[t])*ax;
+        res[t] = top + (bottom-top)*ay;
+    }
+    return res;
+}
+
+TGAColor Texture::to_color(const Vec4f &c) const {
+    TGAColor res;
+    res.bytespp = bytespp_;
+    for (int t=0; t<bytespp_; t++) res[t] = (unsigned char)std::max(0.f, std::min(255.f, c[t]+.5f));
+    return res;
+}
+
+float Texture::lod(Vec2f duvdx, Vec2f duvdy) const {
+    if (levels_.empty()) return 0.f;
+    float w = levels_[0].width, h = levels_[0].height;
+    float dx = (duvdx.x*w)*(duvdx.x*w) + (duvdx.y*h)*(duvdx.y*h);
+    float dy = (duvdy.x*w)*(duvdy.x*w) + (duvdy.y*h)*(duvdy.y*h);
+    float rho2 = std::max(dx, dy);
+    if (rho2<=1.f) return 0.f;
+    return std::min((float)(levels()-1), .5f*std::log2(rho2));
+}
+
+TGAColor Texture::sample(Vec2f uv) const {
+    return sample(uv, filter_);
+}
+
+TGAColor Texture::sample(Vec2f uv, Vec2f duvdx, Vec2f duvdy) const {
+    return sample(uv, duvdx, duvdy, filter_);
+}
+
+TGAColor Texture::sample(Vec2f uv, Filter f) const {
+    if (levels_.empty()) return TGAColor();
+    return to_color(f==NEAREST ? nearest(0, uv) : bilinear(0, uv));
+}
+
+TGAColor Texture::sample(Vec2f uv, Vec2f duvdx, Vec2f duvdy, Filter f) const {
+    if (levels_.empty()) return TGAColor();
+    float lambda = lod(duvdx, duvdy);
+    switch (f) {
+        case NEAREST: // point sampling of the full map, no mips
+            return to_color(nearest(0, uv));
+        case BILINEAR:
+            return to_color(bilinear((int)(lambda+.5f), uv));
+        case TRILINEAR:
+        default: {
+            int l0 = (int)lambda;
+            int l1 = std::min(l0+1, levels()-1);
+            float a = lambda-l0;
+            Vec4f c0 = bilinear(l0, uv);
+            if (l0==l1 || a<=0.f) return to_color(c0);
+            Vec4f c1 = bilinear(l1, uv);
+            return to_color(c0 + (c1-c0)*a);
+        }
+    }
+}
@@ -0,0 +1,175 @@
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <vector>
+#include "../Include/texture_cache.h"
+#include "../Include/image_kernels.h"
+#include "../Include/image_pool.h"
+#include "../Include/trace.h"
+
+static bool read_file(const std::string &path, std::vector<unsigned char> &out) {
+    std::ifstream in;
+    in.open (path.c_str(), std::ios::binary);
+    if (!in.is_open()) {
+        std::cerr << "can't open file " << path << "\n";
+        return false;
+    }
+    in.seekg(0, std::ios::end);
+    std::streamoff size = in.tellg();
+    in.seekg(0, std::ios::beg);
+    out.resize(size>0 ? (size_t)size : 0);
+    if (size>0) in.read((char *)out.data(), size);
+    bool ok = size>0 && in.good();
+    in.close();
+    return ok;
+}
+
+// 64-bit FNV-1a
+static unsigned long long content_hash(const std::vector<unsigned char> &bytes) {
+    unsigned long long h = 14695981039346656037ULL;
+    for (size_t i=0; i<bytes.size(); i++) {
+        h ^= bytes[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// box-filtered copy no larger than TextureCache::PREVIEW_SIZE on either side
+static std::shared_ptr<const Texture> make_preview(const TGAImage &img) {
+    int w = img.get_width(), h = img.get_height();
+    int n = TextureCache::PREVIEW_SIZE, m = std::max(w, h);
+    int pw = m>n ? std::max(1, (int)((long)w*n/m)) : w;
+    int ph = m>n ? std::max(1, (int)((long)h*n/m)) : h;
+    TGAImage small = ImagePool::instance().acquire(pw, ph, img.get_bytespp());
+    switch (img.get_bytespp()) {
+        case TGAImage::GRAYSCALE: downscale_box<Gray8>(img.pixels<Gray8>(), small.pixels<Gray8>()); break;
+        case TGAImage::RGB:       downscale_box<RGB8> (img.pixels<RGB8>(),  small.pixels<RGB8>());  break;
+        case TGAImage::RGBA:      downscale_box<RGBA8>(img.pixels<RGBA8>(), small.pixels<RGBA8>()); break;
+    }
+    std::shared_ptr<const Texture> tex = std::make_shared<Texture>(small);
+    ImagePool::instance().release(std::move(small));
+    return tex;
+}
+
+TextureCache::TextureCache(unsigned long budget) : mutex_(), paths_(), entries_(), lru_(), bytes_(0), budget_(budget) {
+    stats_.hits = stats_.misses = stats_.duplicates = stats_.evictions = 0;
+    stats_.entries = stats_.bytes = 0;
+    stats_.budget = budget;
+}
+
+TextureCache &TextureCache::instance() {
+    static TextureCache cache([]() {
+        const char *env = std::getenv("RENDERER_TEXTURE_BUDGET_MB");
+        long mb = env ? std::atol(env) : 256;
+        return (unsigned long)(mb>0 ? mb : 0) << 20;
+    }());
+    return cache;
+}
+
+// mutex_ must be held; moves the entry to the front of the LRU list, the caller counts the hit
+std::shared_ptr<const Texture> TextureCache::lookup(const Key &key) {
+    std::map<Key, Entry>::iterator it = entries_.find(key);
+    if (it==entries_.end()) return std::shared_ptr<const Texture>();
+    lru_.splice(lru_.begin(), lru_, it->second.lru);
+    return it->second.texture;
+}
+
+// mutex_ must be held; entries still referenced outside the cache are skipped
+void TextureCache::evict(unsigned long budget) {
+    std::list<Key>::iterator it = lru_.end();
+    while (bytes_>budget && it!=lru_.begin()) {
+        --it;
+        std::map<Key, Entry>::iterator e = entries_.find(*it);
+        if (e->second.texture.use_count()>1) continue;
+        bytes_ -= e->second.bytes;
+        entries_.erase(e);
+        it = lru_.erase(it);
+        stats_.evictions++;
+    }
+}
+
+std::shared_ptr<const Texture> TextureCache::acquire(const std::string &path, Texture::Format fmt, const PreviewFn &preview) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::map<std::string, unsigned long long>::iterator p = paths_.find(path);
+        if (p!=paths_.end()) {
+            Key key = {p->second, fmt};
+            std::shared_ptr<const Texture> tex = lookup(key);
+            if (tex) {
+                stats_.hits++;
+                return tex;
+            }
+        }
+    }
+
+    // decoding happens outside the lock; two threads missing on the same file
+    // both decode it and the second one throws its copy away
+    std::vector<unsigned char> file;
+    bool read;
+    {
+        TRACE_SCOPE("read texture file");
+        read = read_file(path, file);
+    }
+    if (!read) {
+        std::cerr << "texture file " << path << " loading failed" << std::endl;
+        return std::shared_ptr<const Texture>();
+    }
+    Key key = {content_hash(file), fmt};
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        paths_[path] = key.hash;
+        std::shared_ptr<const Texture> tex = lookup(key);
+        if (tex) {
+            stats_.hits++;
+            return tex;
+        }
+    }
+
+    TRACE_SCOPE("decode texture");
+    TGAImage img;
+    bool ok = img.read_tga_buffer(file.data(), file.size());
+    std::cerr << "texture file " << path << " loading " << (ok ? "ok" : "failed") << std::endl;
+    if (!ok) return std::shared_ptr<const Texture>();
+    img.flip_vertically();
+    if (preview) preview(make_preview(img));
+    std::shared_ptr<Texture> decoded = std::make_shared<Texture>(img);
+    if (fmt!=Texture::BGRA8) decoded->compress(fmt);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    // another thread decoded the same file meanwhile: ours was wasted work
+    std::shared_ptr<const Texture> tex = lookup(key);
+    if (tex) {
+        stats_.duplicates++;
+        return tex;
+    }
+    stats_.misses++;
+    lru_.push_front(key);
+    Entry &e = entries_[key];
+    e.texture = decoded;
+    e.bytes = decoded->memory_bytes();
+    e.lru = lru_.begin();
+    bytes_ += e.bytes;
+    evict(budget_);
+    return decoded;
+}
+
+void TextureCache::set_budget(unsigned long bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    budget_ = bytes;
+    evict(budget_);
+}
+
+void TextureCache::trim() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    evict(0);
+}
+
+TextureCache::Stats TextureCache::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats s = stats_;
+    s.entries = entries_.size();
+    s.bytes = bytes_;
+    s.budget = budget_;
+    return s;
+}
@@ -3,7 +3,13 @@
 #include <string.h>
 #include <time.h>
 #include <math.h>
+#include <algorithm>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "..//Include/tgaimage.h"
+#include "../Include/image_kernels.h"
 
 TGAImage::TGAImage() : data(NULL), width(0), height(0), bytespp(0) {
 }
@@ -20,26 +26,45 @@ TGAImage::TGAImage(const TGAImage &img) : data(NULL), width(img.width), height(i
     memcpy(data, img.data, nbytes);
 }
 
+TGAImage::TGAImage(TGAImage &&img) : data(img.data), width(img.width), height(img.height), bytespp(img.bytespp) {
+    img.data = NULL;
+    img.width = img.height = img.bytespp = 0;
+}
+
 TGAImage::~TGAImage() {
     if (data) delete [] data;
 }
 
 TGAImage & TGAImage::operator =(const TGAImage &img) {
     if (this != &img) {
-        if (data) delete [] data;
+        unsigned long nbytes = img.width*img.height*img.bytespp;
+        // same size: copy into the buffer we already have
+        if (!data || nbytes!=(unsigned long)width*height*bytespp) {
+            if (data) delete [] data;
+            data = new unsigned char[nbytes];
+        }
         width  = img.width;
         height = img.height;
         bytespp = img.bytespp;
-        unsigned long nbytes = width*height*bytespp;
-        data = new unsigned char[nbytes];
         memcpy(data, img.data, nbytes);
     }
     return *this;
 }
 
+TGAImage & TGAImage::operator =(TGAImage &&img) {
+    if (this != &img) {
+        if (data) delete [] data;
+        data    = img.data;
+        width   = img.width;
+        height  = img.height;
+        bytespp = img.bytespp;
+        img.data = NULL;
+        img.width = img.height = img.bytespp = 0;
+    }
+    return *this;
+}
+
 bool TGAImage::read_tga_file(const char *filename) {
-    if (data) delete [] data;
-    data = NULL;
     std::ifstream in;
     in.open (filename, std::ios::binary);
     if (!in.is_open()) {
@@ -47,38 +72,53 @@ bool TGAImage::read_tga_file(const char *filename) {
         in.close();
         return false;
     }
-    TGA_Header header;
-    in.read((char *)&header, sizeof(header));
-    if (!in.good()) {
+    // one bulk read, the decoder then works on memory only
+    in.seekg(0, std::ios::end);
+    std::streamoff size = in.tellg();
+    in.seekg(0, std::ios::beg);
+    std::vector<unsigned char> file(size>0 ? (size_t)size : 0);
+    if (size>0) in.read((char *)file.data(), size);
+    if (size<=0 || !in.good()) {
         in.close();
+        std::cerr << "an error occured while reading the file\n";
+        return false;
+    }
+    in.close();
+    return read_tga_buffer(file.data(), file.size());
+}
+
+bool TGAImage::read_tga_buffer(const unsigned char *buf, unsigned long size) {
+    if (data) delete [] data;
+    data = NULL;
+    TGA_Header header;
+    if (size<sizeof(header)) {
         std::cerr << "an error occured while reading the header\n";
         return false;
     }
+    memcpy((void *)&header, buf, sizeof(header));
     width   = header.width;
     height  = header.height;
     bytespp = header.bitsperpixel>>3;
     if (width<=0 || height<=0 || (bytespp!=GRAYSCALE && bytespp!=RGB && bytespp!=RGBA)) {
-        in.close();
         std::cerr << "bad bpp (or width/height) value\n";
         return false;
     }
+    const unsigned char *in  = buf + sizeof(header) + (unsigned char)header.idlength;
+    const unsigned char *end = buf + size;
     unsigned long nbytes = bytespp*width*height;
     data = new unsigned char[nbytes];
     if (3==header.datatypecode || 2==header.datatypecode) {
-        in.read((char *)data, nbytes);
-        if (!in.good()) {
-            in.close();
+        if (in>end || (unsigned long)(end-in)<nbytes) {
             std::cerr << "an error occured while reading the data\n";
             return false;
         }
+        memcpy(data, in, nbytes);
     } else if (10==header.datatypecode||11==header.datatypecode) {
-        if (!load_rle_data(in)) {
-            in.close();
+        if (in>end || !load_rle_data(in, end)) {
             std::cerr << "an error occured while reading the data\n";
             return false;
         }
     } else {
-        in.close();
         std::cerr << "unknown file format " << (int)header.datatypecode << "\n";
         return false;
     }
@@ -89,63 +129,58 @@ bool TGAImage::read_tga_file(const char *filename) {
         flip_horizontally();
     }
     std::cerr << width << "x" << height << "/" << bytespp*8 << "\n";
-    in.close();
     return true;
 }
 
-bool TGAImage::load_rle_data(std::ifstream &in) {
-    unsigned long pixelcount = width*height;
-    unsigned long currentpixel = 0;
-    unsigned long currentbyte  = 0;
-    TGAColor colorbuffer;
-    do {
-        unsigned char chunkheader = 0;
-        chunkheader = in.get();
-        if (!in.good()) {
+bool TGAImage::load_rle_data(const unsigned char *in, const unsigned char *end) {
+    unsigned char *out    = data;
+    unsigned char *outend = data + (unsigned long)width*height*bytespp;
+    while (out<outend) {
+        if (in>=end) {
             std::cerr << "an error occured while reading the data\n";
             return false;
         }
+        unsigned char chunkheader = *in++;
+        unsigned long count = (chunkheader<128 ? chunkheader+1 : chunkheader-127);
+        unsigned long nbytes = count*bytespp;
+        if (nbytes>(unsigned long)(outend-out)) {
+            std::cerr << "Too many pixels read\n";
+            return false;
+        }
         if (chunkheader<128) {
-            chunkheader++;
-            for (int i=0; i<chunkheader; i++) {
-                in.read((char *)colorbuffer.bgra, bytespp);
-                if (!in.good()) {
-                    std::cerr << "an error occured while reading the header\n";
-                    return false;
-                }
-                for (int t=0; t<bytespp; t++)
-                    data[currentbyte++] = colorbuffer.bgra[t];
-                currentpixel++;
-                if (currentpixel>pixelcount) {
-                    std::cerr << "Too many pixels read\n";
-                    return false;
-                }
+            if (nbytes>(unsigned long)(end-in)) {
+                std::cerr << "an error occured while reading the header\n";
+                return false;
             }
+            memcpy(out, in, nbytes);
+            in += nbytes;
         } else {
-            chunkheader -= 127;
-            in.read((char *)colorbuffer.bgra, bytespp);
-            if (!in.good()) {
+            if ((unsigned long)bytespp>(unsigned long)(end-in)) {
                 std::cerr << "an error occured while reading the header\n";
                 return false;
             }
-            for (int i=0; i<chunkheader; i++) {
-                for (int t=0; t<bytespp; t++)
-                    data[currentbyte++] = colorbuffer.bgra[t];
-                currentpixel++;
-                if (currentpixel>pixelcount) {
-                    std::cerr << "Too many pixels read\n";
-                    return false;
+            if (1==bytespp) {
+                memset(out, *in, count);
+            } else {
+                // seed one pixel, then keep doubling the filled prefix
+                memcpy(out, in, bytespp);
+                unsigned long filled = bytespp;
+                while (filled<nbytes) {
+                    unsigned long n = std::min(filled, nbytes-filled);
+                    memcpy(out+filled, out, n);
+                    filled += n;
                 }
             }
+            in += bytespp;
         }
-    } while (currentpixel < pixelcount);
+        out += nbytes;
+    }
     return true;
 }
 
-bool TGAImage::write_tga_file(const char *filename, bool rle) {
-    unsigned char developer_area_ref[4] = {0, 0, 0, 0};
-    unsigned char extension_area_ref[4] = {0, 0, 0, 0};
-    unsigned char footer[18] = {'T','R','U','E','V','I','S','I','O','N','-','X','F','I','L','E','.','\0'};
+bool TGAImage::write_tga_file(const char *filename, bool rle) const {
+    std::vector<unsigned char> file;
+    encode_tga(view(), file, rle);
     std::ofstream out;
     out.open (filename, std::ios::binary);
     if (!out.is_open()) {
@@ -153,98 +188,102 @@ bool TGAImage::write_tga_file(const char *filename, bool rle) {
         out.close();
         return false;
     }
-    TGA_Header header;
-    memset((void *)&header, 0, sizeof(header));
-    header.bitsperpixel = bytespp<<3;
-    header.width  = width;
-    header.height = height;
-    header.datatypecode = (bytespp==GRAYSCALE?(rle?11:3):(rle?10:2));
-    header.imagedescriptor = 0x20; // top-left origin
-    out.write((char *)&header, sizeof(header));
+    out.write((const char *)file.data(), file.size());
     if (!out.good()) {
-        out.close();
         std::cerr << "can't dump the tga file\n";
+        out.close();
         return false;
     }
+    out.close();
+    return true;
+}
+
+static void unload_rle_data(const ConstImageView &img, std::vector<unsigned char> &out);
+
+void encode_tga(const ConstImageView &img, std::vector<unsigned char> &out, bool rle) {
+    const int bytespp = img.bytespp;
+    unsigned char developer_area_ref[4] = {0, 0, 0, 0};
+    unsigned char extension_area_ref[4] = {0, 0, 0, 0};
+    unsigned char footer[18] = {'T','R','U','E','V','I','S','I','O','N','-','X','F','I','L','E','.','\0'};
+    TGA_Header header;
+    memset((void *)&header, 0, sizeof(header));
+    header.bitsperpixel = bytespp<<3;
+    header.width  = img.width;
+    header.height = img.height;
+    header.datatypecode = (bytespp==TGAImage::GRAYSCALE?(rle?11:3):(rle?10:2));
+    header.imagedescriptor = 0x20; // top-left origin
+    unsigned long nbytes = img.size();
+    out.clear();
+    // worst case RLE is one header byte per 128 raw pixels
+    out.reserve(sizeof(header) + nbytes + nbytes/(128*bytespp) + 1 + sizeof(developer_area_ref) +
+                sizeof(extension_area_ref) + sizeof(footer));
+    out.insert(out.end(), (unsigned char *)&header, (unsigned char *)&header + sizeof(header));
     if (!rle) {
-        out.write((char *)data, width*height*bytespp);
-        if (!out.good()) {
-            std::cerr << "can't unload raw data\n";
-            out.close();
-            return false;
-        }
+        out.insert(out.end(), img.data, img.data + nbytes);
     } else {
-        if (!unload_rle_data(out)) {
-            out.close();
-            std::cerr << "can't unload rle data\n";
-            return false;
-        }
-    }
-    out.write((char *)developer_area_ref, sizeof(developer_area_ref));
-    if (!out.good()) {
-        std::cerr << "can't dump the tga file\n";
-        out.close();
-        return false;
+        unload_rle_data(img, out);
     }
-    out.write((char *)extension_area_ref, sizeof(extension_area_ref));
-    if (!out.good()) {
-        std::cerr << "can't dump the tga file\n";
-        out.close();
-        return false;
+    out.insert(out.end(), developer_area_ref, developer_area_ref + sizeof(developer_area_ref));
+    out.insert(out.end(), extension_area_ref, extension_area_ref + sizeof(extension_area_ref));
+    out.insert(out.end(), footer, footer + sizeof(footer));
+}
+
+// length of the common prefix of a and b, 16 bytes per step where SSE2 is available
+static unsigned long match_length(const unsigned char *a, const unsigned char *b, unsigned long n) {
+    unsigned long i = 0;
+#ifdef __SSE2__
+    for (; i+16<=n; i+=16) {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a+i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b+i));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) ^ 0xffffu;
+        if (mask) return i + __builtin_ctz(mask);
     }
-    out.write((char *)footer, sizeof(footer));
-    if (!out.good()) {
-        std::cerr << "can't dump the tga file\n";
-        out.close();
-        return false;
+#endif
+    for (; i<n && a[i]==b[i]; i++);
+    return i;
+}
+
+static inline bool same_pixel(const unsigned char *a, const unsigned char *b, int bytespp) {
+    switch (bytespp) {
+        case 1:  return a[0]==b[0];
+        case 3:  return a[0]==b[0] && a[1]==b[1] && a[2]==b[2];
+        default: return !memcmp(a, b, bytespp);
     }
-    out.close();
-    return true;
 }
 
-bool TGAImage::unload_rle_data(std::ofstream &out) {
-    const unsigned char max_chunk_length = 128;
-    unsigned long npixels = width*height;
+static void unload_rle_data(const ConstImageView &img, std::vector<unsigned char> &out) {
+    const unsigned long max_chunk_length = 128;
+    const unsigned char *data = img.data;
+    const int bytespp = img.bytespp;
+    unsigned long npixels = (unsigned long)img.width*img.height;
     unsigned long curpix = 0;
     while (curpix<npixels) {
-        unsigned long chunkstart = curpix*bytespp;
-        unsigned long curbyte = curpix*bytespp;
-        unsigned char run_length = 1;
-        bool raw = true;
-        while (curpix+run_length<npixels && run_length<max_chunk_length) {
-            bool succ_eq = true;
-            for (int t=0; succ_eq && t<bytespp; t++) {
-                succ_eq = (data[curbyte+t]==data[curbyte+t+bytespp]);
-            }
-            curbyte += bytespp;
-            if (1==run_length) {
-                raw = !succ_eq;
-            }
-            if (raw && succ_eq) {
-                run_length--;
-                break;
-            }
-            if (!raw && !succ_eq) {
-                break;
+        const unsigned char *chunk = data + curpix*bytespp;
+        unsigned long maxlen = std::min(max_chunk_length, npixels-curpix);
+        bool raw = (1==maxlen || !same_pixel(chunk, chunk+bytespp, bytespp));
+        unsigned long run_length;
+        if (raw) {
+            // raw packet stops right before the first pixel that starts a repeat
+            run_length = 1;
+            while (run_length<maxlen) {
+                const unsigned char *p = chunk + run_length*bytespp;
+                if (same_pixel(p-bytespp, p, bytespp)) {
+                    run_length--;
+                    break;
+                }
+                run_length++;
             }
-            run_length++;
+        } else {
+            // pixel k equals pixel k+1 for the whole run <=> the buffer matches itself shifted by one pixel
+            run_length = 1 + match_length(chunk, chunk+bytespp, (maxlen-1)*bytespp)/bytespp;
         }
         curpix += run_length;
-        out.put(raw?run_length-1:run_length+127);
-        if (!out.good()) {
-            std::cerr << "can't dump the tga file\n";
-            return false;
-        }
-        out.write((char *)(data+chunkstart), (raw?run_length*bytespp:bytespp));
-        if (!out.good()) {
-            std::cerr << "can't dump the tga file\n";
-            return false;
-        }
+        out.push_back((unsigned char)(raw?run_length-1:run_length+127));
+        out.insert(out.end(), chunk, chunk + (raw?run_length*bytespp:bytespp));
     }
-    return true;
 }
 
-TGAColor TGAImage::get(int x, int y) {
+TGAColor TGAImage::get(int x, int y) const {
     if (!data || x<0 || y<0 || x>=width || y>=height) {
         return TGAColor();
     }
@@ -267,89 +306,63 @@ bool TGAImage::set(int x, int y, const TGAColor &c) {
     return true;
 }
 
-int TGAImage::get_bytespp() {
+int TGAImage::get_bytespp() const {
     return bytespp;
 }
 
-int TGAImage::get_width() {
+int TGAImage::get_width() const {
     return width;
 }
 
-int TGAImage::get_height() {
+int TGAImage::get_height() const {
     return height;
 }
 
 bool TGAImage::flip_horizontally() {
     if (!data) return false;
-    int half = width>>1;
-    for (int i=0; i<half; i++) {
-        for (int j=0; j<height; j++) {
-            TGAColor c1 = get(i, j);
-            TGAColor c2 = get(width-1-i, j);
-            set(i, j, c2);
-            set(width-1-i, j, c1);
-        }
+    switch (bytespp) {
+        case GRAYSCALE: ::flip_horizontal(pixels<Gray8>()); return true;
+        case RGB:       ::flip_horizontal(pixels<RGB8>());  return true;
+        case RGBA:      ::flip_horizontal(pixels<RGBA8>()); return true;
     }
-    return true;
+    return false;
 }
 
 bool TGAImage::flip_vertically() {
     if (!data) return false;
-    unsigned long bytes_per_line = width*bytespp;
-    unsigned char *line = new unsigned char[bytes_per_line];
-    int half = height>>1;
-    for (int j=0; j<half; j++) {
-        unsigned long l1 = j*bytes_per_line;
-        unsigned long l2 = (height-1-j)*bytes_per_line;
-        memmove((void *)line,      (void *)(data+l1), bytes_per_line);
-        memmove((void *)(data+l1), (void *)(data+l2), bytes_per_line);
-        memmove((void *)(data+l2), (void *)line,      bytes_per_line);
+    switch (bytespp) {
+        case GRAYSCALE: ::flip_vertical(pixels<Gray8>()); return true;
+        case RGB:       ::flip_vertical(pixels<RGB8>());  return true;
+        case RGBA:      ::flip_vertical(pixels<RGBA8>()); return true;
     }
-    delete [] line;
-    return true;
+    return false;
 }
 
 unsigned char *TGAImage::buffer() {
     return data;
 }
 
+const unsigned char *TGAImage::buffer() const {
+    return data;
+}
+
+ConstImageView TGAImage::view() const {
+    return ConstImageView(data, width, height, bytespp);
+}
+
 void TGAImage::clear() {
     memset((void *)data, 0, width*height*bytespp);
 }
 
 bool TGAImage::scale(int w, int h) {
     if (w<=0 || h<=0 || !data) return false;
-    unsigned char *tdata = new unsigned char[w*h*bytespp];
-    int nscanline = 0;
-    int oscanline = 0;
-    int erry = 0;
-    unsigned long nlinebytes = w*bytespp;
-    unsigned long olinebytes = width*bytespp;
-    for (int j=0; j<height; j++) {
-        int errx = width-w;
-        int nx   = -bytespp;
-        int ox   = -bytespp;
-        for (int i=0; i<width; i++) {
-            ox += bytespp;
-            errx += w;
-            while (errx>=(int)width) {
-                errx -= width;
-                nx += bytespp;
-                memcpy(tdata+nscanline+nx, data+oscanline+ox, bytespp);
-            }
-        }
-        erry += h;
-        oscanline += olinebytes;
-        while (erry>=(int)height) {
-            if (erry>=(int)height<<1)
-                memcpy(tdata+nscanline+nlinebytes, tdata+nscanline, nlinebytes);
-            erry -= height;
-            nscanline += nlinebytes;
-        }
+    if (bytespp!=GRAYSCALE && bytespp!=RGB && bytespp!=RGBA) return false;
+    TGAImage scaled(w, h, bytespp);
+    switch (bytespp) {
+        case GRAYSCALE: resize_nearest<Gray8>(pixels<Gray8>(), scaled.pixels<Gray8>()); break;
+        case RGB:       resize_nearest<RGB8>(pixels<RGB8>(),  scaled.pixels<RGB8>());  break;
+        case RGBA:      resize_nearest<RGBA8>(pixels<RGBA8>(), scaled.pixels<RGBA8>()); break;
     }
-    delete [] data;
-    data = tdata;
-    width = w;
-    height = h;
+    *this = std::move(scaled);
     return true;
 }
@@ -0,0 +1,100 @@
+#include <cstdlib>
+#include "../Include/thread_pool.h"
+#include "../Include/trace.h"
+
+static thread_local bool in_worker = false;
+
+ThreadPool::ThreadPool(int nthreads) : threads_(), fn_(NULL), ctx_(NULL), count_(0), next_(0), finished_(0),
+                                       generation_(0), busy_(0), stop_(false) {
+    for (int i=1; i<nthreads; i++)
+        threads_.push_back(std::thread(&ThreadPool::worker, this));
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (size_t i=0; i<threads_.size(); i++) threads_[i].join();
+}
+
+ThreadPool &ThreadPool::instance() {
+    static ThreadPool pool([]() {
+        const char *env = std::getenv("RENDERER_THREADS");
+        int n = env ? std::atoi(env) : (int)std::thread::hardware_concurrency();
+        return n>0 ? n : 1;
+    }());
+    return pool;
+}
+
+int ThreadPool::size() const {
+    return (int)threads_.size()+1;
+}
+
+void ThreadPool::drain(void (*fn)(void *, int), void *ctx, int count) {
+    int i;
+    while ((i = next_.fetch_add(1)) < count) {
+        fn(ctx, i);
+        finished_.fetch_add(1);
+    }
+}
+
+void ThreadPool::worker() {
+    in_worker = true;
+    Trace::name_thread("pool worker");
+    unsigned long seen = 0;
+    while (true) {
+        void (*fn)(void *, int);
+        void *ctx;
+        int count;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [&]() { return stop_ || generation_!=seen; });
+            if (stop_) return;
+            seen = generation_;
+            fn = fn_;
+            ctx = ctx_;
+            count = count_;
+            busy_++;
+        }
+        drain(fn, ctx, count);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            busy_--;
+        }
+        done_.notify_all();
+    }
+}
+
+void ThreadPool::run(int n, void (*fn)(void *, int), void *ctx) {
+    if (n<=0) return;
+    if (threads_.empty() || in_worker || n==1) {
+        for (int i=0; i<n; i++) fn(ctx, i);
+        return;
+    }
+    // the pool is busy with another thread's loop, and that loop may be waiting
+    // for this thread (raster bands blocked on a texture loader): run inline
+    std::unique_lock<std::mutex> submit(submit_, std::try_to_lock);
+    if (!submit.owns_lock()) {
+        for (int i=0; i<n; i++) fn(ctx, i);
+        return;
+    }
+    {
+        // a worker that woke up late for the previous job may still be leaving drain()
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [&]() { return busy_==0; });
+        fn_ = fn;
+        ctx_ = ctx;
+        count_ = n;
+        next_ = 0;
+        finished_ = 0;
+        generation_++;
+    }
+    wake_.notify_all();
+    in_worker = true; // nested parallel_for from fn runs inline on this thread too
+    drain(fn, ctx, n);
+    in_worker = false;
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [&]() { return finished_.load()==n; });
+}
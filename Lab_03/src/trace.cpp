@@ -0,0 +1,113 @@
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <vector>
+#include "../Include/trace.h"
+
+struct TraceEvent {
+    const char *name;
+    unsigned long long begin_ns;
+    unsigned long long end_ns;
+    int index;
+};
+
+// written only by its thread; the exporter reads it after the work is done
+struct TraceBuffer {
+    std::vector<TraceEvent> events;
+    unsigned long long dropped;
+    const char *name;
+    int tid;
+};
+
+std::atomic<bool> Trace::enabled_(false);
+
+static std::mutex buffers_mutex;
+static std::vector<TraceBuffer *> buffers;
+static unsigned long long origin_ns = 0;
+
+static TraceBuffer &local_buffer() {
+    // never freed: the thread may be gone by the time write() runs
+    thread_local TraceBuffer *buffer = NULL;
+    if (!buffer) {
+        buffer = new TraceBuffer();
+        buffer->events.reserve(Trace::THREAD_EVENTS);
+        buffer->dropped = 0;
+        buffer->name = NULL;
+        std::lock_guard<std::mutex> lock(buffers_mutex);
+        buffer->tid = (int)buffers.size() + 1;
+        buffers.push_back(buffer);
+    }
+    return *buffer;
+}
+
+unsigned long long Trace::now_ns() {
+    return (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Trace::start() {
+    origin_ns = now_ns();
+    enabled_.store(true, std::memory_order_relaxed);
+}
+
+void Trace::record(const char *name, unsigned long long begin_ns, unsigned long long end_ns, int index) {
+    TraceBuffer &b = local_buffer();
+    if (b.events.size() == b.events.capacity()) {
+        b.dropped++;
+        return;
+    }
+    TraceEvent e = {name, begin_ns, end_ns, index};
+    b.events.push_back(e);
+}
+
+void Trace::name_thread(const char *name) {
+    local_buffer().name = name;
+}
+
+unsigned long long Trace::dropped() {
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    unsigned long long n = 0;
+    for (size_t i = 0; i < buffers.size(); i++) n += buffers[i]->dropped;
+    return n;
+}
+
+static void write_string(std::ofstream &out, const char *s) {
+    out << '"';
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') out << '\\';
+        out << *s;
+    }
+    out << '"';
+}
+
+bool Trace::write(const char *filename) {
+    std::ofstream out(filename);
+    if (!out) return false;
+    out.setf(std::ios::fixed);
+    out.precision(3);
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    bool first = true;
+    for (size_t i = 0; i < buffers.size(); i++) {
+        const TraceBuffer &b = *buffers[i];
+        out << (first ? "" : ",\n") << "{\"ph\": \"M\", \"pid\": 1, \"tid\": " << b.tid
+            << ", \"name\": \"thread_name\", \"args\": {\"name\": ";
+        if (b.name) write_string(out, b.name);
+        else out << "\"thread " << b.tid << "\"";
+        out << "}}";
+        first = false;
+        for (size_t k = 0; k < b.events.size(); k++) {
+            const TraceEvent &e = b.events[k];
+            // events that began before start() would show up at negative times
+            unsigned long long begin = e.begin_ns > origin_ns ? e.begin_ns - origin_ns : 0;
+            unsigned long long end = e.end_ns > origin_ns ? e.end_ns - origin_ns : 0;
+            out << ",\n{\"ph\": \"X\", \"pid\": 1, \"tid\": " << b.tid << ", \"name\": ";
+            write_string(out, e.name);
+            out << ", \"ts\": " << begin*1e-3 << ", \"dur\": " << (end - begin)*1e-3;
+            if (e.index >= 0) out << ", \"args\": {\"index\": " << e.index << "}";
+            out << "}";
+        }
+    }
+    out << "\n]}\n";
+    return (bool)out;
+}
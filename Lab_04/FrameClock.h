@@ -0,0 +1,49 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include "InputEvent.h"
+
+// Time source of the frame scheduler. The steady clock sleeps for real; the
+// headless one jumps to whatever time is asked for, so a scheduler run on it
+// is the same on every machine and takes no wall time.
+class FrameClock
+{
+public:
+    virtual ~FrameClock() = default;
+    virtual uint64_t NowNs() = 0;
+    virtual void SleepUntil(uint64_t ns) = 0;
+};
+
+class SteadyFrameClock : public FrameClock
+{
+public:
+    uint64_t NowNs() override { return InputClockNs(); }
+
+    // OS sleeps overshoot by up to a scheduler tick, so sleep short and
+    // yield through the last millisecond
+    void SleepUntil(uint64_t ns) override
+    {
+        for (uint64_t now = NowNs(); now < ns; now = NowNs())
+        {
+            if (ns - now > 2000000)
+                std::this_thread::sleep_for(std::chrono::nanoseconds(ns - now - 1000000));
+            else
+                std::this_thread::yield();
+        }
+    }
+};
+
+class HeadlessFrameClock : public FrameClock
+{
+public:
+    explicit HeadlessFrameClock(uint64_t start = 0) : m_now(start) {}
+
+    uint64_t NowNs() override { return m_now; }
+    void SleepUntil(uint64_t ns) override { if (ns > m_now) m_now = ns; }
+    // work that takes time: callbacks charge their cost here
+    void Advance(uint64_t ns) { m_now += ns; }
+
+private:
+    uint64_t m_now;
+};
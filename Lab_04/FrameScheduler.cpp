@@ -0,0 +1,118 @@
+#include "FrameScheduler.h"
+#include <algorithm>
+
+FrameScheduler::FrameScheduler(FrameClock& clock, const FrameSchedulerConfig& config)
+    : m_clock(clock), m_config(config)
+{
+    m_config.simulationHz = std::max(1.0, m_config.simulationHz);
+    m_config.renderHz = std::max(0.0, m_config.renderHz);
+    m_config.maxSimulationSteps = std::max(1, m_config.maxSimulationSteps);
+    m_intervals.reserve(kSamples);
+    m_work.reserve(kSamples);
+}
+
+bool FrameScheduler::Idle(uint64_t untilNs)
+{
+    for (;;)
+    {
+        if (m_stop.load(std::memory_order_relaxed))
+            return false;
+        if (m_pump)
+        {
+            if (!m_pump(untilNs))
+                return false;
+        }
+        else
+        {
+            m_clock.SleepUntil(untilNs);
+        }
+        // a pump may come back early with events handled; wait out the rest
+        if (m_clock.NowNs() >= untilNs)
+            return !m_stop.load(std::memory_order_relaxed);
+    }
+}
+
+static void Record(std::vector<uint32_t>& samples, uint64_t index, size_t capacity, uint64_t ns)
+{
+    uint32_t v = (uint32_t)std::min<uint64_t>(ns, UINT32_MAX);
+    if (samples.size() < capacity)
+        samples.push_back(v);
+    else
+        samples[index % capacity] = v;
+}
+
+void FrameScheduler::Run(uint64_t maxFrames)
+{
+    const uint64_t step = (uint64_t)(1e9 / m_config.simulationHz + 0.5);
+    const uint64_t period = m_config.renderHz > 0.0 ? (uint64_t)(1e9 / m_config.renderHz + 0.5) : 0;
+
+    uint64_t now = m_clock.NowNs();
+    uint64_t previous = now, lastStart = now, nextFrame = now;
+    uint64_t accumulator = 0;
+
+    for (uint64_t frame = 0; maxFrames == 0 || frame < maxFrames; frame++)
+    {
+        if (!Idle(period ? nextFrame : m_clock.NowNs()))
+            break;
+
+        uint64_t start = m_clock.NowNs();
+        accumulator += start - previous;
+        previous = start;
+
+        int steps = 0;
+        while (accumulator >= step && steps < m_config.maxSimulationSteps)
+        {
+            if (m_simulate)
+                m_simulate(step * 1e-9);
+            accumulator -= step;
+            steps++;
+        }
+        // after a stall, catching up would only make the next frame late too
+        if (accumulator >= step)
+        {
+            m_counts.droppedSteps += accumulator / step;
+            accumulator %= step;
+        }
+        m_counts.simulationSteps += steps;
+
+        if (m_render)
+            m_render((double)accumulator / step);
+
+        uint64_t end = m_clock.NowNs();
+        if (frame > 0)
+            Record(m_intervals, m_counts.frames, kSamples, start - lastStart);
+        Record(m_work, m_counts.frames, kSamples, end - start);
+        lastStart = start;
+        m_counts.frames++;
+
+        if (period)
+        {
+            nextFrame += period;
+            // late: count it and restart the cadence from now instead of bursting
+            if (end > nextFrame)
+            {
+                m_counts.missedDeadlines++;
+                nextFrame = end;
+            }
+        }
+    }
+}
+
+static double PercentileMs(std::vector<uint32_t> v, double p)
+{
+    if (v.empty())
+        return 0.0;
+    size_t k = std::min(v.size() - 1, (size_t)(p * (v.size() - 1) + 0.5));
+    std::nth_element(v.begin(), v.begin() + k, v.end());
+    return v[k] * 1e-6;
+}
+
+FrameStats FrameScheduler::Stats() const
+{
+    FrameStats s = m_counts;
+    s.intervalP50Ms = PercentileMs(m_intervals, .5);
+    s.intervalP99Ms = PercentileMs(m_intervals, .99);
+    s.workP50Ms = PercentileMs(m_work, .5);
+    s.workP99Ms = PercentileMs(m_work, .99);
+    return s;
+}
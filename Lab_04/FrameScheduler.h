@@ -0,0 +1,74 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "FrameClock.h"
+
+struct FrameSchedulerConfig
+{
+    double simulationHz = 60.0;  // fixed simulation step
+    double renderHz = 60.0;      // frame rate target; 0 renders as often as it can
+    int maxSimulationSteps = 5;  // per frame; the rest of a long stall is dropped
+};
+
+struct FrameStats
+{
+    uint64_t frames = 0;
+    uint64_t simulationSteps = 0;
+    uint64_t droppedSteps = 0;    // simulation time given up after long frames
+    uint64_t missedDeadlines = 0; // frames that ended after the next one was due
+    double intervalP50Ms = 0.0;   // frame start to frame start
+    double intervalP99Ms = 0.0;
+    double workP50Ms = 0.0;       // simulation + render of one frame
+    double workP99Ms = 0.0;
+};
+
+// Fixed-timestep simulation with interpolated rendering. Each frame runs as
+// many simulation steps as real time has accumulated (at most
+// maxSimulationSteps), then renders with alpha = how far the clock is into
+// the next step, so the renderer can blend the last two states.
+//
+// Between frames the scheduler idles until the next one is due: through the
+// pump when one is set (a platform step that handles window events and may
+// block on them until the deadline), otherwise by sleeping on the clock.
+class FrameScheduler
+{
+public:
+    using SimulateFunc = std::function<void(double dt)>;
+    using RenderFunc = std::function<void(double alpha)>;
+    // waits for and handles events until at most untilNs; false ends Run()
+    using PumpFunc = std::function<bool(uint64_t untilNs)>;
+
+    FrameScheduler(FrameClock& clock, const FrameSchedulerConfig& config);
+
+    void SetSimulate(SimulateFunc f) { m_simulate = std::move(f); }
+    void SetRender(RenderFunc f) { m_render = std::move(f); }
+    void SetPump(PumpFunc f) { m_pump = std::move(f); }
+
+    // runs frames until stopped, the pump says so, or maxFrames (0: no limit)
+    void Run(uint64_t maxFrames = 0);
+    // any thread; Run() returns after the current frame or wait. A stop made
+    // before Run() is kept, so Run() then returns at once
+    void RequestStop() { m_stop.store(true, std::memory_order_relaxed); }
+    // clears a stop so the scheduler can Run() again
+    void Reset() { m_stop.store(false, std::memory_order_relaxed); }
+
+    FrameStats Stats() const;
+
+private:
+    static const size_t kSamples = 4096; // frame times kept for the percentiles
+
+    bool Idle(uint64_t untilNs);
+
+    FrameClock& m_clock;
+    FrameSchedulerConfig m_config;
+    SimulateFunc m_simulate;
+    RenderFunc m_render;
+    PumpFunc m_pump;
+    std::atomic<bool> m_stop{false};
+
+    FrameStats m_counts;
+    std::vector<uint32_t> m_intervals; // ns, the last kSamples frames
+    std::vector<uint32_t> m_work;
+};
@@ -0,0 +1,177 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "InputReplay.h"
+
+// Throughput and latency of the input path without a window: a replay thread
+// produces, this thread consumes in per-frame batches like the simulation
+// loop does.
+//
+//   input_bench [--events N] [--rate HZ] [--frame-us US] [--realtime]
+//               [--replay FILE] [--record FILE] [--print-each]
+
+// a mouse at rate Hz with a key press every 1000 events
+static std::vector<InputEvent> MakeSyntheticInput(size_t count, double rate)
+{
+    std::vector<InputEvent> events(count);
+    double step = 1e9 / rate;
+    for (size_t i = 0; i < count; i++)
+    {
+        InputEvent& e = events[i];
+        e = {};
+        e.time = (uint64_t)(i * step);
+        if (i % 1000 == 500)
+        {
+            e.type = InputEventType::KeyDown;
+            e.code = 'W';
+        }
+        else if (i % 1000 == 510)
+        {
+            e.type = InputEventType::KeyUp;
+            e.code = 'W';
+        }
+        else if (i % 8 == 0)
+        {
+            e.type = InputEventType::MouseMove;
+            e.x = (int32_t)(i / 8 % 800);
+            e.y = (int32_t)(i / 64 % 600);
+        }
+        else
+        {
+            e.type = InputEventType::MouseDelta;
+            e.x = (int32_t)(i % 7) - 3;
+            e.y = (int32_t)(i % 5) - 2;
+        }
+    }
+    return events;
+}
+
+static double Percentile(std::vector<uint32_t>& v, double p)
+{
+    if (v.empty())
+        return 0.0;
+    size_t k = std::min(v.size() - 1, (size_t)(p * (v.size() - 1) + 0.5));
+    std::nth_element(v.begin(), v.begin() + k, v.end());
+    return v[k] / 1000.0;
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = 1000000;
+    double rate = 8000.0;
+    long frameUs = -1;
+    bool realtime = false;
+    bool printEach = false;
+    std::string replayPath, recordPath;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!std::strcmp(argv[i], "--events") && i + 1 < argc) count = (size_t)std::atoll(argv[++i]);
+        else if (!std::strcmp(argv[i], "--rate") && i + 1 < argc) rate = std::max(1.0, std::atof(argv[++i]));
+        else if (!std::strcmp(argv[i], "--frame-us") && i + 1 < argc) frameUs = std::atol(argv[++i]);
+        else if (!std::strcmp(argv[i], "--realtime")) realtime = true;
+        else if (!std::strcmp(argv[i], "--replay") && i + 1 < argc) replayPath = argv[++i];
+        else if (!std::strcmp(argv[i], "--record") && i + 1 < argc) recordPath = argv[++i];
+        else if (!std::strcmp(argv[i], "--print-each")) printEach = true;
+        else
+        {
+            std::cerr << "unknown argument " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+    // realtime runs drain once per 60 Hz frame, throughput runs as often as they can
+    if (frameUs < 0)
+        frameUs = realtime ? 16667 : 0;
+
+    std::vector<InputEvent> events;
+    if (!replayPath.empty())
+    {
+        if (!LoadInputEvents(replayPath, events))
+        {
+            std::cerr << "can't read " << replayPath << std::endl;
+            return 1;
+        }
+    }
+    else
+    {
+        events = MakeSyntheticInput(count, rate);
+    }
+    if (!recordPath.empty() && !SaveInputEvents(recordPath, events))
+    {
+        std::cerr << "can't write " << recordPath << std::endl;
+        return 1;
+    }
+
+    auto ring = std::make_unique<InputRing>();
+    InputReplay replay(*ring);
+    std::vector<uint32_t> latency;
+    latency.reserve(events.size());
+
+    // what a frame does with its batch: the cursor, the summed raw motion and the keys
+    int32_t cursorX = 0, cursorY = 0;
+    int64_t motionX = 0, motionY = 0;
+    bool keys[65536] = {};
+    size_t batches = 0, largest = 0;
+
+    uint64_t start = InputClockNs();
+    replay.Start(events, realtime);
+    uint64_t nextFrame = start;
+    for (;;)
+    {
+        bool finished = replay.Finished();
+        uint64_t now = InputClockNs();
+        size_t n = ring->Drain([&](const InputEvent& e)
+        {
+            latency.push_back((uint32_t)std::min<uint64_t>(now - e.time, UINT32_MAX));
+            switch (e.type)
+            {
+            case InputEventType::MouseMove:  cursorX = e.x; cursorY = e.y; break;
+            case InputEventType::MouseDelta: motionX += e.x; motionY += e.y; break;
+            case InputEventType::KeyDown:    keys[e.code] = true; break;
+            case InputEventType::KeyUp:      keys[e.code] = false; break;
+            default: break;
+            }
+            // what the window procedure used to do for every event
+            if (printEach)
+                std::cout << "Event " << (int)e.type << ": " << e.x << " " << e.y << std::endl;
+        });
+        if (n)
+        {
+            batches++;
+            largest = std::max(largest, n);
+        }
+        if (finished && n == 0 && ring->SizeApprox() == 0)
+            break;
+
+        if (frameUs > 0)
+        {
+            nextFrame += (uint64_t)frameUs * 1000;
+            uint64_t t = InputClockNs();
+            if (nextFrame > t)
+                std::this_thread::sleep_for(std::chrono::nanoseconds(nextFrame - t));
+        }
+        else if (n == 0)
+        {
+            std::this_thread::yield();
+        }
+    }
+    double seconds = (InputClockNs() - start) * 1e-9;
+    replay.Join();
+
+    std::cerr << latency.size() << " events (" << (realtime ? "realtime" : "as fast as possible")
+              << ", ring of " << InputRing::capacity() << "): " << seconds * 1000.0 << " ms, "
+              << latency.size() / seconds / 1e6 << " Mevents/s" << std::endl;
+    std::cerr << batches << " batches, " << (batches ? (double)latency.size() / batches : 0.0)
+              << " events per batch on average, " << largest << " at most; producer waited on a full ring "
+              << replay.FullWaits() << " times" << std::endl;
+    std::cerr << "push to drain latency, us: p50 " << Percentile(latency, .5) << ", p99 " << Percentile(latency, .99)
+              << ", p99.9 " << Percentile(latency, .999) << ", max " << Percentile(latency, 1.0) << std::endl;
+    std::cerr << "state: cursor " << cursorX << "," << cursorY << ", motion " << motionX << "," << motionY
+              << ", W " << (keys['W'] ? "down" : "up") << std::endl;
+    return 0;
+}
@@ -1,9 +1,9 @@
 #include "InputDevice.h"
-#include <iostream>
-#include <vector>
 
-void InputDevice::Initialize(HWND hwnd)
+void InputDevice::Initialize(HWND hwnd, InputRing& ring)
 {
+    m_ring = &ring;
+
     RAWINPUTDEVICE rid{};
 
     rid.usUsagePage = 0x01;
@@ -16,34 +16,40 @@ void InputDevice::Initialize(HWND hwnd)
 
 void InputDevice::ProcessRawInput(LPARAM lParam)
 {
-    UINT size = 0;
-
-    GetRawInputData((HRAWINPUT)lParam,
-                    RID_INPUT,
-                    nullptr,
-                    &size,
-                    sizeof(RAWINPUTHEADER));
-
-    if (size == 0)
-        return;
-
-    std::vector<BYTE> buffer(size);
+    // a mouse or keyboard packet always fits in one RAWINPUT, so no allocation
+    RAWINPUT raw;
+    UINT size = sizeof(raw);
 
     if (GetRawInputData((HRAWINPUT)lParam,
                         RID_INPUT,
-                        buffer.data(),
+                        &raw,
                         &size,
-                        sizeof(RAWINPUTHEADER)) != size)
+                        sizeof(RAWINPUTHEADER)) == (UINT)-1)
         return;
 
-    RAWINPUT* raw = reinterpret_cast<RAWINPUT*>(buffer.data());
+    if (raw.header.dwType == RIM_TYPEMOUSE)
+        HandleMouse(&raw);
+}
 
-    if (raw->header.dwType == RIM_TYPEMOUSE)
-    {
-        LONG dx = raw->data.mouse.lLastX;
-        LONG dy = raw->data.mouse.lLastY;
+void InputDevice::HandleMouse(const RAWINPUT* raw)
+{
+    const RAWMOUSE& mouse = raw->data.mouse;
+
+    if ((mouse.usFlags & MOUSE_MOVE_ABSOLUTE) == 0 && (mouse.lLastX != 0 || mouse.lLastY != 0))
+        Push(InputEventType::MouseDelta, mouse.lLastX, mouse.lLastY);
 
-        std::cout << "Mouse dx: " << dx
-                  << " dy: " << dy << std::endl;
-    }
+    if (mouse.usButtonFlags & RI_MOUSE_WHEEL)
+        Push(InputEventType::MouseWheel, 0, (SHORT)mouse.usButtonData);
+}
+
+void InputDevice::Push(InputEventType type, int32_t x, int32_t y)
+{
+    InputEvent e{};
+    e.time = InputClockNs();
+    e.type = type;
+    e.x = x;
+    e.y = y;
+
+    if (!m_ring || !m_ring->TryPush(e))
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
 }
@@ -1,13 +1,25 @@
 #pragma once
 #include <windows.h>
+#include <atomic>
+#include <cstdint>
+#include "InputRing.h"
 
+// Raw mouse input as the Win32 producer of an InputRing. Runs on the window's
+// message thread; a full ring drops the event rather than stall the loop.
+// Only the mouse is registered: keys come from WM_KEYDOWN/WM_KEYUP in Window,
+// which carry the autorepeat flag.
 class InputDevice
 {
 public:
-    void Initialize(HWND hwnd);
+    void Initialize(HWND hwnd, InputRing& ring);
     void ProcessRawInput(LPARAM lParam);
+    uint64_t Dropped() const { return m_dropped.load(std::memory_order_relaxed); }
 
 private:
-    void HandleKeyboard(const RAWINPUT* raw);
     void HandleMouse(const RAWINPUT* raw);
+    void Push(InputEventType type, int32_t x, int32_t y);
+
+private:
+    InputRing* m_ring = nullptr;
+    std::atomic<uint64_t> m_dropped{0};
 };
@@ -0,0 +1,38 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <type_traits>
+
+// Platform-neutral input event. Fixed size and trivially copyable, so it can
+// go through the ring buffer and into event files as raw bytes.
+enum class InputEventType : uint8_t
+{
+    None,
+    MouseMove,   // x, y: cursor position in client pixels
+    MouseDelta,  // x, y: raw relative motion
+    MouseWheel,  // y: wheel delta
+    ButtonDown,  // code: 0 left, 1 right, 2 middle; x, y: position
+    ButtonUp,
+    KeyDown,     // code: virtual key
+    KeyUp,
+};
+
+struct InputEvent
+{
+    uint64_t time;        // InputClockNs() when the producer saw it
+    InputEventType type;
+    uint8_t flags;        // KeyDown: 1 for auto-repeat
+    uint16_t code;
+    int32_t x;
+    int32_t y;
+};
+
+static_assert(std::is_trivially_copyable_v<InputEvent>, "input events are copied as bytes");
+static_assert(sizeof(InputEvent) == 24, "the event file format depends on this layout");
+
+// Monotonic nanoseconds shared by producers and consumers.
+inline uint64_t InputClockNs()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,103 @@
+#include "InputReplay.h"
+#include <cstdio>
+#include <cstring>
+
+static const char     kMagic[4] = {'I', 'N', 'E', 'V'};
+static const uint32_t kVersion  = 1;
+
+bool SaveInputEvents(const std::string& path, const std::vector<InputEvent>& events)
+{
+    FILE* f = std::fopen(path.c_str(), "wb");
+    if (!f)
+        return false;
+
+    uint32_t version = kVersion;
+    uint64_t count = events.size();
+    bool ok = std::fwrite(kMagic, sizeof(kMagic), 1, f) == 1
+           && std::fwrite(&version, sizeof(version), 1, f) == 1
+           && std::fwrite(&count, sizeof(count), 1, f) == 1
+           && (count == 0 || std::fwrite(events.data(), sizeof(InputEvent), events.size(), f) == events.size());
+    return std::fclose(f) == 0 && ok;
+}
+
+bool LoadInputEvents(const std::string& path, std::vector<InputEvent>& events)
+{
+    FILE* f = std::fopen(path.c_str(), "rb");
+    if (!f)
+        return false;
+
+    char magic[4];
+    uint32_t version = 0;
+    uint64_t count = 0;
+    bool ok = std::fread(magic, sizeof(magic), 1, f) == 1
+           && std::memcmp(magic, kMagic, sizeof(kMagic)) == 0
+           && std::fread(&version, sizeof(version), 1, f) == 1
+           && version == kVersion
+           && std::fread(&count, sizeof(count), 1, f) == 1
+           && count <= (1ull << 32);
+    if (ok)
+    {
+        events.resize((size_t)count);
+        ok = count == 0 || std::fread(events.data(), sizeof(InputEvent), events.size(), f) == events.size();
+    }
+    std::fclose(f);
+    if (!ok)
+        events.clear();
+    return ok;
+}
+
+InputReplay::InputReplay(InputRing& ring) : m_ring(ring) {}
+
+InputReplay::~InputReplay()
+{
+    Join();
+}
+
+void InputReplay::Start(std::vector<InputEvent> events, bool realtime)
+{
+    Join();
+    m_events = std::move(events);
+    m_finished.store(false, std::memory_order_relaxed);
+    m_pushed.store(0, std::memory_order_relaxed);
+    m_fullWaits.store(0, std::memory_order_relaxed);
+    m_thread = std::thread([this, realtime] { Run(realtime); });
+}
+
+void InputReplay::Join()
+{
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+void InputReplay::Run(bool realtime)
+{
+    uint64_t start = InputClockNs();
+    uint64_t first = m_events.empty() ? 0 : m_events.front().time;
+
+    for (InputEvent e : m_events)
+    {
+        if (realtime)
+        {
+            // sleep for the long gaps, spin for the last stretch
+            uint64_t due = start + (e.time - first);
+            for (uint64_t now = InputClockNs(); now < due; now = InputClockNs())
+            {
+                if (due - now > 2000000)
+                    std::this_thread::sleep_for(std::chrono::nanoseconds(due - now - 1000000));
+                else
+                    std::this_thread::yield();
+            }
+        }
+
+        e.time = InputClockNs();
+        while (!m_ring.TryPush(e))
+        {
+            m_fullWaits.fetch_add(1, std::memory_order_relaxed);
+            std::this_thread::yield();
+            e.time = InputClockNs();
+        }
+        m_pushed.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    m_finished.store(true, std::memory_order_release);
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+#include "InputRing.h"
+
+// Recorded input: "INEV", a version, the event count, then the events as
+// raw little-endian InputEvent records. Event times are kept as recorded;
+// replay only uses the gaps between them.
+bool SaveInputEvents(const std::string& path, const std::vector<InputEvent>& events);
+bool LoadInputEvents(const std::string& path, std::vector<InputEvent>& events);
+
+// Headless producer: feeds recorded events into a ring from its own thread,
+// the way the window procedure feeds live ones. Each event is restamped with
+// the time it is pushed, so the consumer measures queueing latency the same
+// way for both producers.
+class InputReplay
+{
+public:
+    explicit InputReplay(InputRing& ring);
+    ~InputReplay();
+
+    // realtime=true keeps the recorded gaps between events; false pushes as
+    // fast as the consumer frees slots (throughput runs). A full ring makes
+    // the replay wait instead of dropping.
+    void Start(std::vector<InputEvent> events, bool realtime);
+    void Join();
+    bool Finished() const { return m_finished.load(std::memory_order_acquire); }
+    uint64_t Pushed() const { return m_pushed.load(std::memory_order_relaxed); }
+    uint64_t FullWaits() const { return m_fullWaits.load(std::memory_order_relaxed); }
+
+private:
+    void Run(bool realtime);
+
+    InputRing& m_ring;
+    std::vector<InputEvent> m_events;
+    std::thread m_thread;
+    std::atomic<bool> m_finished{false};
+    std::atomic<uint64_t> m_pushed{0};
+    std::atomic<uint64_t> m_fullWaits{0};
+};
@@ -0,0 +1,90 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include "InputEvent.h"
+
+// Lock-free single-producer/single-consumer ring. The producer (window
+// procedure, replay thread) only calls TryPush; the consumer (simulation
+// thread) only calls Pop/Drain. Head and tail sit on their own cache lines,
+// and each side keeps a cached copy of the other's index so a push or pop
+// touches the shared line only when the cached one says full or empty.
+template<typename T, size_t Capacity>
+class SpscRing
+{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+    static_assert(std::is_trivially_copyable_v<T>, "ring items are copied as bytes");
+
+public:
+    SpscRing() : m_items(new T[Capacity]) {}
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // producer side; false when the ring is full, the producer decides
+    // whether to wait or drop
+    bool TryPush(const T& item)
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tailCache == Capacity)
+        {
+            m_tailCache = m_tail.load(std::memory_order_acquire);
+            if (head - m_tailCache == Capacity)
+                return false;
+        }
+        m_items[head & Mask] = item;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side; copies up to max items into out
+    size_t Pop(T* out, size_t max)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (m_headCache == tail)
+            m_headCache = m_head.load(std::memory_order_acquire);
+        size_t n = std::min(m_headCache - tail, max);
+        for (size_t i = 0; i < n; i++)
+            out[i] = m_items[(tail + i) & Mask];
+        m_tail.store(tail + n, std::memory_order_release);
+        return n;
+    }
+
+    // consumer side; hands every item available now to f, in place, and
+    // frees the slots once at the end of the batch
+    template<typename F>
+    size_t Drain(F&& f)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        size_t head = m_head.load(std::memory_order_acquire);
+        m_headCache = head;
+        for (size_t i = tail; i != head; i++)
+            f(m_items[i & Mask]);
+        m_tail.store(head, std::memory_order_release);
+        return head - tail;
+    }
+
+    // either side; exact only when the other side is idle
+    size_t SizeApprox() const
+    {
+        return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+    }
+
+    static constexpr size_t capacity() { return Capacity; }
+
+private:
+    static constexpr size_t Mask = Capacity - 1;
+
+    alignas(64) std::atomic<size_t> m_head{0};   // written by the producer
+    size_t m_tailCache = 0;                      // producer's view of m_tail
+    alignas(64) std::atomic<size_t> m_tail{0};   // written by the consumer
+    size_t m_headCache = 0;                      // consumer's view of m_head
+    alignas(64) std::unique_ptr<T[]> m_items;
+};
+
+// 4096 events hold half a second of an 8 kHz mouse, so a stalled frame or two
+// never drops input.
+using InputRing = SpscRing<InputEvent, 4096>;
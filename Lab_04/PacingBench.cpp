@@ -0,0 +1,122 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include "FrameScheduler.h"
+#include "InputRing.h"
+
+// Runs the frame scheduler against a synthetic workload. By default on the
+// headless clock, so the numbers depend only on the arguments and repeat
+// exactly; --real runs the same workload on the steady clock.
+//
+//   pacing_bench [--frames N] [--sim-hz HZ] [--render-hz HZ] [--max-steps N]
+//                [--work-ms MS] [--spike-every N] [--spike-ms MS]
+//                [--input-hz HZ] [--no-pump] [--real]
+
+int main(int argc, char** argv)
+{
+    FrameSchedulerConfig config;
+    uint64_t frames = 600;
+    double workMs = 4.0, spikeMs = 40.0, inputHz = 1000.0;
+    int spikeEvery = 100;
+    bool real = false, pump = true;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!std::strcmp(argv[i], "--frames") && i + 1 < argc) frames = (uint64_t)std::atoll(argv[++i]);
+        else if (!std::strcmp(argv[i], "--sim-hz") && i + 1 < argc) config.simulationHz = std::atof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--render-hz") && i + 1 < argc) config.renderHz = std::atof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--max-steps") && i + 1 < argc) config.maxSimulationSteps = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--work-ms") && i + 1 < argc) workMs = std::atof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--spike-every") && i + 1 < argc) spikeEvery = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--spike-ms") && i + 1 < argc) spikeMs = std::atof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--input-hz") && i + 1 < argc) inputHz = std::max(0.0, std::atof(argv[++i]));
+        else if (!std::strcmp(argv[i], "--no-pump")) pump = false;
+        else if (!std::strcmp(argv[i], "--real")) real = true;
+        else
+        {
+            std::cerr << "unknown argument " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    HeadlessFrameClock headless(1000000000ull);
+    SteadyFrameClock steady;
+    FrameClock& clock = real ? (FrameClock&)steady : (FrameClock&)headless;
+
+    // costs are charged to the headless clock, or spent spinning on the real one
+    auto spend = [&](double ms)
+    {
+        uint64_t ns = (uint64_t)(ms * 1e6);
+        if (real)
+            steady.SleepUntil(steady.NowNs() + ns);
+        else
+            headless.Advance(ns);
+    };
+
+    auto ring = std::make_unique<InputRing>();
+    std::vector<uint32_t> ages; // push to simulation, ns
+    uint64_t frame = 0;
+    double position = 0.0, previous = 0.0, drawn = 0.0;
+    uint64_t inputPeriod = inputHz > 0.0 ? (uint64_t)(1e9 / inputHz) : 0;
+    uint64_t nextInput = clock.NowNs();
+
+    FrameScheduler scheduler(clock, config);
+    scheduler.SetSimulate([&](double dt)
+    {
+        uint64_t now = clock.NowNs();
+        ring->Drain([&](const InputEvent& e) { ages.push_back((uint32_t)std::min<uint64_t>(now - e.time, UINT32_MAX)); });
+        previous = position;
+        position += dt;
+        spend(.1);
+    });
+    scheduler.SetRender([&](double alpha)
+    {
+        drawn = previous + (position - previous) * alpha;
+        spend(spikeEvery > 0 && frame % (uint64_t)spikeEvery == (uint64_t)spikeEvery - 1 ? spikeMs : workMs);
+        frame++;
+    });
+    // a platform step: input arrives at a fixed rate while the scheduler waits
+    if (pump)
+    {
+        scheduler.SetPump([&](uint64_t until)
+        {
+            uint64_t wake = inputPeriod ? std::min(until, nextInput) : until;
+            clock.SleepUntil(wake);
+            for (uint64_t now = clock.NowNs(); inputPeriod && nextInput <= now; nextInput += inputPeriod)
+            {
+                InputEvent e{};
+                e.time = nextInput;
+                e.type = InputEventType::MouseDelta;
+                e.x = 1;
+                ring->TryPush(e);
+            }
+            return true;
+        });
+    }
+
+    uint64_t start = clock.NowNs();
+    scheduler.Run(frames);
+    double seconds = (clock.NowNs() - start) * 1e-9;
+
+    FrameStats s = scheduler.Stats();
+    std::sort(ages.begin(), ages.end());
+    auto agePct = [&](double p) { return ages.empty() ? 0.0 : ages[(size_t)(p * (ages.size() - 1))] * 1e-6; };
+
+    std::cerr << (real ? "steady" : "headless") << " clock, sim " << config.simulationHz << " Hz, render "
+              << config.renderHz << " Hz, " << workMs << " ms per frame";
+    if (spikeEvery > 0)
+        std::cerr << ", " << spikeMs << " ms every " << spikeEvery << " frames";
+    std::cerr << std::endl;
+    std::cerr << s.frames << " frames in " << seconds << " s, " << s.simulationSteps << " simulation steps, "
+              << s.droppedSteps << " dropped, " << s.missedDeadlines << " missed deadlines" << std::endl;
+    std::cerr << "frame interval p50 " << s.intervalP50Ms << " ms, p99 " << s.intervalP99Ms << " ms; work p50 "
+              << s.workP50Ms << " ms, p99 " << s.workP99Ms << " ms" << std::endl;
+    if (!ages.empty())
+        std::cerr << ages.size() << " input events, age at simulation p50 " << agePct(.5) << " ms, p99 "
+                  << agePct(.99) << " ms" << std::endl;
+    std::cerr << "simulated " << position << " s, drawn at " << drawn << " s" << std::endl;
+    return 0;
+}
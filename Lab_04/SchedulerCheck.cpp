@@ -0,0 +1,88 @@
+#include <cmath>
+#include <iostream>
+#include "FrameScheduler.h"
+
+// Checks the frame scheduler on the headless clock, where every count is
+// exact: steps, dropped steps and missed deadlines around a stall, and stops
+// requested before Run() and from inside a frame. Exits 1 on a mismatch.
+//
+//   scheduler_check
+
+static int failures = 0;
+
+static void Expect(const char* what, uint64_t got, uint64_t want)
+{
+    if (got == want)
+        return;
+    std::cerr << what << ": " << got << ", expected " << want << std::endl;
+    failures++;
+}
+
+// 60 Hz both ways, 4 ms frames and one 150 ms frame. The frame after the stall
+// owes 9 steps: it runs maxSimulationSteps = 5 and drops 3, the last partial
+// step stays in the accumulator.
+static void CheckStall()
+{
+    HeadlessFrameClock clock(1000000000ull);
+    FrameScheduler scheduler(clock, FrameSchedulerConfig{});
+    const uint64_t frames = 30, stall = 10;
+    uint64_t frame = 0, steps = 0;
+    scheduler.SetSimulate([&](double) { steps++; });
+    scheduler.SetRender([&](double) { clock.Advance(frame++ == stall ? 150000000ull : 4000000ull); });
+    scheduler.Run(frames);
+
+    FrameStats s = scheduler.Stats();
+    Expect("stall: frames", s.frames, frames);
+    Expect("stall: rendered", frame, frames);
+    // none on the first frame, one per frame after, 5 instead of 1 after the stall
+    Expect("stall: simulation steps", s.simulationSteps, frames - 1 + 4);
+    Expect("stall: simulate calls", steps, s.simulationSteps);
+    Expect("stall: dropped steps", s.droppedSteps, 3);
+    Expect("stall: missed deadlines", s.missedDeadlines, 1);
+    if (std::fabs(s.intervalP50Ms - 1000.0 / 60) > 1e-3)
+    {
+        std::cerr << "stall: interval p50 " << s.intervalP50Ms << " ms, expected " << 1000.0 / 60 << std::endl;
+        failures++;
+    }
+}
+
+// a stop before Run() must not be lost, or Window's simulation thread never joins
+static void CheckStopBeforeRun()
+{
+    HeadlessFrameClock clock;
+    FrameScheduler scheduler(clock, FrameSchedulerConfig{});
+    uint64_t frame = 0;
+    scheduler.SetRender([&](double) { frame++; });
+    scheduler.RequestStop();
+    scheduler.Run(5);
+    Expect("stop before run: frames", frame, 0);
+
+    scheduler.Reset();
+    scheduler.Run(3);
+    Expect("after reset: frames", frame, 3);
+}
+
+// a stop during a frame ends Run() before the next one
+static void CheckStopInFrame()
+{
+    HeadlessFrameClock clock;
+    FrameScheduler scheduler(clock, FrameSchedulerConfig{});
+    uint64_t frame = 0;
+    scheduler.SetRender([&](double)
+    {
+        clock.Advance(4000000ull);
+        if (++frame == 6)
+            scheduler.RequestStop();
+    });
+    scheduler.Run();
+    Expect("stop in frame: frames", scheduler.Stats().frames, 6);
+}
+
+int main()
+{
+    CheckStall();
+    CheckStopBeforeRun();
+    CheckStopInFrame();
+    std::cerr << (failures ? "FAILED" : "ok") << std::endl;
+    return failures ? 1 : 0;
+}
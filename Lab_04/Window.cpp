@@ -1,7 +1,9 @@
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #include <windowsx.h>
+#include <algorithm>
 #include <iostream>
+#include "FrameScheduler.h"
 #include "Window.h"
 
 bool Window::Initialize(HINSTANCE instance, int showCmd)
@@ -41,6 +43,8 @@ bool Window::Initialize(HINSTANCE instance, int showCmd)
     if (!m_hwnd)
         return false;
 
+    m_input.Initialize(m_hwnd, *m_events);
+
     ShowWindow(m_hwnd, showCmd);
     UpdateWindow(m_hwnd);
 
@@ -51,19 +55,100 @@ int Window::Run()
 {
     MSG msg = {};
 
-    while (!m_exitRequested)
-    {
-        while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
-        {
-            TranslateMessage(&msg);
-            DispatchMessage(&msg);
-        }
+    m_simulation = std::jthread([this](std::stop_token stop) { Simulate(stop); });
 
+    // the message thread sleeps until there is input instead of spinning
+    while (!m_exitRequested && GetMessage(&msg, nullptr, 0, 0) > 0)
+    {
+        TranslateMessage(&msg);
+        DispatchMessage(&msg);
     }
 
+    m_simulation.request_stop();
+    m_simulation.join();
+
     return (int)msg.wParam;
 }
 
+void Window::Push(InputEventType type, uint16_t code, int32_t x, int32_t y, uint8_t flags)
+{
+    InputEvent e{};
+    e.time = InputClockNs();
+    e.type = type;
+    e.flags = flags;
+    e.code = code;
+    e.x = x;
+    e.y = y;
+
+    if (!m_events->TryPush(e))
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Runs the simulation on the frame scheduler: each fixed step drains the ring,
+// and each rendered frame prints one line if input arrived since the last.
+// The message thread pumps events, so this thread just sleeps between frames.
+void Window::Simulate(std::stop_token stop)
+{
+    SteadyFrameClock clock;
+    FrameScheduler scheduler(clock, FrameSchedulerConfig{});
+    std::stop_callback onStop(stop, [&] { scheduler.RequestStop(); });
+
+    int32_t cursorX = 0, cursorY = 0;
+    int64_t motionX = 0, motionY = 0;
+    bool keys[256] = {};
+    uint64_t frame = 0, oldest = 0;
+    size_t events = 0;
+    int wheel = 0;
+
+    scheduler.SetSimulate([&](double)
+    {
+        uint64_t now = InputClockNs();
+        events += m_events->Drain([&](const InputEvent& e)
+        {
+            oldest = std::max(oldest, now - e.time);
+            switch (e.type)
+            {
+            case InputEventType::MouseMove:  cursorX = e.x; cursorY = e.y; break;
+            case InputEventType::MouseDelta: motionX += e.x; motionY += e.y; break;
+            case InputEventType::MouseWheel: wheel += e.y; break;
+            case InputEventType::KeyDown:    keys[e.code & 255] = true; break;
+            case InputEventType::KeyUp:      keys[e.code & 255] = false; break;
+            default: break;
+            }
+        });
+    });
+
+    scheduler.SetRender([&](double)
+    {
+        frame++;
+        if (events == 0)
+            return;
+
+        int held = 0;
+        for (bool k : keys)
+            held += k;
+
+        std::cout << "Frame " << frame << ": " << events << " events"
+                  << ", cursor " << cursorX << "," << cursorY
+                  << ", raw motion " << motionX << "," << motionY
+                  << ", wheel " << wheel
+                  << ", keys held " << held
+                  << ", oldest " << oldest / 1000 << " us"
+                  << ", dropped " << m_dropped.load(std::memory_order_relaxed) + m_input.Dropped()
+                  << std::endl;
+        events = 0;
+        oldest = 0;
+        wheel = 0;
+    });
+
+    scheduler.Run();
+
+    FrameStats s = scheduler.Stats();
+    std::cout << s.frames << " frames, " << s.missedDeadlines << " missed deadlines"
+              << ", frame interval p50 " << s.intervalP50Ms << " ms, p99 " << s.intervalP99Ms << " ms"
+              << std::endl;
+}
+
 LRESULT CALLBACK Window::WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 {
     if (msg == WM_CREATE)
@@ -90,20 +175,35 @@ LRESULT Window::HandleMessage(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
     {
     case WM_MOUSEMOVE:
     {
-        int x = GET_X_LPARAM(lParam);
-        int y = GET_Y_LPARAM(lParam);
-
-        std::cout << "Mouse Position: X = "
-                  << x << " Y = "
-                  << y << std::endl;
+        Push(InputEventType::MouseMove, 0, GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam));
+        return 0;
+    }
 
+    case WM_LBUTTONDOWN:
+    case WM_RBUTTONDOWN:
+    case WM_MBUTTONDOWN:
+    case WM_LBUTTONUP:
+    case WM_RBUTTONUP:
+    case WM_MBUTTONUP:
+    {
+        bool down = msg == WM_LBUTTONDOWN || msg == WM_RBUTTONDOWN || msg == WM_MBUTTONDOWN;
+        uint16_t button = (msg == WM_LBUTTONDOWN || msg == WM_LBUTTONUP) ? 0
+                        : (msg == WM_RBUTTONDOWN || msg == WM_RBUTTONUP) ? 1 : 2;
+        Push(down ? InputEventType::ButtonDown : InputEventType::ButtonUp,
+             button, GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam));
         return 0;
     }
 
+    case WM_INPUT:
+    {
+        m_input.ProcessRawInput(lParam);
+        return DefWindowProc(hwnd, msg, wParam, lParam);
+    }
+
     case WM_KEYDOWN:
     {
-        std::cout << "Key Down: "
-                  << wParam << std::endl;
+        // bit 30: the key was already down, this is auto-repeat
+        Push(InputEventType::KeyDown, (uint16_t)wParam, 0, 0, (lParam & (1 << 30)) ? 1 : 0);
 
         if (wParam == VK_ESCAPE)
         {
@@ -116,8 +216,7 @@ LRESULT Window::HandleMessage(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 
     case WM_KEYUP:
     {
-        std::cout << "Key Up: "
-                  << wParam << std::endl;
+        Push(InputEventType::KeyUp, (uint16_t)wParam, 0, 0);
         return 0;
     }
 
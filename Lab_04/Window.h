@@ -1,6 +1,16 @@
 #pragma once
 #include <windows.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <stop_token>
+#include <thread>
+#include "InputDevice.h"
+#include "InputRing.h"
 
+// The message thread only turns window messages into InputEvents and pushes
+// them; a simulation thread drains the ring once per frame and acts on the
+// whole batch.
 class Window
 {
 public:
@@ -10,9 +20,16 @@ public:
 private:
     static LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
     LRESULT HandleMessage(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
+    void Push(InputEventType type, uint16_t code, int32_t x, int32_t y, uint8_t flags = 0);
+    void Simulate(std::stop_token stop);
 
 private:
     HWND m_hwnd = nullptr;
     HINSTANCE m_instance = nullptr;
     bool m_exitRequested = false;
+
+    std::unique_ptr<InputRing> m_events = std::make_unique<InputRing>();
+    InputDevice m_input;
+    std::atomic<uint64_t> m_dropped{0};
+    std::jthread m_simulation;
 };